@@ -250,6 +250,11 @@
 #define HOST_64BIT_CPU
 #endif
 
+// The software renderer needs SSE2
+#if HOST_CPU == CPU_X86 || HOST_CPU == CPU_X64
+#define HAVE_SOFTREND
+#endif
+
 // Some restrictions on FEAT_NO_RWX_PAGES
 #if defined(FEAT_NO_RWX_PAGES) && FEAT_SHREC == DYNAREC_JIT
 #if HOST_CPU != CPU_X64 && HOST_CPU != CPU_ARM64
@@ -9,6 +9,14 @@
 #include <string>
 #include <iomanip>
 #include <cctype>
+#include <algorithm>
+
+// Only 64-bit targets have the address space to map whole disc images
+#if !defined(_WIN32) && !defined(HAVE_LIBNX) && (defined(__LP64__) || defined(_LP64))
+#define COREIO_MMAP
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #define TRUE 1
 #define FALSE 0
@@ -24,6 +32,10 @@ struct CORE_FILE {
 
    std::string host;
 	int port;
+
+	const u8* map;
+	size_t map_size;
+	bool map_failed;
 };
 
 core_file* core_fopen(const char* filename)
@@ -33,6 +45,9 @@ core_file* core_fopen(const char* filename)
 	CORE_FILE* rv = new CORE_FILE();
 	rv->f = 0;
 	rv->path = p;
+	rv->map = NULL;
+	rv->map_size = 0;
+	rv->map_failed = false;
   {
 		rv->f = fopen(filename, "rb");
 
@@ -83,6 +98,10 @@ int core_fclose(core_file* fc)
 {
    CORE_FILE* f = (CORE_FILE*)fc;
 
+#ifdef COREIO_MMAP
+   if (f->map)
+      munmap((void*)f->map, f->map_size);
+#endif
    if (f->f)
       fclose(f->f);
 
@@ -104,3 +123,45 @@ size_t core_fsize(core_file* fc)
    }
    return 0;
 }
+
+const u8* core_fmap(core_file* fc, size_t* size)
+{
+   CORE_FILE* f = (CORE_FILE*)fc;
+
+#ifdef COREIO_MMAP
+   if (f->map == NULL && !f->map_failed && f->f)
+   {
+      size_t file_size = core_fsize(fc);
+      void* p = file_size == 0 ? MAP_FAILED : mmap(NULL, file_size, PROT_READ, MAP_SHARED, fileno(f->f), 0);
+      if (p == MAP_FAILED)
+      {
+         WARN_LOG(COMMON, "Cannot map %s, using buffered reads", f->path.c_str());
+         f->map_failed = true;
+      }
+      else
+      {
+         f->map = (const u8*)p;
+         f->map_size = file_size;
+      }
+   }
+#endif
+   *size = f->map_size;
+   return f->map;
+}
+
+void core_fadvise(core_file* fc, size_t offs, size_t len, bool sequential)
+{
+#ifdef COREIO_MMAP
+   CORE_FILE* f = (CORE_FILE*)fc;
+   if (f->map == NULL || offs >= f->map_size)
+      return;
+   len = std::min(len, f->map_size - offs);
+   // madvise needs a page aligned address
+   static const size_t page_mask = sysconf(_SC_PAGESIZE) - 1;
+   size_t start = offs & ~page_mask;
+   u8* addr = (u8*)f->map + start;
+   len += offs - start;
+   madvise(addr, len, sequential ? MADV_SEQUENTIAL : MADV_NORMAL);
+   madvise(addr, len, MADV_WILLNEED);
+#endif
+}
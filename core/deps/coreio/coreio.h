@@ -10,4 +10,10 @@ size_t core_fseek(core_file* fc, size_t offs, size_t origin);
 int core_fread(core_file* fc, void* buff, size_t len);
 int core_fclose(core_file* fc);
 size_t core_fsize(core_file* fc);
-size_t core_ftell(core_file* fc);
\ No newline at end of file
+size_t core_ftell(core_file* fc);
+
+// Maps the whole file for reading. Returns NULL if the platform or the file doesn't allow it.
+// The mapping is shared by all callers and released by core_fclose.
+const u8* core_fmap(core_file* fc, size_t* size);
+// Hints that [offs, offs + len) of a mapped file is going to be read, sequentially or not
+void core_fadvise(core_file* fc, size_t offs, size_t len, bool sequential);
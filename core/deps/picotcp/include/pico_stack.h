@@ -66,6 +66,8 @@ int pico_stack_init(void);
 /* ----- Loop Function. ----- */
 void pico_stack_tick(void);
 void pico_stack_loop(void);
+/* Milliseconds until the next timer expires, -1 if there is none */
+int32_t pico_stack_next_timeout(void);
 
 /* ---- Notifications for stack errors */
 int pico_notify_socket_unreachable(struct pico_frame *f);
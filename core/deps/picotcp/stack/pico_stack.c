@@ -813,6 +813,28 @@ void pico_stack_tick(void)
     calc_score(score, index, (int (*)[])avg, ret);
 }
 
+int32_t pico_stack_next_timeout(void)
+{
+    struct pico_timer_ref *tref;
+    pico_time now;
+    if (!Timers)
+        return -1;
+
+    tref = heap_first(Timers);
+    if (!tref)
+        return -1;
+
+    now = PICO_TIME_MS();
+    /* timers fire once their expiration time is strictly in the past */
+    if (tref->expire < now)
+        return 0;
+
+    if (tref->expire - now >= 0x7fffffff)
+        return 0x7fffffff;
+
+    return (int32_t)(tref->expire - now + 1);
+}
+
 void pico_stack_loop(void)
 {
     while(1) {
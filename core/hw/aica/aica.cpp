@@ -89,7 +89,7 @@ const int AICA_TICK = 145125;	// 44.1 KHz / 32
 static int AicaUpdate(int tag, int c, int j)
 {
    aicaarm::run(32);
-	if (!settings.aica.NoBatch && !settings.aica.DSPEnabled)
+	if (!settings.aica.NoBatch)
 		AICA_Sample32();
 
 	return AICA_TICK;
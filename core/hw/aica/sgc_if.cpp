@@ -299,6 +299,21 @@ enum _EG_state
 
 struct ChannelEx;
 
+#define SAMPLE_BLOCK 32
+
+// Per-sample inputs of a channel for a block of samples, see ChannelEx::StepBlock()
+struct ChannelBlock
+{
+	SampleType s0[SAMPLE_BLOCK];
+	SampleType s1[SAMPLE_BLOCK];
+	s32 fp[SAMPLE_BLOCK];
+	u32 fv[SAMPLE_BLOCK];
+	s32 gLeft[SAMPLE_BLOCK];
+	s32 gRight[SAMPLE_BLOCK];
+	s32 gDsp[SAMPLE_BLOCK];
+	SampleType sample[SAMPLE_BLOCK];
+};
+
 static void (* STREAM_STEP_LUT[5][2][2])(ChannelEx* ch);
 static void (* STREAM_INITAL_STEP_LUT[5])(ChannelEx* ch);
 static void (* AEG_STEP_LUT[4])(ChannelEx* ch);
@@ -441,6 +456,53 @@ struct ChannelEx
 
 		return rv;
 	}
+	// Low-pass filter
+	__forceinline SampleType Filter(SampleType sample, u32 fv)
+	{
+		s32 f = (((fv & 0xFF) | 0x100) << 4) >> ((fv >> 8) ^ 0x1F);
+		f = std::max(1, f);
+		sample = f * sample + (0x2000 - f + FEG.q) * FEG.prev1 - FEG.q * FEG.prev2;
+		sample >>= 13;
+		clip16(sample);
+		FEG.prev2 = FEG.prev1;
+		FEG.prev1 = sample;
+
+		return sample;
+	}
+	__forceinline void GetGains(s32& gLeft, s32& gRight, s32& gDsp)
+	{
+		//Volume & Mixer processing
+		//All attenuations are added together then applied and mixed :)
+		
+		//offset is up to 511
+		//*Att is up to 511
+		//logtable handles up to 1024, anything >=255 is mute
+
+		u32 ofsatt;
+		if (ccd->VOFF == 1)
+		{
+			ofsatt = 0;
+		}
+		else
+		{
+			ofsatt = lfo.alfo + (AEG.GetValue() >> 2);
+			ofsatt = std::min(ofsatt, (u32)255); // make sure it never gets more 255 -- it can happen with some alfo/aeg combinations
+		}
+		u32 const max_att = ((16 << 4) - 1) - ofsatt;
+		
+		s32* logtable = ofsatt + tl_lut;
+
+		gLeft = logtable[std::min(VolMix.DLAtt, max_att)];
+		gRight = logtable[std::min(VolMix.DRAtt, max_att)];
+		gDsp = logtable[std::min(VolMix.DSPAtt, max_att)];
+	}
+	__forceinline void StepState()
+	{
+		StepAEG(this);
+		StepFEG(this);
+		StepStream(this);
+		lfo.Step(this);
+	}
 	__forceinline bool Step(SampleType& oLeft, SampleType& oRight, SampleType& oDsp)
 	{
 		if (!enabled)
@@ -452,47 +514,15 @@ struct ChannelEx
 		{
 			SampleType sample = InterpolateSample();
 
-			// Low-pass filter
 			if (FEG.active)
-			{
-				u32 fv = FEG.GetValue();
-				s32 f = (((fv & 0xFF) | 0x100) << 4) >> ((fv >> 8) ^ 0x1F);
-				f = std::max(1, f);
-				sample = f * sample + (0x2000 - f + FEG.q) * FEG.prev1 - FEG.q * FEG.prev2;
-				sample >>= 13;
-				clip16(sample);
-				FEG.prev2 = FEG.prev1;
-				FEG.prev1 = sample;
-			}
-
-			//Volume & Mixer processing
-			//All attenuations are added together then applied and mixed :)
-			
-			//offset is up to 511
-			//*Att is up to 511
-			//logtable handles up to 1024, anything >=255 is mute
-
-			u32 ofsatt;
-			if (ccd->VOFF == 1)
-			{
-				ofsatt = 0;
-			}
-			else
-			{
-				ofsatt = lfo.alfo + (AEG.GetValue() >> 2);
-				ofsatt = std::min(ofsatt, (u32)255); // make sure it never gets more 255 -- it can happen with some alfo/aeg combinations
-			}
-			u32 const max_att = ((16 << 4) - 1) - ofsatt;
-			
-			s32* logtable = ofsatt + tl_lut;
+				sample = Filter(sample, FEG.GetValue());
 
-			u32 dl = std::min(VolMix.DLAtt, max_att);
-			u32 dr = std::min(VolMix.DRAtt, max_att);
-			u32 ds = std::min(VolMix.DSPAtt, max_att);
+			s32 gLeft, gRight, gDsp;
+			GetGains(gLeft, gRight, gDsp);
 
-			oLeft = FPMul(sample, logtable[dl], 15);
-			oRight = FPMul(sample, logtable[dr], 15);
-			oDsp = FPMul(sample, logtable[ds], 11);	// 20 bits
+			oLeft = FPMul(sample, gLeft, 15);
+			oRight = FPMul(sample, gRight, 15);
+			oDsp = FPMul(sample, gDsp, 11);	// 20 bits
 
 			clip_verify(((s16)oLeft)==oLeft);
 			clip_verify(((s16)oRight)==oRight);
@@ -501,14 +531,31 @@ struct ChannelEx
 			clip_verify(sample*oRight>=0);
 			clip_verify((s64)sample*oDsp>=0);
 
-			StepAEG(this);
-			StepFEG(this);
-			StepStream(this);
-			lfo.Step(this);
+			StepState();
 			return true;
 		}
 	}
 
+	// Scalar part of a batched Step(): records the interpolation inputs, filter
+	// value and volume gains of up to count samples while stepping the channel.
+	// Returns the number of samples generated before the channel got disabled.
+	u32 StepBlock(ChannelBlock& blk, u32 count)
+	{
+		u32 i;
+		for (i = 0; i < count && enabled; i++)
+		{
+			blk.s0[i] = s0;
+			blk.s1[i] = s1;
+			blk.fp[i] = step.fp;
+			if (FEG.active)
+				blk.fv[i] = FEG.GetValue();
+			GetGains(blk.gLeft[i], blk.gRight[i], blk.gDsp[i]);
+
+			StepState();
+		}
+		return i;
+	}
+
 	__forceinline void Step(SampleType& mixl, SampleType& mixr)
 	{
 		SampleType oLeft,oRight,oDsp;
@@ -1345,122 +1392,9 @@ void WriteCommonReg8(u32 reg,u32 data)
 s16 cdda_sector[CDDA_SIZE]={0};
 u32 cdda_index=CDDA_SIZE<<1;
 
-//no DSP for now in this version
-void AICA_Sample32()
-{
-	SampleType mxlr[64];
-	memset(mxlr,0,sizeof(mxlr));
-
-	//Generate 32 samples for each channel, before moving to next channel
-	//much more cache efficient !
-	u32 sg=0;
-	for (int ch = 0; ch < 64; ch++)
-	{
-		for (int i=0;i<32;i++)
-		{
-			SampleType oLeft,oRight,oDsp;
-			//stop working on this channel if its turned off ...
-			if (!Chans[ch].Step(oLeft, oRight, oDsp))
-				break;
-
-			sg++;
-
-         if (oLeft + oRight == 0)
-            oLeft = oRight = oDsp;
-
-			mxlr[i*2+0] += oLeft;
-			mxlr[i*2+1] += oRight;
-		}
-	}
-	//OK , generated all Channels  , now DSP/ect + final mix ;p
-	//CDDA EXTS input
-	
-	for (int i=0;i<32;i++)
-	{
-		SampleType mixl,mixr;
-
-		mixl=mxlr[i*2+0];
-		mixr=mxlr[i*2+1];
-
-		if (cdda_index>=CDDA_SIZE)
-		{
-			cdda_index=0;
-			libCore_CDDA_Sector(cdda_sector);
-		}
-		s32 EXTS0L=cdda_sector[cdda_index];
-		s32 EXTS0R=cdda_sector[cdda_index+1];
-		cdda_index+=2;
-
-		//Final MIX ..
-		//Add CDDA / DSP effect(s)
-
-		//CDDA
-		if (settings.aica.CDDAMute==0) 
-		{
-			VOLPAN(EXTS0L,dsp_out_vol[16].EFSDL,dsp_out_vol[16].EFPAN,mixl,mixr);
-			VOLPAN(EXTS0R,dsp_out_vol[17].EFSDL,dsp_out_vol[17].EFPAN,mixl,mixr);
-		}
-
-		/*
-		no dsp for now -- needs special handling of oDSP for ch paraller version ...
-		if (settings.aica.DSPEnabled)
-		{
-			dsp_step();
-
-			for (int i=0;i<16;i++)
-			{
-				VOLPAN( (*(s16*)&DSPData->EFREG[i]) ,dsp_out_vol[i].EFSDL,dsp_out_vol[i].EFPAN,mixl,mixr);
-			}
-		}
-		*/
-
-		//Mono !
-		if (CommonData->Mono)
-		{
-			//Yay for mono =P
-			mixl+=mixr;
-			mixr=mixl;
-		}
-
-		//MVOL !
-		//we want to make sure mix* is *At least* 23 bits wide here, so 64 bit mul !
-		u32 mvol=CommonData->MVOL;
-		s32 val=volume_lut[mvol];
-		mixl=(s32)FPMul((s64)mixl,val,15);
-		mixr=(s32)FPMul((s64)mixr,val,15);
-
-
-		if (CommonData->DAC18B)
-		{
-			//If 18 bit output , make it 16b :p
-			mixl=FPs(mixl,2);
-			mixr=FPs(mixr,2);
-		}
-
-		//Sample is ready ! clip/saturate and store :}
-
-#ifdef CLIP_WARN
-	if (((s16)mixl) != mixl || ((s16)mixr) != mixr)
-		printf("Clipped mixl %d mixr %d\n", mixl, mixr);
-#endif
-
-		clip16(mixl);
-		clip16(mixr);
-
-		if (!settings.aica.NoSound) WriteSample(mixr,mixl);
-	}
-}
-
-void AICA_Sample()
+// CDDA, DSP effects and master volume. Writes the final sample.
+static void MixSample(SampleType mixl, SampleType mixr)
 {
-	SampleType mixl,mixr;
-	mixl = 0;
-	mixr = 0;
-	memset(dsp.MIXS,0,sizeof(dsp.MIXS));
-
-	ChannelEx::StepAll(mixl,mixr);
-	
-	//OK , generated all Channels  , now DSP/ect + final mix ;p
 	//CDDA EXTS input
 	
 	if (cdda_index>=CDDA_SIZE)
@@ -1538,6 +1472,177 @@ void AICA_Sample()
 	WriteSample(mixr,mixl);
 }
 
+/*
+	Batched synthesis
+
+	Each channel generates a block of samples before moving to the next one.
+	The channel state machines (AEG, FEG, LFO, stream decoding) run sample by
+	sample in StepBlock(), then interpolation, volume and mixing are done for
+	the whole block, 4 samples at a time when SIMD is available.
+	All operations are the same 32-bit integer ops as ChannelEx::Step(), and all
+	intermediate values fit in 32 bits, so the result is identical to calling
+	AICA_Sample() for each sample with the same register state.
+*/
+#if defined(__SSE2__) || defined(_M_X64)
+#define AICA_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define AICA_NEON
+#include <arm_neon.h>
+#endif
+
+#ifdef AICA_SSE2
+typedef __m128i v4s32;
+
+static inline v4s32 v_load(const s32 *p) { return _mm_loadu_si128((const __m128i *)p); }
+static inline void v_store(s32 *p, v4s32 v) { _mm_storeu_si128((__m128i *)p, v); }
+static inline v4s32 v_set1(s32 x) { return _mm_set1_epi32(x); }
+static inline v4s32 v_add(v4s32 a, v4s32 b) { return _mm_add_epi32(a, b); }
+static inline v4s32 v_sub(v4s32 a, v4s32 b) { return _mm_sub_epi32(a, b); }
+// Low 32 bits of the products (no pmulld in SSE2)
+static inline v4s32 v_mul(v4s32 a, v4s32 b)
+{
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+#define v_sra(a, n) _mm_srai_epi32(a, n)
+// t == 0 ? a : b
+static inline v4s32 v_select_zero(v4s32 t, v4s32 a, v4s32 b)
+{
+	__m128i mask = _mm_cmpeq_epi32(t, _mm_setzero_si128());
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+#endif
+
+#ifdef AICA_NEON
+typedef int32x4_t v4s32;
+
+static inline v4s32 v_load(const s32 *p) { return vld1q_s32(p); }
+static inline void v_store(s32 *p, v4s32 v) { vst1q_s32(p, v); }
+static inline v4s32 v_set1(s32 x) { return vdupq_n_s32(x); }
+static inline v4s32 v_add(v4s32 a, v4s32 b) { return vaddq_s32(a, b); }
+static inline v4s32 v_sub(v4s32 a, v4s32 b) { return vsubq_s32(a, b); }
+static inline v4s32 v_mul(v4s32 a, v4s32 b) { return vmulq_s32(a, b); }
+#define v_sra(a, n) vshrq_n_s32(a, n)
+static inline v4s32 v_select_zero(v4s32 t, v4s32 a, v4s32 b)
+{
+	return vbslq_s32(vceqq_s32(t, vdupq_n_s32(0)), a, b);
+}
+#endif
+
+// sample = s0 * (1024 - fp) >> 10 + s1 * fp >> 10, as in ChannelEx::InterpolateSample()
+static void InterpolateBlock(ChannelBlock& blk)
+{
+#if defined(AICA_SSE2) || defined(AICA_NEON)
+	const v4s32 one = v_set1(1024);
+	for (int i = 0; i < SAMPLE_BLOCK; i += 4)
+	{
+		v4s32 fp = v_load(&blk.fp[i]);
+		v4s32 a = v_sra(v_mul(v_load(&blk.s0[i]), v_sub(one, fp)), 10);
+		v4s32 b = v_sra(v_mul(v_load(&blk.s1[i]), fp), 10);
+		v_store(&blk.sample[i], v_add(a, b));
+	}
+#else
+	for (int i = 0; i < SAMPLE_BLOCK; i++)
+		blk.sample[i] = FPMul(blk.s0[i], 1024 - blk.fp[i], 10) + FPMul(blk.s1[i], blk.fp[i], 10);
+#endif
+}
+
+// Applies the channel volumes and adds the result to the mix and DSP input buffers
+static void MixBlock(const ChannelBlock& blk, SampleType *mixl, SampleType *mixr, SampleType *mixs)
+{
+	const bool dsp_enabled = settings.aica.DSPEnabled;
+#if defined(AICA_SSE2) || defined(AICA_NEON)
+	for (int i = 0; i < SAMPLE_BLOCK; i += 4)
+	{
+		v4s32 sample = v_load(&blk.sample[i]);
+		v4s32 oLeft = v_sra(v_mul(sample, v_load(&blk.gLeft[i])), 15);
+		v4s32 oRight = v_sra(v_mul(sample, v_load(&blk.gRight[i])), 15);
+		v4s32 oDsp = v_sra(v_mul(sample, v_load(&blk.gDsp[i])), 11);
+
+		v_store(&mixs[i], v_add(v_load(&mixs[i]), oDsp));
+		if (!dsp_enabled)
+		{
+			v4s32 sum = v_add(oLeft, oRight);
+			oLeft = v_select_zero(sum, v_sra(oDsp, 4), oLeft);
+			oRight = v_select_zero(sum, v_sra(oDsp, 4), oRight);
+		}
+		v_store(&mixl[i], v_add(v_load(&mixl[i]), oLeft));
+		v_store(&mixr[i], v_add(v_load(&mixr[i]), oRight));
+	}
+#else
+	for (int i = 0; i < SAMPLE_BLOCK; i++)
+	{
+		SampleType oLeft = FPMul(blk.sample[i], blk.gLeft[i], 15);
+		SampleType oRight = FPMul(blk.sample[i], blk.gRight[i], 15);
+		SampleType oDsp = FPMul(blk.sample[i], blk.gDsp[i], 11);
+
+		mixs[i] += oDsp;
+		if (oLeft + oRight == 0 && !dsp_enabled)
+			oLeft = oRight = oDsp >> 4;
+		mixl[i] += oLeft;
+		mixr[i] += oRight;
+	}
+#endif
+}
+
+void AICA_Sample32()
+{
+	alignas(16) SampleType mixl[SAMPLE_BLOCK];
+	alignas(16) SampleType mixr[SAMPLE_BLOCK];
+	alignas(16) SampleType mixs[16][SAMPLE_BLOCK];
+	alignas(16) ChannelBlock blk;
+	memset(mixl, 0, sizeof(mixl));
+	memset(mixr, 0, sizeof(mixr));
+	memset(mixs, 0, sizeof(mixs));
+
+	//Generate 32 samples for each channel, before moving to next channel
+	//much more cache efficient !
+	for (int ch = 0; ch < 64; ch++)
+	{
+		ChannelEx& chan = Chans[ch];
+		if (!chan.enabled)
+			continue;
+		SampleType *dspOut = mixs[chan.VolMix.DSPOut - dsp.MIXS];
+		bool filter = chan.FEG.active;
+
+		u32 count = chan.StepBlock(blk, SAMPLE_BLOCK);
+		// Samples after the channel is disabled are silent
+		for (u32 i = count; i < SAMPLE_BLOCK; i++)
+		{
+			blk.s0[i] = blk.s1[i] = blk.fp[i] = 0;
+			blk.gLeft[i] = blk.gRight[i] = blk.gDsp[i] = 0;
+		}
+		InterpolateBlock(blk);
+		if (filter)
+			for (u32 i = 0; i < count; i++)
+				blk.sample[i] = chan.Filter(blk.sample[i], blk.fv[i]);
+		MixBlock(blk, mixl, mixr, dspOut);
+	}
+
+	//OK , generated all Channels  , now DSP/ect + final mix ;p
+	for (int i = 0; i < SAMPLE_BLOCK; i++)
+	{
+		for (int j = 0; j < 16; j++)
+			dsp.MIXS[j] = mixs[j][i];
+		MixSample(mixl[i], mixr[i]);
+	}
+}
+
+void AICA_Sample()
+{
+	SampleType mixl,mixr;
+	mixl = 0;
+	mixr = 0;
+	memset(dsp.MIXS,0,sizeof(dsp.MIXS));
+
+	ChannelEx::StepAll(mixl,mixr);
+	
+	//OK , generated all Channels  , now DSP/ect + final mix ;p
+	MixSample(mixl, mixr);
+}
+
 bool channel_serialize(void **data, unsigned int *total_size)
 {
 	int i = 0 ;
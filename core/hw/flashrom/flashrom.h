@@ -5,6 +5,7 @@
 #pragma once
 #include <math.h>
 #include "types.h"
+#include "writeback.h"
 
 struct MemChip
 {
@@ -53,6 +54,11 @@ struct MemChip
 
 	bool Load(const std::string& file)
 	{
+		if (wb_read(file, data + write_protect_size, size - write_protect_size))
+		{
+			this->load_filename = file;
+			return true;
+		}
 		FILE* f=fopen(file.c_str(),"rb");
 		if (f)
 		{
@@ -73,12 +79,7 @@ struct MemChip
 
 	void Save(const std::string& file)
 	{
-		FILE* f=fopen(file.c_str(),"wb");
-		if (f)
-		{
-			fwrite(data + write_protect_size, 1, size - write_protect_size, f);
-			fclose(f);
-		}
+		wb_write(file, data + write_protect_size, size - write_protect_size);
 	}
 
 	bool Load(const std::string& root,const char *prefix,const char *names_ro,const char *title)
@@ -0,0 +1,164 @@
+/*
+	Write-behind of save files (VMU, EEPROM and flash)
+*/
+#include "writeback.h"
+#include "stdclass.h"
+#include "oslib/oslib.h"
+
+#include <atomic>
+#include <map>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// Time without new writes to wait for before flushing
+#define WB_IDLE_DELAY_MS 250
+// Maximum time a write can stay pending
+#define WB_MAX_DELAY_MS 2000
+
+struct PendingFile
+{
+	std::vector<u8> data;
+	bool dirty;
+};
+
+static std::map<std::string, PendingFile> pending_files;
+static cMutex wb_mutex;
+
+static bool wb_write_file(const std::string& path, const std::vector<u8>& data)
+{
+	std::string tmp_path = path + ".tmp";
+	FILE *f = fopen(tmp_path.c_str(), "wb");
+	if (f == NULL)
+	{
+		WARN_LOG(COMMON, "Cannot create %s", tmp_path.c_str());
+		return false;
+	}
+	bool ok = data.empty() || fwrite(&data[0], 1, data.size(), f) == data.size();
+	ok = fflush(f) == 0 && ok;
+#ifndef _WIN32
+	ok = fsync(fileno(f)) == 0 && ok;
+#endif
+	fclose(f);
+	if (ok)
+	{
+#ifdef _WIN32
+		ok = MoveFileExA(tmp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+		ok = rename(tmp_path.c_str(), path.c_str()) == 0;
+#endif
+	}
+	if (!ok)
+	{
+		WARN_LOG(COMMON, "Error writing %s", path.c_str());
+		remove(tmp_path.c_str());
+	}
+	return ok;
+}
+
+// Never runs concurrently: called by the background thread, by wb_term() once it's
+// stopped, or by wb_write() when there are no threads
+static void wb_flush_pending()
+{
+	while (true)
+	{
+		// Write one file at a time so that the emulation thread isn't blocked
+		std::string path;
+		std::vector<u8> data;
+		wb_mutex.lock();
+		for (auto& it : pending_files)
+			if (it.second.dirty)
+			{
+				path = it.first;
+				data = it.second.data;
+				it.second.dirty = false;
+				break;
+			}
+		wb_mutex.unlock();
+		if (path.empty())
+			break;
+
+		if (wb_write_file(path, data))
+			DEBUG_LOG(COMMON, "Saved %s (%d bytes)", path.c_str(), (int)data.size());
+		wb_mutex.lock();
+		// Forget files that are saved and haven't changed since
+		auto it = pending_files.find(path);
+		if (it != pending_files.end() && !it->second.dirty)
+			pending_files.erase(it);
+		wb_mutex.unlock();
+	}
+}
+
+#ifndef TARGET_NO_THREADS
+static cResetEvent wb_event;
+static std::atomic<bool> wb_exit;
+
+static void *wb_thread_func(void *)
+{
+	while (!wb_exit)
+	{
+		wb_event.Wait();
+		// Wait for the writes of a save to be finished
+		double start = os_GetSeconds();
+		while (!wb_exit && os_GetSeconds() - start < WB_MAX_DELAY_MS / 1000.0
+				&& wb_event.Wait(WB_IDLE_DELAY_MS))
+			;
+		wb_flush_pending();
+	}
+	return NULL;
+}
+
+static cThread wb_thread(wb_thread_func, NULL);
+#endif
+
+void wb_write(const std::string& path, const u8 *data, u32 size, u32 offset, u32 len)
+{
+	verify(offset + len <= size);
+	wb_mutex.lock();
+	PendingFile& file = pending_files[path];
+	if (file.data.size() != size)
+		file.data.assign(data, data + size);
+	else
+		memcpy(&file.data[offset], data + offset, len);
+	file.dirty = true;
+	wb_mutex.unlock();
+
+#ifndef TARGET_NO_THREADS
+	if (wb_thread.hThread == NULL)
+	{
+		wb_exit = false;
+		wb_thread.Start();
+	}
+	wb_event.Set();
+#else
+	wb_flush_pending();
+#endif
+}
+
+bool wb_read(const std::string& path, u8 *data, u32 size)
+{
+	wb_mutex.lock();
+	auto it = pending_files.find(path);
+	bool found = it != pending_files.end() && it->second.data.size() == size;
+	if (found && size > 0)
+		memcpy(data, &it->second.data[0], size);
+	wb_mutex.unlock();
+
+	return found;
+}
+
+void wb_term()
+{
+#ifndef TARGET_NO_THREADS
+	if (wb_thread.hThread != NULL)
+	{
+		wb_exit = true;
+		wb_event.Set();
+		wb_thread.WaitToEnd();
+	}
+#endif
+	wb_flush_pending();
+}
@@ -0,0 +1,23 @@
+/*
+	Write-behind of save files (VMU, EEPROM and flash)
+
+	Writes are kept in memory per file and flushed by a background thread so
+	that slow storage doesn't stall the emulation thread. The writes made to a
+	file in a short period of time are coalesced. Each flush writes the whole
+	file to a temporary file, syncs it and renames it over the original, so that
+	a crash can't leave a partially written save.
+*/
+#pragma once
+#include "types.h"
+
+// Schedules writing data, the whole content of the file, to path.
+// Only [offset, offset + len) has changed since the previous write of this file.
+void wb_write(const std::string& path, const u8 *data, u32 size, u32 offset, u32 len);
+static inline void wb_write(const std::string& path, const u8 *data, u32 size)
+{
+	wb_write(path, data, size, 0, size);
+}
+// Gets the content of a file that is waiting to be written. Returns false if there is none.
+bool wb_read(const std::string& path, u8 *data, u32 size);
+// Writes all the pending files and stops the background thread
+void wb_term();
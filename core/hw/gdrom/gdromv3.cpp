@@ -104,19 +104,53 @@ void gd_spi_pio_end(const u8* buffer, u32 len, gd_states next_state = gds_pio_en
 void gd_process_spi_cmd();
 void gd_process_ata_cmd();
 
+// Next DMA buffer fill, read in the background while the current one is transferred
+static struct
+{
+	bool pending;
+	u32 start_sector;
+	u32 sector_count;
+	u32 sector_type;
+	u8 data[sizeof(read_buff.cache)];
+} read_ahead;
+
+static u32 ReadBufferSectors(void)
+{
+	return std::min(read_params.remaining_sectors, (u32)sizeof(read_buff.cache) / 2352);
+}
+
+static void StartReadAhead(void)
+{
+	u32 count = ReadBufferSectors();
+	read_ahead.pending = count != 0;
+	if (!read_ahead.pending)
+		return;
+	read_ahead.start_sector = read_params.start_sector;
+	read_ahead.sector_count = count;
+	read_ahead.sector_type = read_params.sector_type;
+	libGDR_ReadSectorAsync(read_ahead.data, read_ahead.start_sector, count, read_ahead.sector_type);
+}
+
 static void FillReadBuffer(void)
 {
 	read_buff.cache_index=0;
-	u32 count = read_params.remaining_sectors;
-
-	if (count > 32)
-		count = 32;
+	u32 count = ReadBufferSectors();
 
 	read_buff.cache_size=count*read_params.sector_type;
 
-	libGDR_ReadSector(read_buff.cache,read_params.start_sector,count,read_params.sector_type);
+	if (read_ahead.pending && read_ahead.start_sector == read_params.start_sector
+			&& read_ahead.sector_count == count && read_ahead.sector_type == read_params.sector_type)
+	{
+		libGDR_WaitRead();
+		memcpy(read_buff.cache, read_ahead.data, read_buff.cache_size);
+	}
+	else
+		libGDR_ReadSector(read_buff.cache,read_params.start_sector,count,read_params.sector_type);
+	read_ahead.pending = false;
 	read_params.start_sector+=count;
 	read_params.remaining_sectors-=count;
+
+	StartReadAhead();
 }
 
 void gd_set_state(gd_states state)
@@ -206,7 +240,10 @@ void gd_set_state(gd_states state)
 			break;
 			
 		case gds_readsector_dma:
- 			FillReadBuffer();
+			// The buffer is filled when the DMA needs it. Until then the first sectors are read in the background.
+			read_buff.cache_index = 0;
+			read_buff.cache_size = 0;
+			StartReadAhead();
 			break;
 
 		case gds_pio_end:
@@ -320,6 +357,8 @@ void libCore_gdrom_disc_change()
 	set_mode_offset = 0;
 	packet_cmd = { 0 };
 	memset(&read_buff, 0, sizeof(read_buff));
+	libGDR_WaitRead();
+	read_ahead.pending = false;
 	pio_buff = { gds_waitcmd, 0 };
 	ata_cmd = { 0 };
 	cdda = { cdda_t::NoInfo, 0 };
@@ -613,6 +652,7 @@ void gd_process_spi_cmd()
 			else
 				read_params.remaining_sectors = (packet_cmd.data_8[6] << 8) | packet_cmd.data_8[7];
 			read_params.sector_type = sector_type;//yeah i know , not really many types supported...
+			libGDR_ReadAhead(read_params.start_sector, read_params.remaining_sectors);
 
 			printf_spicmd("SPI_CD_READ - Sector=%d Size=%d/%d DMA=%d",read_params.start_sector,read_params.remaining_sectors,read_params.sector_type,Features.CDRead.DMA);
 			if (Features.CDRead.DMA == 1)
@@ -1068,6 +1108,10 @@ static int GDRomschd(int i, int c, int j)
 	if(!(SB_GDST&1) || !(SB_GDEN &1) || (read_buff.cache_size==0 && read_params.remaining_sectors==0))
 		return 0;
 
+	// Collect the sectors read in the background before sizing the transfer
+	if (read_buff.cache_size == 0)
+		FillReadBuffer();
+
    u32 src = SB_GDSTARD;
    u32 len = (SB_GDLEN == 0 ? 0x02000000 : SB_GDLEN) - SB_GDLEND;
 
@@ -5,6 +5,7 @@
 #include "maple_cfg.h"
 #include "hw/pvr/spg.h"
 #include "hw/naomi/naomi_cart.h"
+#include "hw/flashrom/writeback.h"
 #include <math.h>
 #include <time.h>
 
@@ -546,7 +547,7 @@ u8 vmu_default[] = {
 
 struct maple_sega_vmu: maple_base
 {
-	FILE* file;
+	std::string save_path;
 	u8 flash_data[128*1024];
 	u8 lcd_data[192];
 	u8 lcd_data_decoded[VMU_SCREEN_WIDTH*VMU_SCREEN_HEIGHT];
@@ -574,7 +575,7 @@ struct maple_sega_vmu: maple_base
 	{
 		memset(flash_data,0,sizeof(flash_data));
 		memset(lcd_data,0,sizeof(lcd_data));
-      std::string apath = get_writable_vmu_path(logical_port);
+		save_path = get_writable_vmu_path(logical_port);
 
 		vmu_screen_params[bus_id].vmu_lcd_screen = lcd_data_decoded ;
 
@@ -585,33 +586,25 @@ struct maple_sega_vmu: maple_base
 		verify(rv == Z_OK);
 		verify(dec_sz == sizeof(flash_data));
 
-		file=fopen(apath.c_str(),"rb+");
-		if (!file)
+		// The last writes may not be saved yet
+		if (wb_read(save_path, flash_data, sizeof(flash_data)))
 		{
-			INFO_LOG(MAPLE, "Unable to open VMU save file \"%s\", creating new file",apath.c_str());
-			file=fopen(apath.c_str(),"wb");
-			if (file) {
-				fwrite(flash_data, sizeof(flash_data), 1, file);
-				fseek(file,0,SEEK_SET);
-			} else {
-				INFO_LOG(MAPLE, "Unable to create VMU!");
-			}
+			NOTICE_LOG(MAPLE, "Loaded VMU from pending writes to \"%s\"", save_path.c_str());
+			return;
 		}
-
+		FILE *file = fopen(save_path.c_str(), "rb");
 		if (!file)
 		{
-			WARN_LOG(MAPLE, "Failed to create VMU save file \"%s\"", apath.c_str());
+			INFO_LOG(MAPLE, "Unable to open VMU save file \"%s\", creating new file", save_path.c_str());
+			wb_write(save_path, flash_data, sizeof(flash_data));
 		}
 		else
 		{
 			fread(flash_data,1,sizeof(flash_data),file);
-			NOTICE_LOG(MAPLE, "Loaded VMU from file \"%s\"", apath.c_str());
+			fclose(file);
+			NOTICE_LOG(MAPLE, "Loaded VMU from file \"%s\"", save_path.c_str());
 		}
 	}
-	virtual ~maple_sega_vmu()
-	{
-		if (file) fclose(file);
-	}
 	virtual u32 dma(u32 cmd)
 	{
 		//printf("maple_sega_vmu::dma Called for port %d:%d, Command %d\n", bus_id, bus_port, cmd);
@@ -816,16 +809,8 @@ struct maple_sega_vmu: maple_base
 						}
 						rptr(&flash_data[write_adr],write_len);
 
-						if (file)
-						{
-							fseek(file,write_adr,SEEK_SET);
-							fwrite(&flash_data[write_adr],1,write_len,file);
-							fflush(file);
-						}
-						else
-						{
-							INFO_LOG(MAPLE, "Failed to save VMU %s data", logical_port);
-						}
+						// Saved in the background
+						wb_write(save_path, flash_data, sizeof(flash_data), write_adr, write_len);
 						return MDRS_DeviceReply;//just ko
 					}
 
@@ -2355,14 +2340,7 @@ struct maple_naomi_jamma : maple_sega_controller
 				//printState(Command,buffer_in,buffer_in_len);
 				memcpy(EEPROM + address, dma_buffer_in + 4, size);
 
-				FILE* f = fopen(eeprom_file, "wb");
-				if (f)
-				{
-				   fwrite(EEPROM, 1, 0x80, f);
-				   fclose(f);
-				}
-				else
-					WARN_LOG(MAPLE, "Cannot save EEPROM to file %s", eeprom_file);
+				wb_write(eeprom_file, (const u8 *)EEPROM, 0x80);
 
 				w8(MDRS_JVSReply);
 				w8(0x00);
@@ -2376,15 +2354,21 @@ struct maple_naomi_jamma : maple_sega_controller
 
 			case 0x3:	//EEPROM read
 			{
-				FILE* f = fopen(eeprom_file, "rb");
-				if (f)
+				// The last write may not be saved yet
+				if (wb_read(eeprom_file, (u8 *)EEPROM, 0x80))
+					DEBUG_LOG(MAPLE, "Loaded EEPROM from pending writes to %s", eeprom_file);
+				else
 				{
-				   fread(EEPROM, 1, 0x80, f);
-				   fclose(f);
-				   DEBUG_LOG(MAPLE, "Loaded EEPROM from %s", eeprom_file);
+					FILE* f = fopen(eeprom_file, "rb");
+					if (f)
+					{
+					   fread(EEPROM, 1, 0x80, f);
+					   fclose(f);
+					   DEBUG_LOG(MAPLE, "Loaded EEPROM from %s", eeprom_file);
+					}
+					else if (naomi_default_eeprom != NULL)
+						memcpy(EEPROM, naomi_default_eeprom, 0x80);
 				}
-				else if (naomi_default_eeprom != NULL)
-					memcpy(EEPROM, naomi_default_eeprom, 0x80);
 
 				//printf("EEprom READ\n");
 				int address = dma_buffer_in[1];
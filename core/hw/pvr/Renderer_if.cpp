@@ -5,6 +5,10 @@
 #include "hw/mem/_vmem.h"
 #include "cheats.h"
 #include "spg.h"
+#include "ta_capture.h"
+#include "emulator.h"
+
+#include <atomic>
 
 /*
 
@@ -84,6 +88,19 @@ u32 fb_w_cur = 1;
 
 int max_idx,max_mvo,max_op,max_pt,max_tr,max_vtx,max_modt, ovrn;
 bool pend_rend = false;
+#if !defined(TARGET_NO_THREADS)
+// Contexts queued by the emulation thread, and contexts parsed by the render thread.
+// Parsing reads VRAM, the palette and the PVR registers, so the emulation thread
+// must not go on until all the queued contexts are parsed.
+static u32 queued_contexts;
+static std::atomic<u32> parsed_contexts;
+
+static void rend_context_parsed()
+{
+	parsed_contexts.fetch_add(1, std::memory_order_release);
+	re.Set();
+}
+#endif
 
 static bool render_called = false;
 u32 fb_watch_addr_start;
@@ -120,6 +137,12 @@ void rend_create_renderer()
 		NOTICE_LOG(PVR, "Creating Vulkan per-pixel renderer");
 		renderer = rend_OITVulkan();
 		break;
+#endif
+#ifdef HAVE_SOFTREND
+	case 6:
+		NOTICE_LOG(PVR, "Creating software renderer");
+		renderer = rend_softrend();
+		break;
 #endif
 	}
 #endif
@@ -168,12 +191,16 @@ bool rend_frame(TA_context* ctx, bool draw_osd)
    }
    bool proc = renderer->Process(ctx);
 #if !defined(TARGET_NO_THREADS)
-   if (settings.rend.ThreadedRendering && (!proc || (!ctx->rend.isRenderFramebuffer && !ctx->rend.isRTT)))
+   if (settings.rend.ThreadedRendering && (!proc || !ctx->rend.isRTT))
 	   // If rendering to texture, continue locking until the frame is rendered
-      re.Set();
+	   rend_context_parsed();
 #endif
-   
+
    bool do_swp = proc && renderer->Render();
+#if !defined(TARGET_NO_THREADS)
+   if (settings.rend.ThreadedRendering && proc && ctx->rend.isRTT)
+	   rend_context_parsed();
+#endif
 
    return do_swp;
 }
@@ -190,7 +217,8 @@ bool rend_single_frame(void)
 #if !defined(TARGET_NO_THREADS)
 				if (settings.rend.ThreadedRendering)
 				{
-					if (!rs.Wait(100))
+					// Several frames can be queued for a single signal
+					if (!rend_framePending() && !rs.Wait(100))
 						return false;
 					if (do_swap)
 					{
@@ -220,9 +248,6 @@ bool rend_single_frame(void)
 		swap_pending = do_swp && !_pvrrc->rend.isRenderFramebuffer && FB_R_SOF1 != FB_W_SOF1
 				 && settings.rend.ThreadedRendering && settings.rend.DelayFrameSwapping;
 
-		if (settings.rend.ThreadedRendering && _pvrrc->rend.isRTT)
-			re.Set();
-
 		//clear up & free data ..
 		FinishRender(_pvrrc);
 		_pvrrc=0;
@@ -265,6 +290,9 @@ void rend_start_render(void)
          ctx->rend.fog_clamp_min = FOG_CLAMP_MIN;
 			ctx->rend.fog_clamp_max = FOG_CLAMP_MAX;
 
+         if (!ctx->rend.isRenderFramebuffer)
+            ta_capture_frame(ctx);
+
          max_idx              = std::max(max_idx,  ctx->rend.idx.used());
          max_vtx              = std::max(max_vtx,  ctx->rend.verts.used());
          max_op               = std::max(max_op,   ctx->rend.global_param_op.used());
@@ -274,12 +302,16 @@ void rend_start_render(void)
          max_mvo              = std::max(max_mvo,  ctx->rend.global_param_mvo.used());
          max_modt             = std::max(max_modt, ctx->rend.modtrig.used());
 
+         // The render thread can pick up the context as soon as it's queued
+         palette_update();
          if (QueueRender(ctx))
          {
-            palette_update();
 #if !defined(TARGET_NO_THREADS)
             if (settings.rend.ThreadedRendering)
+            {
+            	queued_contexts++;
             	rs.Set();
+            }
             else
 #endif
             	rend_single_frame();
@@ -301,7 +333,11 @@ void rend_end_render(void)
    {
 #if !defined(TARGET_NO_THREADS)
 	   if (settings.rend.ThreadedRendering)
-		   re.Wait();
+	   {
+		   // Queued frames can still be waiting to be rendered, but they must all be parsed
+		   while (parsed_contexts.load(std::memory_order_acquire) != queued_contexts && dc_is_running())
+			   re.Wait();
+	   }
 	   else
 #endif
 		  if(renderer != NULL)
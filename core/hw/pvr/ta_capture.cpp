@@ -0,0 +1,267 @@
+/*
+	TA context capture and replay
+
+	A capture holds everything the renderer-side processing of a frame depends on:
+	the PVR registers (including the palette), VRAM and the TA data of the context,
+	stored with SerializeTAContext. Replaying it runs ta_parse_vdrc and GenSorted
+	without any emulation or GPU, so their cost can be measured reproducibly.
+*/
+#include "ta_capture.h"
+#include "ta_ctx.h"
+#include "pvr_mem.h"
+#include "Renderer_if.h"
+#include "oslib/oslib.h"
+#include "rend/TexCache.h"
+#include "rend/sorter.h"
+#include "file/file_path.h"
+
+#include <cinttypes>
+
+static const u32 CAPTURE_MAGIC = 0x50434154;	// "TACP"
+static const u32 CAPTURE_VERSION = 1;
+
+static u32 capture_remaining;
+
+static void SerializeCapture(TA_context *ctx, void **data, unsigned int *total_size)
+{
+	LIBRETRO_S(CAPTURE_MAGIC);
+	LIBRETRO_S(CAPTURE_VERSION);
+	LIBRETRO_S(settings.System);
+	LIBRETRO_SA(pvr_regs, pvr_RegSize);
+	LIBRETRO_S(vram.size);
+	LIBRETRO_SA(vram.data, vram.size);
+
+	LIBRETRO_S(ctx->rend.isRTT);
+	LIBRETRO_S(ctx->rend.fb_X_CLIP);
+	LIBRETRO_S(ctx->rend.fb_Y_CLIP);
+	LIBRETRO_S(ctx->rend.fog_clamp_min);
+	LIBRETRO_S(ctx->rend.fog_clamp_max);
+	SerializeTAContext(ctx, data, total_size);
+}
+
+void ta_capture_start(u32 count)
+{
+	capture_remaining = count;
+	if (count > 0)
+		NOTICE_LOG(PVR, "Capturing the next %d TA contexts", count);
+}
+
+void ta_capture_frame(TA_context *ctx)
+{
+	if (capture_remaining == 0)
+		return;
+	capture_remaining--;
+
+	std::string dir = get_writable_data_path("/tacapture/");
+	if (!path_is_valid(dir.c_str()))
+		path_mkdir(dir.c_str());
+	extern char content_name[PATH_MAX];
+	std::string path = dir + content_name + "_" + std::to_string(FrameCount) + ".tacap";
+
+	unsigned int total_size = 0;
+	void *data = NULL;
+	SerializeCapture(ctx, &data, &total_size);
+	std::vector<u8> buffer(total_size);
+	data = buffer.data();
+	total_size = 0;
+	SerializeCapture(ctx, &data, &total_size);
+
+	FILE *f = fopen(path.c_str(), "wb");
+	if (f == NULL)
+	{
+		WARN_LOG(PVR, "Cannot create TA capture file %s", path.c_str());
+		return;
+	}
+	bool written = fwrite(buffer.data(), 1, buffer.size(), f) == buffer.size();
+	fclose(f);
+	if (written)
+		NOTICE_LOG(PVR, "TA context captured to %s (%d bytes)", path.c_str(), total_size);
+	else
+		WARN_LOG(PVR, "Error writing TA capture file %s", path.c_str());
+}
+
+#ifdef NO_REND
+extern void dc_prepare_system(void);
+bool _vmem_reserve();
+
+bool ta_replay(const char *path, u32 iterations)
+{
+	FILE *f = fopen(path, "rb");
+	if (f == NULL)
+	{
+		ERROR_LOG(PVR, "Cannot open TA capture file %s", path);
+		return false;
+	}
+	fseek(f, 0, SEEK_END);
+	std::vector<u8> buffer(ftell(f));
+	fseek(f, 0, SEEK_SET);
+	bool read = fread(buffer.data(), 1, buffer.size(), f) == buffer.size();
+	fclose(f);
+
+	u32 magic = 0;
+	u32 version = 0;
+	const size_t header_size = sizeof(magic) + sizeof(version) + sizeof(settings.System) + pvr_RegSize + sizeof(u32);
+	if (read && buffer.size() >= header_size)
+	{
+		memcpy(&magic, &buffer[0], sizeof(magic));
+		memcpy(&version, &buffer[sizeof(magic)], sizeof(version));
+	}
+	if (magic != CAPTURE_MAGIC || version != CAPTURE_VERSION)
+	{
+		ERROR_LOG(PVR, "%s isn't a valid TA capture file", path);
+		return false;
+	}
+
+	void *pos = &buffer[sizeof(magic) + sizeof(version)];
+	unsigned int offset = sizeof(magic) + sizeof(version);
+	void **data = &pos;
+	unsigned int *total_size = &offset;
+	LIBRETRO_US(settings.System);
+	dc_prepare_system();
+	if (!_vmem_reserve())
+	{
+		ERROR_LOG(PVR, "Failed to alloc mem");
+		return false;
+	}
+	LIBRETRO_USA(pvr_regs, pvr_RegSize);
+	u32 vram_size;
+	LIBRETRO_US(vram_size);
+	const size_t rend_size = sizeof(bool) + sizeof(FB_X_CLIP_type) + sizeof(FB_Y_CLIP_type) + 2 * sizeof(u32);
+	if (vram_size != vram.size || buffer.size() < offset + vram_size + rend_size + 2 * sizeof(u32))
+	{
+		ERROR_LOG(PVR, "TA capture file %s is truncated or doesn't match the system VRAM size", path);
+		return false;
+	}
+	LIBRETRO_USA(vram.data, vram_size);
+
+	TA_context *ctx = tactx_Alloc();
+	LIBRETRO_US(ctx->rend.isRTT);
+	LIBRETRO_US(ctx->rend.fb_X_CLIP);
+	LIBRETRO_US(ctx->rend.fb_Y_CLIP);
+	LIBRETRO_US(ctx->rend.fog_clamp_min);
+	LIBRETRO_US(ctx->rend.fog_clamp_max);
+	// Check the TA data size and render pass count before unserializing them
+	u32 ta_size;
+	memcpy(&ta_size, &buffer[offset + sizeof(u32)], sizeof(ta_size));
+	u32 pass_count = ~0u;
+	size_t passes_offset = offset + 2 * sizeof(u32) + ta_size;
+	if (ta_size <= TA_DATA_SIZE && buffer.size() >= passes_offset + sizeof(u32))
+		memcpy(&pass_count, &buffer[passes_offset], sizeof(pass_count));
+	bool valid = pass_count < sizeof(ctx->tad.render_passes) / sizeof(u8 *)
+			&& buffer.size() >= passes_offset + sizeof(u32) * (pass_count + 1);
+	// Render passes must end on a parameter boundary inside the TA data, in order
+	u32 last_pass_end = 0;
+	for (u32 i = 0; valid && i < pass_count; i++)
+	{
+		u32 pass_end;
+		memcpy(&pass_end, &buffer[passes_offset + sizeof(u32) * (i + 1)], sizeof(pass_end));
+		valid = pass_end >= last_pass_end && pass_end <= ta_size && pass_end % 32 == 0;
+		last_pass_end = pass_end;
+	}
+	if (!valid || !UnserializeTAContext(ctx, data, total_size))
+	{
+		ERROR_LOG(PVR, "TA capture file %s is corrupted", path);
+		tactx_Recycle(ctx);
+		return false;
+	}
+
+	Renderer *saved_renderer = renderer;
+	renderer = rend_norend();
+	_pvrrc = ctx;
+	pal_needs_update = true;
+	palette_update();
+	FillBGP(ctx);
+
+	std::vector<SortTrigDrawParam> pidx_sort;
+	std::vector<u32> vidx_sort;
+	RenderStageStats start_stats;
+	RenderStageStats first_stats;
+	render_stage_timing = true;
+	GetRenderStageStats(start_stats);
+	double min_parse = 1e9;
+	double min_sort = 1e9;
+	for (u32 i = 0; i < iterations; i++)
+	{
+		double start_time = os_GetSeconds();
+		ctx->rend_inuse.lock();
+		ta_parse_vdrc(ctx);
+		double parse_end = os_GetSeconds();
+
+		u32 first = 0;
+		for (RenderPass *pass = pvrrc.render_passes.head(); pass != pvrrc.render_passes.LastPtr(0); pass++)
+		{
+			GenSorted(first, pass->tr_count - first, pidx_sort, vidx_sort);
+			first = pass->tr_count;
+		}
+		double sort_end = os_GetSeconds();
+
+		min_parse = std::min(min_parse, parse_end - start_time);
+		min_sort = std::min(min_sort, sort_end - parse_end);
+		if (i == 0)
+			GetRenderStageStats(first_stats);
+	}
+	RenderStageStats end_stats;
+	GetRenderStageStats(end_stats);
+	render_stage_timing = false;
+
+	// Same sort with std::stable_sort, and check that both give the same order
+	std::vector<SortTrigDrawParam> ref_pidx_sort;
+	std::vector<u32> ref_vidx_sort;
+	bool same_order = true;
+	u32 first = 0;
+	for (RenderPass *pass = pvrrc.render_passes.head(); pass != pvrrc.render_passes.LastPtr(0); pass++)
+	{
+		GenSorted(first, pass->tr_count - first, pidx_sort, vidx_sort);
+		stable_sort_trigs = true;
+		GenSorted(first, pass->tr_count - first, ref_pidx_sort, ref_vidx_sort);
+		stable_sort_trigs = false;
+		first = pass->tr_count;
+		same_order = same_order && vidx_sort == ref_vidx_sort && pidx_sort.size() == ref_pidx_sort.size()
+				&& std::equal(pidx_sort.begin(), pidx_sort.end(), ref_pidx_sort.begin(),
+						[](const SortTrigDrawParam& l, const SortTrigDrawParam& r) {
+							return l.ppid == r.ppid && l.first == r.first && l.count == r.count;
+						});
+	}
+	double stable_time = 0;
+	double min_stable = 1e9;
+	stable_sort_trigs = true;
+	for (u32 i = 0; i < iterations; i++)
+	{
+		double start_time = os_GetSeconds();
+		first = 0;
+		for (RenderPass *pass = pvrrc.render_passes.head(); pass != pvrrc.render_passes.LastPtr(0); pass++)
+		{
+			GenSorted(first, pass->tr_count - first, ref_pidx_sort, ref_vidx_sort);
+			first = pass->tr_count;
+		}
+		double time = os_GetSeconds() - start_time;
+		stable_time += time;
+		min_stable = std::min(min_stable, time);
+	}
+	stable_sort_trigs = false;
+
+	if (iterations > 0)
+	{
+		NOTICE_LOG(PVR, "TA replay of %s: %d iterations, %d render passes", path, iterations, pvrrc.render_passes.used());
+		NOTICE_LOG(PVR, "  vertices %d, indices %d, op %d, pt %d, tr %d, modvol triangles %d%s",
+				pvrrc.verts.used(), pvrrc.idx.used(), pvrrc.global_param_op.used(), pvrrc.global_param_pt.used(),
+				pvrrc.global_param_tr.used(), pvrrc.modtrig.used(), pvrrc.Overrun ? " (overrun)" : "");
+		NOTICE_LOG(PVR, "  ta_parse_vdrc: avg %.3f ms, min %.3f ms",
+				(end_stats.parse_time - start_stats.parse_time) * 1000.0 / iterations, min_parse * 1000.0);
+		NOTICE_LOG(PVR, "  GenSorted:     avg %.3f ms, min %.3f ms, %" PRIu64 " triangles per frame",
+				(end_stats.sort_time - start_stats.sort_time) * 1000.0 / iterations, min_sort * 1000.0,
+				(end_stats.sorted_triangles - start_stats.sorted_triangles) / iterations);
+		NOTICE_LOG(PVR, "  stable_sort:   avg %.3f ms, min %.3f ms, %s order",
+				stable_time * 1000.0 / iterations, min_stable * 1000.0, same_order ? "same" : "DIFFERENT");
+		NOTICE_LOG(PVR, "  cache growths: %" PRIu64 " in the first iteration, %" PRIu64 " in the next ones",
+				first_stats.storage_growths - start_stats.storage_growths, end_stats.storage_growths - first_stats.storage_growths);
+	}
+
+	delete renderer;
+	renderer = saved_renderer;
+	_pvrrc = NULL;
+	tactx_Recycle(ctx);
+
+	return true;
+}
+#endif
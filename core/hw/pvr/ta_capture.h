@@ -0,0 +1,18 @@
+#pragma once
+#include "types.h"
+
+struct TA_context;
+
+// Number of times a capture is parsed and sorted by ta_replay
+#define TA_REPLAY_ITERATIONS 600
+
+// Captures the next count TA contexts queued for rendering to data/tacapture/
+void ta_capture_start(u32 count);
+// Called by rend_start_render with the context about to be queued
+void ta_capture_frame(TA_context *ctx);
+
+#ifdef NO_REND
+// Parses and sorts the TA context of a capture file with the norend backend
+// and logs the time spent in each stage. Must be called before dc_init().
+bool ta_replay(const char *path, u32 iterations);
+#endif
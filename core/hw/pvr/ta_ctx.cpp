@@ -3,6 +3,10 @@
 #include "oslib/oslib.h"
 
 #include "hw/sh4/sh4_sched.h"
+#include "emulator.h"
+
+#include <atomic>
+#include <cinttypes>
 
 #if defined(HAVE_LIBNX)
 #include <malloc.h>
@@ -106,10 +110,55 @@ void VDecEnd(void)
 	vd_ctx = 0;
 }
 
-cMutex mtx_rqueue;
-TA_context* rqueue;
+/*
+	Render queue
+
+	Single producer (emulation thread, QueueRender) / single consumer
+	(render thread, DequeueRender and FinishRender) ring of TA contexts.
+	Head and tail are free running counters, the consumer only moves
+	the head and the producer only moves the tail, so no lock is needed.
+	The number of usable slots is settings.pvr.RenderQueueSize and can be
+	changed at any time, up to RENDER_QUEUE_MAX. The emulation thread
+	blocks when all the slots are in use. It also waits for the queued
+	contexts to be parsed, and render to texture frames to be rendered,
+	at the end of render (see rend_end_render).
+*/
+#define RENDER_QUEUE_MAX 8
+
+static TA_context* rqueue[RENDER_QUEUE_MAX];
+static std::atomic<u32> rqueue_head;
+static std::atomic<u32> rqueue_tail;
 cResetEvent frame_finished;
 
+// Only updated by the emulation thread
+static RenderQueueStats rqueue_stats;
+
+RenderStageStats render_stage_stats;
+bool render_stage_timing;
+
+void GetRenderStageStats(RenderStageStats& stats)
+{
+	stats = render_stage_stats;
+}
+
+static u32 rqueue_capacity(void)
+{
+   return std::max(1u, std::min((u32)RENDER_QUEUE_MAX, settings.pvr.RenderQueueSize));
+}
+
+static u32 rqueue_depth(void)
+{
+   return rqueue_tail.load(std::memory_order_acquire) - rqueue_head.load(std::memory_order_acquire);
+}
+
+static void rqueue_wait_frame(void)
+{
+   double start = os_GetSeconds();
+   frame_finished.Wait();
+   rqueue_stats.stalls++;
+   rqueue_stats.stall_time += os_GetSeconds() - start;
+}
+
 bool QueueRender(TA_context* ctx)
 {
    verify(ctx != 0);
@@ -137,69 +186,81 @@ bool QueueRender(TA_context* ctx)
       bool too_fast            = (cycle_span / time_span) > SH4_MAIN_CLOCK;
 
       // Vulkan: RTT frames seem to be discarded often
-      if (rqueue && (too_fast || ctx->rend.isRTT))
+      if (rqueue_depth() != 0 && (too_fast || ctx->rend.isRTT))
       {
          //wait for a frame if
          //  we have another one queue'd and
          //  sh4 run at > 120% on the last slice
          //  and SynchronousRendering is enabled
-         frame_finished.Wait();
+         rqueue_wait_frame();
       }
    }
 
+   // Queue full: wait for the render thread to free a slot. The wait is
+   // cut short by rend_cancel_emu_wait() when emulation is being stopped.
+   while (rqueue_depth() >= rqueue_capacity() && dc_is_running())
+      rqueue_wait_frame();
 
-	if (rqueue)
+   u32 depth = rqueue_depth();
+	if (depth >= rqueue_capacity())
    {
+      // Emulation stopped while waiting: drop the new frame.
 		tactx_Recycle(ctx);
+      rqueue_stats.dropped++;
 		return false;
 	}
 
    frame_finished.Reset();
-   mtx_rqueue.lock();
-	TA_context* old = rqueue;
-	rqueue=ctx;
-   mtx_rqueue.unlock();
+   u32 tail = rqueue_tail.load(std::memory_order_relaxed);
+   rqueue[tail % RENDER_QUEUE_MAX] = ctx;
+   rqueue_tail.store(tail + 1, std::memory_order_release);
 
-   verify(!old);
+   rqueue_stats.queued++;
+   rqueue_stats.max_depth = std::max(rqueue_stats.max_depth, depth + 1);
+   if (rqueue_stats.queued % 3600 == 0)
+      DEBUG_LOG(PVR, "Render queue: %" PRIu64 " frames, %" PRIu64 " dropped, max depth %d, %" PRIu64 " stalls (%.1f ms)",
+            rqueue_stats.queued, rqueue_stats.dropped, rqueue_stats.max_depth,
+            rqueue_stats.stalls, rqueue_stats.stall_time * 1000.0);
 
 	return true;
 }
 
 TA_context* DequeueRender(void)
 {
-   mtx_rqueue.lock();
-	TA_context* rv = rqueue;
-   mtx_rqueue.unlock();
+   u32 head = rqueue_head.load(std::memory_order_relaxed);
+   if (head == rqueue_tail.load(std::memory_order_acquire))
+      return NULL;
 
-	if (rv)
-		FrameCount++;
+   FrameCount++;
 
-	return rv;
+	return rqueue[head % RENDER_QUEUE_MAX];
 }
 
 bool rend_framePending(void)
 {
-   mtx_rqueue.lock();
-	TA_context* rv = rqueue;
-   mtx_rqueue.unlock();
-
-	return rv != 0;
+	return rqueue_depth() != 0;
 }
 
 void FinishRender(TA_context* ctx)
 {
 	if (ctx != NULL)
 	{
-		verify(rqueue == ctx);
-		mtx_rqueue.lock();
-		rqueue = NULL;
-		mtx_rqueue.unlock();
+		u32 head = rqueue_head.load(std::memory_order_relaxed);
+		verify(head != rqueue_tail.load(std::memory_order_acquire) && rqueue[head % RENDER_QUEUE_MAX] == ctx);
+		rqueue[head % RENDER_QUEUE_MAX] = NULL;
+		rqueue_head.store(head + 1, std::memory_order_release);
 
 		tactx_Recycle(ctx);
 	}
 	frame_finished.Set();
 }
 
+void GetRenderQueueStats(RenderQueueStats& stats)
+{
+   stats = rqueue_stats;
+   stats.depth = rqueue_depth();
+}
+
 static cMutex mtx_pool;
 
 /* texture cache entry pool. */
@@ -230,7 +291,8 @@ TA_context* tactx_Alloc(void)
 void tactx_Recycle(TA_context* poped_ctx)
 {
    mtx_pool.lock();
-   if (ctx_pool.size()>2)
+   // Keep enough contexts around to fill the render queue without allocating
+   if (ctx_pool.size() > rqueue_capacity() + 1)
    {
       poped_ctx->Free();
       delete poped_ctx;
@@ -284,49 +346,71 @@ TA_context* tactx_Pop(u32 addr)
 
 const u32 NULL_CONTEXT = ~0u;
 
-void SerializeTAContext(void **data, unsigned int *total_size)
+void SerializeTAContext(const TA_context *ctx, void **data, unsigned int *total_size)
 {
-	if (ta_ctx == nullptr)
+	if (ctx == nullptr)
 	{
 		LIBRETRO_S(NULL_CONTEXT);
 		return;
 	}
-	LIBRETRO_S(ta_ctx->Address);
-	const u32 taSize = ta_ctx->tad.thd_data - ta_ctx->tad.thd_root;
+	LIBRETRO_S(ctx->Address);
+	const u32 taSize = ctx->tad.thd_data - ctx->tad.thd_root;
 	LIBRETRO_S(taSize);
-	LIBRETRO_SA(ta_ctx->tad.thd_root, taSize);
+	LIBRETRO_SA(ctx->tad.thd_root, taSize);
 
-   LIBRETRO_S(ta_ctx->tad.render_pass_count);
-	for (u32 i = 0; i < ta_ctx->tad.render_pass_count; i++)
+   LIBRETRO_S(ctx->tad.render_pass_count);
+	for (u32 i = 0; i < ctx->tad.render_pass_count; i++)
 	{
-		u32 offset = (u32)(ta_ctx->tad.render_passes[i] - ta_ctx->tad.thd_root);
+		u32 offset = (u32)(ctx->tad.render_passes[i] - ctx->tad.thd_root);
 		LIBRETRO_S(offset);
 	}
 }
 
-void UnserializeTAContext(void **data, unsigned int *total_size, serialize_version_enum version)
+void SerializeTAContext(void **data, unsigned int *total_size)
+{
+	SerializeTAContext(ta_ctx, data, total_size);
+}
+
+static void UnserializeTAData(TA_context *ctx, void **data, unsigned int *total_size, serialize_version_enum version)
 {
-	u32 address;
-	LIBRETRO_US(address);
-	if (address == NULL_CONTEXT)
-		return;
-	SetCurrentTARC(address);
 	u32 size;
 	LIBRETRO_US(size);
-	LIBRETRO_USA(ta_ctx->tad.thd_root, size);
-	ta_ctx->tad.thd_data = ta_ctx->tad.thd_root + size;
+	LIBRETRO_USA(ctx->tad.thd_root, size);
+	ctx->tad.thd_data = ctx->tad.thd_root + size;
    if (version >= V12)
 	{
-		LIBRETRO_US(ta_ctx->tad.render_pass_count);
-		for (u32 i = 0; i < ta_ctx->tad.render_pass_count; i++)
+		LIBRETRO_US(ctx->tad.render_pass_count);
+		for (u32 i = 0; i < ctx->tad.render_pass_count; i++)
 		{
 			u32 offset;
 			LIBRETRO_US(offset);
-			ta_ctx->tad.render_passes[i] = ta_ctx->tad.thd_root + offset;
+			ctx->tad.render_passes[i] = ctx->tad.thd_root + offset;
 		}
 	}
 	else
 	{
-		ta_ctx->tad.render_pass_count = 0;
+		ctx->tad.render_pass_count = 0;
 	}
 }
+
+void UnserializeTAContext(void **data, unsigned int *total_size, serialize_version_enum version)
+{
+	u32 address;
+	LIBRETRO_US(address);
+	if (address == NULL_CONTEXT)
+		return;
+	SetCurrentTARC(address);
+	UnserializeTAData(ta_ctx, data, total_size, version);
+}
+
+// Unserializes into the given context, which must not be the current one
+bool UnserializeTAContext(TA_context *ctx, void **data, unsigned int *total_size)
+{
+	u32 address;
+	LIBRETRO_US(address);
+	if (address == NULL_CONTEXT)
+		return false;
+	ctx->Address = address;
+	UnserializeTAData(ctx, data, total_size, VCUR_LIBRETRO);
+	return true;
+}
@@ -268,7 +268,37 @@ void tactx_Recycle(TA_context* poped_ctx);
 void SetCurrentTARC(u32 addr);
 bool QueueRender(TA_context* ctx);
 TA_context* DequeueRender();
+bool rend_framePending();
 void FinishRender(TA_context* ctx);
+
+struct RenderQueueStats
+{
+	u32 depth;			// frames waiting or being rendered
+	u32 max_depth;
+	u64 queued;
+	u64 dropped;		// frames dropped because the queue was full
+	u64 stalls;			// number of times the emulation waited for the renderer
+	double stall_time;	// total time spent waiting, in seconds
+};
+void GetRenderQueueStats(RenderQueueStats& stats);
+
+// CPU cost of the renderer-side stages. Only updated by the render thread.
+struct RenderStageStats
+{
+	u64 frames;				// contexts parsed by ta_parse_vdrc
+	double parse_time;		// seconds spent in ta_parse_vdrc
+	u64 vertices;
+	u64 sorts;				// GenSorted calls and passes sorted per tile
+	double sort_time;
+	u64 sorted_triangles;
+	u64 texture_updates;	// textures decoded
+	double texture_time;
+	u64 storage_growths;	// new texture cache entries, sort buffer resizes and parse arenas
+};
+extern RenderStageStats render_stage_stats;
+// The stage times are only measured when set, so that normal rendering doesn't pay for the clock reads
+extern bool render_stage_timing;
+void GetRenderStageStats(RenderStageStats& stats);
 bool TryDecodeTARC();
 void VDecEnd();
 
@@ -276,3 +306,5 @@ void VDecEnd();
 void FillBGP(TA_context* ctx);
 void SerializeTAContext(void **data, unsigned int *total_size);
 void UnserializeTAContext(void **data, unsigned int *total_size, serialize_version_enum version);
+void SerializeTAContext(const TA_context *ctx, void **data, unsigned int *total_size);
+bool UnserializeTAContext(TA_context *ctx, void **data, unsigned int *total_size);
@@ -7,6 +7,8 @@
 #include "ta_ctx.h"
 #include "pvr_mem.h"
 #include "Renderer_if.h"
+#include "oslib/oslib.h"
+#include "rend/TexCache.h"
 
 #include <algorithm>
 #include <cmath>
@@ -27,8 +29,16 @@ extern int screen_height;
 
 #define TACALL DYNACALL
 
+// The parser state is per thread so that chunks of the TA stream can be decoded concurrently.
+// It's used for every vertex so avoid the general dynamic TLS model of shared libraries if possible.
+#if defined(__GNUC__) && defined(__ELF__) && !defined(__ANDROID__)
+#define TA_THREAD_LOCAL thread_local __attribute__((tls_model("initial-exec")))
+#else
+#define TA_THREAD_LOCAL thread_local
+#endif
+
 //cache state vars
-static u32 tileclip_val = 0;
+static TA_THREAD_LOCAL u32 tileclip_val = 0;
 
 static u8 f32_su8_tbl[65536];
 #define float_to_satu8(val) f32_su8_tbl[((u32&)val)>>16]
@@ -57,18 +67,23 @@ static u8 float_to_satu8_math(float val)
 }
 
 //vdec state variables
-static ModTriangle* lmr;
+static TA_THREAD_LOCAL ModTriangle* lmr;
 
-static PolyParam* CurrentPP;
-static List<PolyParam>* CurrentPPlist;
+static TA_THREAD_LOCAL PolyParam* CurrentPP;
+static TA_THREAD_LOCAL List<PolyParam>* CurrentPPlist;
+static TA_THREAD_LOCAL ModifierVolumeParam* CurrentMVP;
+// Output of the parser: vd_rc, or a chunk arena when parsing concurrently
+static TA_THREAD_LOCAL rend_context* ta_rc;
+// Texture lookups can only be done by the render thread
+static TA_THREAD_LOCAL bool defer_textures;
 
 //TA state vars	
-DECL_ALIGN(4) static u8 FaceBaseColor[4];
-DECL_ALIGN(4) static u8 FaceOffsColor[4];
-DECL_ALIGN(4) static u8 FaceBaseColor1[4];
-DECL_ALIGN(4) static u8 FaceOffsColor1[4];
-static u32 SFaceBaseColor;
-static u32 SFaceOffsColor;
+DECL_ALIGN(4) static TA_THREAD_LOCAL u8 FaceBaseColor[4];
+DECL_ALIGN(4) static TA_THREAD_LOCAL u8 FaceOffsColor[4];
+DECL_ALIGN(4) static TA_THREAD_LOCAL u8 FaceBaseColor1[4];
+DECL_ALIGN(4) static TA_THREAD_LOCAL u8 FaceOffsColor1[4];
+static TA_THREAD_LOCAL u32 SFaceBaseColor;
+static TA_THREAD_LOCAL u32 SFaceOffsColor;
 
 //misc ones
 const u32 ListType_None = -1;
@@ -80,11 +95,11 @@ const u32 SZ64 = 2;
 typedef Ta_Dma* DYNACALL TaListFP(Ta_Dma* data,Ta_Dma* data_end);
 typedef void TACALL TaPolyParamFP(void* ptr);
 
-static TaListFP* TaCmd;
+static TA_THREAD_LOCAL TaListFP* TaCmd;
 	
-static u32 CurrentList;
-static TaListFP* VertexDataFP;
-static bool ListIsFinished[5];
+static TA_THREAD_LOCAL u32 CurrentList;
+static TA_THREAD_LOCAL TaListFP* VertexDataFP;
+static TA_THREAD_LOCAL bool ListIsFinished[5];
 
 static INLINE f32 f16(u16 v)
 {
@@ -92,7 +107,7 @@ static INLINE f32 f16(u16 v)
 	return *(f32*)&z;
 }
 
-#define vdrc vd_rc
+#define vdrc (*ta_rc)
 
 //Splitter function (normally ta_dma_main , modified for split dma's)
 
@@ -627,6 +642,107 @@ public:
 	void vdec_init()
 	{
 		VDECInit();
+		ta_rc = &vd_rc;
+		defer_textures = false;
+		reset_state();
+	}
+
+	// Prepares the calling thread to decode a chunk of the TA stream into rc.
+	// Texture lookups are left to the caller.
+	void chunk_init(rend_context* rc, u32 tileclip)
+	{
+		ta_rc = rc;
+		defer_textures = true;
+		tileclip_val = tileclip;
+		reset_state();
+	}
+
+	Ta_Dma* parse(Ta_Dma* data, Ta_Dma* data_end)
+	{
+		while (data <= data_end)
+			data = TaCmd(data, data_end);
+		return data;
+	}
+
+	// True between two lists, where the stream can be split
+	bool is_idle()
+	{
+		return TaCmd == ta_main && CurrentList == ListType_None && VertexDataFP == NullVertexData;
+	}
+
+	// Walks the TA stream without decoding it and collects the position following each end of list.
+	// Returns false if the stream can't be walked this way.
+	static bool find_list_ends(Ta_Dma* data, Ta_Dma* data_end, std::vector<Ta_Dma*>& list_ends)
+	{
+		u32 list = ListType_None;
+		u32 vertex_size = SZ32;
+		bool poly_data = false;
+		while (data <= data_end)
+		{
+			switch (data->pcw.ParaType)
+			{
+			case ParamType_End_Of_List:
+				list = ListType_None;
+				vertex_size = SZ32;
+				poly_data = false;
+				data += SZ32;
+				list_ends.push_back(data);
+				break;
+
+			case ParamType_User_Tile_Clip:
+			case ParamType_Object_List_Set:
+				data += SZ32;
+				break;
+
+			case ParamType_Polygon_or_Modifier_Volume:
+				if (list == ListType_None)
+					list = data->pcw.ListType;
+				if (IsModVolList(list))
+				{
+					vertex_size = SZ64;
+					poly_data = false;
+					data += SZ32;
+				}
+				else
+				{
+					u32 uid = ta_type_lut[data->pcw.obj_ctrl];
+					u32 pdid = (u8)uid;
+					if (pdid > 14)
+						return false;
+					vertex_size = pdid == 5 || pdid == 6 || pdid >= 11 ? SZ64 : SZ32;
+					poly_data = true;
+					data += uid >> 30;
+				}
+				break;
+
+			case ParamType_Sprite:
+				if (list == ListType_None)
+					list = data->pcw.ListType;
+				vertex_size = SZ64;
+				poly_data = false;
+				data += SZ32;
+				break;
+
+			case ParamType_Vertex_Parameter:
+				if (poly_data)
+				{
+					// like ta_poly_data, consume vertices up to the end of the strip
+					while (!data->pcw.EndOfStrip && data + vertex_size <= data_end)
+						data += vertex_size;
+				}
+				data += vertex_size;
+				break;
+
+			default:
+				return false;
+			}
+		}
+		return true;
+	}
+
+private:
+	void reset_state()
+	{
 		TaCmd = ta_main;
 		CurrentList = ListType_None;
 		ListIsFinished[0] = ListIsFinished[1] = ListIsFinished[2] = ListIsFinished[3] = ListIsFinished[4] = false;
@@ -640,9 +756,10 @@ public:
 		lmr = NULL;
 		CurrentPP = NULL;
 		CurrentPPlist = NULL;
+		CurrentMVP = NULL;
 	}
-		
-private:
+
+
 	__forceinline
 		static void SetTileClip(u32 xmin,u32 ymin,u32 xmax,u32 ymax)
 	{
@@ -672,6 +789,7 @@ private:
 			CurrentPPlist=&vdrc.global_param_tr;
 
 		CurrentPP = NULL;
+		CurrentMVP = NULL;
 	}
 
 	__forceinline
@@ -708,7 +826,7 @@ private:
 
 		d_pp->texid = -1;
 
-		if (d_pp->pcw.Texture)
+		if (d_pp->pcw.Texture && !defer_textures)
 			d_pp->texid = renderer->GetTexture(d_pp->tsp,d_pp->tcw);
 
 		d_pp->tsp1.full = -1;
@@ -776,7 +894,7 @@ private:
 
 		CurrentPP->tsp1.full = pp->tsp1.full;
 		CurrentPP->tcw1.full = pp->tcw1.full;
-		if (pp->pcw.Texture)
+		if (pp->pcw.Texture && !defer_textures)
 		   CurrentPP->texid1 = renderer->GetTexture(pp->tsp1, pp->tcw1);
 	}
 
@@ -790,7 +908,7 @@ private:
 
 		CurrentPP->tsp1.full = pp->tsp1.full;
 		CurrentPP->tcw1.full = pp->tcw1.full;
-		if (pp->pcw.Texture)
+		if (pp->pcw.Texture && !defer_textures)
 		   CurrentPP->texid1 = renderer->GetTexture(pp->tsp1, pp->tcw1);
 	}
 	__forceinline
@@ -1170,7 +1288,7 @@ private:
 
 		d_pp->texid = -1;
 		
-		if (d_pp->pcw.Texture) {
+		if (d_pp->pcw.Texture && !defer_textures) {
 			d_pp->texid = renderer->GetTexture(d_pp->tsp,d_pp->tcw);
 		}
 		d_pp->tcw1.full = -1;
@@ -1306,13 +1424,14 @@ private:
 			list = &vdrc.global_param_mvo_tr;
 		else
 			return;
-		if (list->used() > 0)
+		// only close the volume opened by this list
+		if (CurrentMVP != NULL)
 		{
-			ModifierVolumeParam *p = list->LastPtr();
+			ModifierVolumeParam *p = CurrentMVP;
 			p->count = vdrc.modtrig.used() - p->first;
 			if (p->count == 0)
 				list->PopLast();
-
+			CurrentMVP = NULL;
 		}
 	}
 
@@ -1331,6 +1450,7 @@ private:
       p->isp.full = param->isp.full;
       p->isp.VolumeLast = param->pcw.Volume != 0;
       p->first = vdrc.modtrig.used();
+      CurrentMVP = p;
 	}
 	__forceinline
 		static void AppendModVolVertexA(TA_ModVolA* mvv)
@@ -1540,10 +1660,227 @@ static void fix_texture_bleeding(const List<PolyParam> *list)
 	}
 }
 
+//
+// Concurrent decoding of the TA stream.
+// The stream is split after end of list markers, where the parser is back to its initial state,
+// and the chunks are decoded by the worker pool. The first chunk is decoded in vd_rc and the others
+// in their own arena, which is then appended to vd_rc in stream order.
+// If a chunk doesn't end on a list boundary, the frame is decoded serially instead.
+//
+#define TA_PARALLEL_MIN_SIZE (64 * 1024)	// smaller streams aren't worth splitting
+#define TA_CHUNK_MIN_SIZE (16 * 1024)
+#define TA_MAX_CHUNKS 16
+
+// The tile clip state at the start of a chunk is only known once the previous chunks are decoded,
+// so chunks start with these markers, which are replaced when merging.
+#define TILECLIP_ENTRY_RECT 0x08000000
+#define TILECLIP_ENTRY_MODE 0x80000000
+#define TILECLIP_RECT_MASK 0x0FFFFFFF
+
+struct TaChunk
+{
+	Ta_Dma* start;
+	Ta_Dma* end;
+	u32 pass;
+	rend_context* rc;
+	// parser state at the end of the chunk
+	Ta_Dma* parse_end;
+	bool idle;
+	u32 tileclip;
+};
+
+static std::vector<TaChunk> ta_chunks;
+static std::vector<rend_context*> chunk_arenas;
+static std::vector<Ta_Dma*> list_ends;
+
+static rend_context* GetChunkArena(u32 index)
+{
+	while (chunk_arenas.size() <= index)
+	{
+		// Same sizes as the TA context so that arenas don't overrun before it does
+		rend_context* rc = new rend_context();
+		rc->verts.InitBytes(4 * 1024 * 1024, &rc->Overrun, NULL);
+		rc->modtrig.Init(16384, &rc->Overrun, NULL);
+		rc->global_param_op.Init(16384, &rc->Overrun, NULL);
+		rc->global_param_pt.Init(5120, &rc->Overrun, NULL);
+		rc->global_param_tr.Init(10240, &rc->Overrun, NULL);
+		rc->global_param_mvo.Init(4096, &rc->Overrun, NULL);
+		rc->global_param_mvo_tr.Init(4096, &rc->Overrun, NULL);
+		chunk_arenas.push_back(rc);
+		render_stage_stats.storage_growths++;
+	}
+	return chunk_arenas[index];
+}
+
+static bool SplitTAStream(TA_context* ctx)
+{
+	ta_chunks.clear();
+	const size_t stream_size = ctx->tad.End() - ctx->tad.thd_root;
+	if (stream_size < TA_PARALLEL_MIN_SIZE)
+		return false;
+	StartWorkerPool();
+	if (worker_pool.ThreadCount() < 2)
+		return false;
+	// More chunks than threads to balance uneven lists
+	const size_t chunk_size = std::max<size_t>(stream_size / (worker_pool.ThreadCount() * 2), TA_CHUNK_MIN_SIZE);
+
+	for (u32 pass = 0; pass <= ctx->tad.render_pass_count; pass++)
+	{
+		ctx->MarkRend(pass);
+		Ta_Dma* start = (Ta_Dma*)ctx->rend.proc_start;
+		Ta_Dma* end = (Ta_Dma*)ctx->rend.proc_end;
+		list_ends.clear();
+		if (!FifoSplitter::find_list_ends(start, end - 1, list_ends))
+			return false;
+		for (Ta_Dma* list_end : list_ends)
+		{
+			if (list_end < end && (size_t)(list_end - start) * sizeof(Ta_Dma) >= chunk_size
+					&& ta_chunks.size() < TA_MAX_CHUNKS - 1)
+			{
+				ta_chunks.push_back({ start, list_end, pass });
+				start = list_end;
+			}
+		}
+		ta_chunks.push_back({ start, end, pass });
+		if (ta_chunks.size() >= TA_MAX_CHUNKS)
+			return false;
+	}
+	return ta_chunks.size() > 1;
+}
+
+// Decodes all the render passes of the context concurrently.
+// Returns false if the stream must be decoded serially.
+static bool ParseTAChunks(TA_context* ctx)
+{
+	if (!SplitTAStream(ctx))
+		return false;
+	const u32 entry_tileclip = tileclip_val;
+	ta_chunks[0].rc = &vd_rc;
+	for (u32 i = 1; i < ta_chunks.size(); i++)
+	{
+		ta_chunks[i].rc = GetChunkArena(i - 1);
+		ta_chunks[i].rc->Clear();
+	}
+
+	worker_pool.Run((int)ta_chunks.size(), [entry_tileclip](int i) {
+		TaChunk& chunk = ta_chunks[i];
+		TAFifo0.chunk_init(chunk.rc, i == 0 ? entry_tileclip : TILECLIP_ENTRY_RECT | TILECLIP_ENTRY_MODE);
+		chunk.parse_end = TAFifo0.parse(chunk.start, chunk.end - 1);
+		chunk.idle = TAFifo0.is_idle();
+		chunk.tileclip = tileclip_val;
+	});
+	// This thread may have decoded chunks as well
+	ta_rc = &vd_rc;
+	defer_textures = false;
+	tileclip_val = entry_tileclip;
+
+	for (u32 i = 0; i < ta_chunks.size(); i++)
+	{
+		const TaChunk& chunk = ta_chunks[i];
+		if ((i > 0 && chunk.rc->Overrun)
+				|| (i < ta_chunks.size() - 1 && (chunk.parse_end != chunk.end || !chunk.idle)))
+		{
+			DEBUG_LOG(PVR, "TA chunk %d/%d can't be decoded separately", i, (int)ta_chunks.size());
+			TAFifo0.vdec_init();
+			return false;
+		}
+	}
+	return true;
+}
+
+template<typename T>
+static T* AppendChunkList(List<T>& list, const List<T>& chunk_list)
+{
+	const int count = chunk_list.used();
+	if (count > list.avail)
+	{
+		list.sig_overrun();
+		return NULL;
+	}
+	T* dst = list.Append(count);
+	memcpy(dst, chunk_list.head(), count * sizeof(T));
+	return dst;
+}
+
+static void AppendChunkParams(List<PolyParam>& list, const List<PolyParam>& chunk_list, u32 vtx_base, u32 entry_tileclip)
+{
+	PolyParam* pp = AppendChunkList(list, chunk_list);
+	if (pp == NULL)
+		return;
+	for (PolyParam* pp_end = list.LastPtr(0); pp != pp_end; pp++)
+	{
+		pp->first += vtx_base;
+		if (pp->tileclip & TILECLIP_ENTRY_RECT)
+			pp->tileclip = (pp->tileclip & ~TILECLIP_RECT_MASK) | (entry_tileclip & TILECLIP_RECT_MASK);
+	}
+}
+
+static void AppendChunkModVols(List<ModifierVolumeParam>& list, const List<ModifierVolumeParam>& chunk_list, u32 modtrig_base)
+{
+	ModifierVolumeParam* p = AppendChunkList(list, chunk_list);
+	if (p == NULL)
+		return;
+	for (ModifierVolumeParam* p_end = list.LastPtr(0); p != p_end; p++)
+		p->first += modtrig_base;
+}
+
+// Appends the chunks of a render pass to vd_rc and returns the tile clip state at the end of the pass
+static u32 MergeTAChunks(u32 pass, u32 tileclip)
+{
+	for (const TaChunk& chunk : ta_chunks)
+	{
+		if (chunk.pass != pass)
+			continue;
+		const rend_context* rc = chunk.rc;
+		if (rc != &vd_rc)
+		{
+			const u32 vtx_base = vd_rc.verts.used();
+			const u32 modtrig_base = vd_rc.modtrig.used();
+			AppendChunkList(vd_rc.verts, rc->verts);
+			AppendChunkList(vd_rc.modtrig, rc->modtrig);
+			AppendChunkParams(vd_rc.global_param_op, rc->global_param_op, vtx_base, tileclip);
+			AppendChunkParams(vd_rc.global_param_pt, rc->global_param_pt, vtx_base, tileclip);
+			AppendChunkParams(vd_rc.global_param_tr, rc->global_param_tr, vtx_base, tileclip);
+			AppendChunkModVols(vd_rc.global_param_mvo, rc->global_param_mvo, modtrig_base);
+			AppendChunkModVols(vd_rc.global_param_mvo_tr, rc->global_param_mvo_tr, modtrig_base);
+			if ((s32&)vd_rc.fZ_max < (const s32&)rc->fZ_max)
+				vd_rc.fZ_max = rc->fZ_max;
+		}
+		const u32 rect = chunk.tileclip & TILECLIP_ENTRY_RECT ? tileclip : chunk.tileclip;
+		const u32 mode = chunk.tileclip & TILECLIP_ENTRY_MODE ? tileclip : chunk.tileclip;
+		tileclip = (rect & TILECLIP_RECT_MASK) | (mode & ~TILECLIP_RECT_MASK);
+	}
+	return tileclip;
+}
+
+// Texture lookups of the polygons decoded by ParseTAChunks
+static void GetChunkTextures(const List<PolyParam>& list, int first)
+{
+	u32 tsp = 0;
+	u32 tcw = 0;
+	u64 texid = -1;
+	for (PolyParam* pp = list.head() + first; pp != list.LastPtr(0); pp++)
+	{
+		if (!pp->pcw.Texture)
+			continue;
+		// consecutive strips usually share the same texture
+		if (texid == (u64)-1 || pp->tsp.full != tsp || pp->tcw.full != tcw)
+		{
+			tsp = pp->tsp.full;
+			tcw = pp->tcw.full;
+			texid = renderer->GetTexture(pp->tsp, pp->tcw);
+		}
+		pp->texid = texid;
+		if (pp->tsp1.full != (u32)-1 || pp->tcw1.full != (u32)-1)
+			pp->texid1 = renderer->GetTexture(pp->tsp1, pp->tcw1);
+	}
+}
+
 static bool UsingAutoSort(int pass_number);
 
 bool ta_parse_vdrc(TA_context* ctx)
 {
+	double start_time = render_stage_timing ? os_GetSeconds() : 0;
 	bool rv=false;
 	vd_ctx = ctx;
 	vd_rc = vd_ctx->rend;
@@ -1553,6 +1890,8 @@ bool ta_parse_vdrc(TA_context* ctx)
 	if (ctx->rend.isRTT || 0 == (ta_parse_cnt %  ( settings.pvr.ta_skip + 1)))
 	{
 		TAFifo0.vdec_init();
+		const bool parallel = ParseTAChunks(ctx);
+		u32 tileclip = tileclip_val;
 
 		bool empty_context = true;
 		int op_poly_count = 0;
@@ -1572,11 +1911,10 @@ bool ta_parse_vdrc(TA_context* ctx)
 			vd_rc.proc_start = ctx->rend.proc_start;
 			vd_rc.proc_end = ctx->rend.proc_end;
 
-         Ta_Dma* ta_data     = (Ta_Dma*)vd_rc.proc_start;
-         Ta_Dma* ta_data_end = (Ta_Dma*)vd_rc.proc_end - 1;
-
-         while (ta_data <= ta_data_end)
-            ta_data =TaCmd(ta_data,ta_data_end);
+			if (parallel)
+				tileclip = MergeTAChunks(pass, tileclip);
+			else
+				TAFifo0.parse((Ta_Dma*)vd_rc.proc_start, (Ta_Dma*)vd_rc.proc_end - 1);
 
          if (ctx->rend.Overrun)
             break;
@@ -1607,6 +1945,13 @@ bool ta_parse_vdrc(TA_context* ctx)
 				render_pass->z_clear = ClearZBeforePass(pass);
 			}
 		}
+		if (parallel)
+		{
+			tileclip_val = tileclip;
+			GetChunkTextures(vd_rc.global_param_op, 1);
+			GetChunkTextures(vd_rc.global_param_pt, 0);
+			GetChunkTextures(vd_rc.global_param_tr, 0);
+		}
 		rv = !empty_context;
 	}
 	bool overrun = ctx->rend.Overrun;
@@ -1635,6 +1980,11 @@ bool ta_parse_vdrc(TA_context* ctx)
 
    ctx->rend.Overrun = overrun;
 
+	render_stage_stats.frames++;
+	render_stage_stats.vertices += ctx->rend.verts.used();
+	if (render_stage_timing)
+		render_stage_stats.parse_time += os_GetSeconds() - start_time;
+
 	return rv && !overrun;
 }
 
@@ -8,10 +8,12 @@
 #include <map>
 #include "blockmanager.h"
 #include "ngen.h"
+#include "deps/xxhash/xxhash.h"
 
 #include "../sh4_core.h"
 #include "hw/sh4/sh4_mem.h"
 #include "hw/sh4/sh4_sched.h"
+#include "rend/TexCache.h"
 
 
 #if defined(__unix__) && defined(DYNA_OPROF)
@@ -33,6 +35,38 @@ bool unprotected_pages[RAM_SIZE_MAX/PAGE_SIZE];
 static std::set<RuntimeBlockInfo*> blocks_per_page[RAM_SIZE_MAX/PAGE_SIZE];
 
 static bm_Map blkmap;
+
+// Persistent block cache: guest code of the blocks compiled in previous sessions,
+// indexed by physical address
+struct BlockCacheEntry
+{
+	u32 vaddr;
+	u32 fpu_cfg;
+	u32 sh4_code_size;
+	u32 hash;
+};
+static std::map<u32, BlockCacheEntry> block_cache;
+static bool warmed_pages[RAM_SIZE_MAX/PAGE_SIZE];
+static bool block_cache_dirty;
+#define BLOCK_CACHE_MAGIC 0x43424346	// FCBC
+#define BLOCK_CACHE_VERSION 1
+#define BLOCK_CACHE_MAX_ENTRIES 65536
+
+// Dirty page tracking for delta savestates: epoch of the last write to each RAM page
+static bool ram_dirty_tracking;
+static u32 ram_dirty_epoch = 1;
+static u32 ram_page_epoch[RAM_SIZE_MAX/PAGE_SIZE];
+
+// Ends the tracking session, for both RAM and VRAM
+static void bm_DirtyTrackingStop()
+{
+	if (ram_dirty_tracking)
+	{
+		ram_dirty_tracking = false;
+		VramDirtyTrackingStop();
+	}
+}
+
 // Stats
 u32 protected_blocks;
 u32 unprotected_blocks;
@@ -178,6 +212,17 @@ void bm_AddBlock(RuntimeBlockInfo* blk)
 	verify((void*)bm_GetCode(block->addr) == (void*)ngen_FailedToFindBlock);
 	FPCA(block->addr) = (DynarecCodeEntryPtr)CC_RW2RX(block->code);
 
+	if (!block->temp_block && !mmu_enabled() && IsOnRam(block->addr)
+			&& (block_cache.size() < BLOCK_CACHE_MAX_ENTRIES || block_cache.count(block->addr) != 0))
+	{
+		BlockCacheEntry& entry = block_cache[block->addr];
+		entry.vaddr = block->vaddr;
+		entry.fpu_cfg = block->fpu_cfg.full;
+		entry.sh4_code_size = block->sh4_code_size;
+		entry.hash = bm_HashCode(block->addr, block->sh4_code_size);
+		block_cache_dirty = true;
+	}
+
 #ifdef DYNA_OPROF
 	if (oprofHandle)
 	{
@@ -203,6 +248,11 @@ void bm_DiscardBlock(RuntimeBlockInfo* block)
 
 	blkmap.erase(it);
 
+	// Unregister from the blocks this one is linked to
+	if (block_ptr->pNextBlock != NULL)
+		block_ptr->pNextBlock->RemRef(block_ptr);
+	if (block_ptr->pBranchBlock != NULL && block_ptr->pBranchBlock != block_ptr->pNextBlock)
+		block_ptr->pBranchBlock->RemRef(block_ptr);
 	block_ptr->pNextBlock = NULL;
 	block_ptr->pBranchBlock = NULL;
 	block_ptr->Relink();
@@ -218,6 +268,25 @@ void bm_DiscardBlock(RuntimeBlockInfo* block)
 	block_ptr->Discard();
 }
 
+// Discards all the blocks whose code starts in [start, end) so that this area of the code cache can be reused
+u32 bm_DiscardCodeRange(void* start, void* end)
+{
+	std::vector<RuntimeBlockInfo*> blocks;
+	for (auto it = blkmap.lower_bound(start); it != blkmap.end() && (u8*)it->first < (u8*)end; ++it)
+		if (!it->second->temp_block)
+			blocks.push_back(it->second.get());
+	for (RuntimeBlockInfo* block : blocks)
+		bm_DiscardBlock(block);
+
+	// The code of the stale blocks in this area is about to be overwritten
+	del_blocks.erase(std::remove_if(del_blocks.begin(), del_blocks.end(),
+			[start, end](const RuntimeBlockInfoPtr& block) {
+				return (u8*)block->code >= (u8*)start && (u8*)block->code < (u8*)end;
+			}), del_blocks.end());
+
+	return blocks.size();
+}
+
 void bm_Periodical_1s()
 {
 	bm_CleanupDeletedBlocks();
@@ -235,8 +304,7 @@ void bm_vmem_pagefill(void** ptr, u32 size_bytes)
 void bm_Reset()
 {
 	bm_CleanupDeletedBlocks();
-	protected_blocks = 0;
-	unprotected_blocks = 0;
+	bm_DirtyTrackingStop();
 
 	if (_nvmem_enabled())
 	{
@@ -259,6 +327,7 @@ void bm_Reset()
 		{
 			mem_region_unlock(virt_ram_base + 0x8C000000, 0x90000000 - 0x8C000000);
 			mem_region_unlock(virt_ram_base + 0xAC000000, 0xB0000000 - 0xAC000000);
+			mem_region_unlock(virt_ram_base + 0xCC000000, 0xD0000000 - 0xCC000000);
 		}
 	}
 	else
@@ -272,13 +341,17 @@ static void bm_LockPage(u32 addr)
 	addr = addr & (RAM_MASK - PAGE_MASK);
 	if (_nvmem_enabled())
 	{
-		if (!mmu_enabled() || !_nvmem_4gb_space())
-			mem_region_lock(virt_ram_base + 0x0C000000 + addr, PAGE_SIZE);
-		if (_nvmem_4gb_space())
+		// Area 3 holds main RAM and its mirrors. Writes through any of them must fault.
+		for (u32 mirror = 0; mirror < 0x04000000; mirror += RAM_SIZE)
 		{
-			mem_region_lock(virt_ram_base + 0x8C000000 + addr, PAGE_SIZE);
-			mem_region_lock(virt_ram_base + 0xAC000000 + addr, PAGE_SIZE);
-			// TODO wraps
+			if (!mmu_enabled() || !_nvmem_4gb_space())
+				mem_region_lock(virt_ram_base + 0x0C000000 + mirror + addr, PAGE_SIZE);
+			if (_nvmem_4gb_space())
+			{
+				mem_region_lock(virt_ram_base + 0x8C000000 + mirror + addr, PAGE_SIZE);
+				mem_region_lock(virt_ram_base + 0xAC000000 + mirror + addr, PAGE_SIZE);
+				mem_region_lock(virt_ram_base + 0xCC000000 + mirror + addr, PAGE_SIZE);
+			}
 		}
 	}
 	else
@@ -292,13 +365,17 @@ static void bm_UnlockPage(u32 addr)
 	addr = addr & (RAM_MASK - PAGE_MASK);
 	if (_nvmem_enabled())
 	{
-		if (!mmu_enabled() || !_nvmem_4gb_space())
-			mem_region_unlock(virt_ram_base + 0x0C000000 + addr, PAGE_SIZE);
-		if (_nvmem_4gb_space())
+		// Area 3 holds main RAM and its mirrors. Writes through any of them must fault.
+		for (u32 mirror = 0; mirror < 0x04000000; mirror += RAM_SIZE)
 		{
-			mem_region_unlock(virt_ram_base + 0x8C000000 + addr, PAGE_SIZE);
-			mem_region_unlock(virt_ram_base + 0xAC000000 + addr, PAGE_SIZE);
-			// TODO wraps
+			if (!mmu_enabled() || !_nvmem_4gb_space())
+				mem_region_unlock(virt_ram_base + 0x0C000000 + mirror + addr, PAGE_SIZE);
+			if (_nvmem_4gb_space())
+			{
+				mem_region_unlock(virt_ram_base + 0x8C000000 + mirror + addr, PAGE_SIZE);
+				mem_region_unlock(virt_ram_base + 0xAC000000 + mirror + addr, PAGE_SIZE);
+				mem_region_unlock(virt_ram_base + 0xCC000000 + mirror + addr, PAGE_SIZE);
+			}
 		}
 	}
 	else
@@ -333,6 +410,9 @@ void bm_ResetCache()
 		block_list.clear();
 
 	memset(unprotected_pages, 0, sizeof(unprotected_pages));
+	memset(warmed_pages, 0, sizeof(warmed_pages));
+	// Also called when the mmu state changes. The leftover locks are handled as stale ones.
+	bm_DirtyTrackingStop();
 
 #ifdef DYNA_OPROF
 	if (oprofHandle)
@@ -385,6 +465,129 @@ void bm_Term()
 	bm_Reset();
 }
 
+u32 bm_HashCode(u32 addr, u32 size)
+{
+	u8* ptr = GetMemPtr(addr, size);
+	if (ptr == NULL)
+		return 0;
+
+	XXH32_state_t *state = XXH32_createState();
+	XXH32_reset(state, 7);
+	for (u32 i = 0; i < size; i += 2)
+	{
+		u16 data = *(u16 *)&ptr[i];
+		//Do not count PC relative loads (relocated code)
+		if ((data >> 12) == 0xD)
+			data = 0xD000;
+		XXH32_update(state, &data, 2);
+	}
+	XXH32_hash_t hash = XXH32_digest(state);
+	XXH32_freeState(state);
+
+	return hash;
+}
+
+static std::string bm_BlockCachePath()
+{
+	extern char content_name[PATH_MAX];
+	return get_writable_data_path("data/") + content_name + ".blkcache";
+}
+
+void bm_LoadBlockCache()
+{
+	block_cache.clear();
+	block_cache_dirty = false;
+	memset(warmed_pages, 0, sizeof(warmed_pages));
+
+	std::string path = bm_BlockCachePath();
+	FILE* f = fopen(path.c_str(), "rb");
+	if (f == NULL)
+		return;
+
+	u32 header[4];
+	if (fread(header, sizeof(header), 1, f) != 1
+			|| header[0] != BLOCK_CACHE_MAGIC || header[1] != BLOCK_CACHE_VERSION
+			|| header[2] != RAM_SIZE || header[3] > BLOCK_CACHE_MAX_ENTRIES)
+	{
+		WARN_LOG(DYNAREC, "Ignoring invalid block cache %s", path.c_str());
+		fclose(f);
+		return;
+	}
+	for (u32 i = 0; i < header[3]; i++)
+	{
+		u32 addr;
+		BlockCacheEntry entry;
+		if (fread(&addr, sizeof(addr), 1, f) != 1 || fread(&entry, sizeof(entry), 1, f) != 1)
+			break;
+		block_cache[addr] = entry;
+	}
+	fclose(f);
+	INFO_LOG(DYNAREC, "Block cache loaded from %s: %d blocks", path.c_str(), (int)block_cache.size());
+}
+
+void bm_SaveBlockCache()
+{
+	if (!block_cache_dirty)
+		return;
+
+	std::string path = bm_BlockCachePath();
+	FILE* f = fopen(path.c_str(), "wb");
+	if (f == NULL)
+	{
+		WARN_LOG(DYNAREC, "Cannot save block cache to %s", path.c_str());
+		return;
+	}
+	u32 header[4] = { BLOCK_CACHE_MAGIC, BLOCK_CACHE_VERSION, RAM_SIZE, (u32)block_cache.size() };
+	fwrite(header, sizeof(header), 1, f);
+	for (const auto& it : block_cache)
+	{
+		fwrite(&it.first, sizeof(it.first), 1, f);
+		fwrite(&it.second, sizeof(it.second), 1, f);
+	}
+	fclose(f);
+	block_cache_dirty = false;
+	INFO_LOG(DYNAREC, "Block cache saved to %s: %d blocks", path.c_str(), (int)block_cache.size());
+}
+
+// Compiles all the cached blocks of the page containing addr whose guest code hasn't changed
+void bm_WarmPage(u32 addr)
+{
+	if (block_cache.empty() || mmu_enabled() || !IsOnRam(addr))
+		return;
+	u32 page = (addr & RAM_MASK) / PAGE_SIZE;
+	if (warmed_pages[page])
+		return;
+	warmed_pages[page] = true;
+
+	u32 compiled = 0;
+	auto it = block_cache.lower_bound(addr & ~PAGE_MASK);
+	while (it != block_cache.end() && it->first < (addr & ~PAGE_MASK) + PAGE_SIZE)
+	{
+		u32 block_addr = it->first;
+		const BlockCacheEntry& entry = it->second;
+		if ((void*)bm_GetCode(block_addr) != (void*)ngen_FailedToFindBlock)
+		{
+			++it;
+			continue;
+		}
+		if (bm_HashCode(block_addr, entry.sh4_code_size) != entry.hash)
+		{
+			// Stale entry
+			it = block_cache.erase(it);
+			block_cache_dirty = true;
+			continue;
+		}
+		fpscr_t fpu_cfg;
+		fpu_cfg.full = entry.fpu_cfg;
+		if (!rdv_PrecompileBlock(entry.vaddr, fpu_cfg))
+			break;
+		compiled++;
+		it = block_cache.upper_bound(block_addr);
+	}
+	if (compiled > 0)
+		DEBUG_LOG(DYNAREC, "bm_WarmPage: %d blocks precompiled in page %08x", compiled, addr & ~PAGE_MASK);
+}
+
 void bm_WriteBlockMap(const std::string& file)
 {
 	FILE* f=fopen(file.c_str(),"wb");
@@ -600,6 +803,16 @@ void RuntimeBlockInfo::SetProtectedFlags()
 void bm_RamWriteAccess(u32 addr)
 {
 	addr &= RAM_MASK;
+	if (ram_dirty_tracking && ram_page_epoch[addr / PAGE_SIZE] != ram_dirty_epoch)
+	{
+		ram_page_epoch[addr / PAGE_SIZE] = ram_dirty_epoch;
+		// Page only locked for dirty tracking
+		if (unprotected_pages[addr / PAGE_SIZE] || blocks_per_page[addr / PAGE_SIZE].empty())
+		{
+			bm_UnlockPage(addr);
+			return;
+		}
+	}
 	if (unprotected_pages[addr / PAGE_SIZE])
 	{
 		ERROR_LOG(DYNAREC, "Page %08x already unprotected", addr);
@@ -619,6 +832,69 @@ void bm_RamWriteAccess(u32 addr)
 	verify(block_list.empty());
 }
 
+// Discards the protected blocks of a RAM page whose content has been replaced
+// while unlocked (savestate load)
+void bm_RamPageChanged(u32 addr)
+{
+	addr &= RAM_MASK;
+	std::set<RuntimeBlockInfo*>& block_list = blocks_per_page[addr / PAGE_SIZE];
+	if (block_list.empty())
+		return;
+	std::vector<RuntimeBlockInfo*> list_copy(block_list.begin(), block_list.end());
+	DEBUG_LOG(DYNAREC, "bm_RamPageChanged page %08x: %d blocks discarded", addr, (int)list_copy.size());
+	for (auto& block : list_copy)
+		bm_DiscardBlock(block);
+	verify(block_list.empty());
+}
+
+// Write-protects again the pages holding protected blocks after bm_Reset()
+void bm_LockProtectedPages()
+{
+	for (u32 page = 0; page < RAM_SIZE / PAGE_SIZE; page++)
+		if (!blocks_per_page[page].empty())
+			bm_LockPage(page * PAGE_SIZE);
+}
+
+// Write-protects the whole RAM so that all the pages written from now on are recorded
+bool bm_DirtyTrackingStart()
+{
+#ifdef TARGET_NO_EXCEPTIONS
+	return false;
+#else
+	if (mmu_enabled())
+		return false;
+	if (!ram_dirty_tracking)
+	{
+		for (u32 addr = 0; addr < RAM_SIZE; addr += PAGE_SIZE)
+			bm_LockPage(addr);
+		ram_dirty_epoch++;
+		ram_dirty_tracking = true;
+	}
+	return true;
+#endif
+}
+
+bool bm_DirtyTrackingActive()
+{
+	return ram_dirty_tracking && !mmu_enabled();
+}
+
+// Ends the current epoch: the pages written during it are locked again
+u32 bm_DirtyTrackingRearm()
+{
+	if (ram_dirty_tracking)
+		for (u32 page = 0; page < RAM_SIZE / PAGE_SIZE; page++)
+			if (ram_page_epoch[page] == ram_dirty_epoch)
+				bm_LockPage(page * PAGE_SIZE);
+	return ++ram_dirty_epoch;
+}
+
+// True if the RAM page at offset has been written during or after the given epoch
+bool bm_RamPageDirty(u32 offset, u32 epoch)
+{
+	return ram_page_epoch[(offset & RAM_MASK) / PAGE_SIZE] >= epoch;
+}
+
 bool bm_RamWriteAccess(void *p)
 {
 	if (_nvmem_enabled())
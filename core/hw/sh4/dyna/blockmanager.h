@@ -29,7 +29,7 @@ struct RuntimeBlockInfo_Core
 
 struct RuntimeBlockInfo: RuntimeBlockInfo_Core
 {
-	bool Setup(u32 pc,fpscr_t fpu_cfg);
+	bool Setup(u32 pc,fpscr_t fpu_cfg,bool superblock = false);
 	const char* hash();
 
 	u32 vaddr;
@@ -47,6 +47,7 @@ struct RuntimeBlockInfo: RuntimeBlockInfo_Core
 	bool has_fpu_op;
 	u32 blockcheck_failures;
 	bool temp_block;
+	bool superblock;	// recompiled hot block that follows its static branches
 
 	u32 BranchBlock; /* if not 0xFFFFFFFF then jump target */
 	u32 NextBlock;   /* if not 0xFFFFFFFF then next block (by position) */
@@ -102,6 +103,7 @@ RuntimeBlockInfoPtr DYNACALL bm_GetBlock(u32 addr);
 
 void bm_AddBlock(RuntimeBlockInfo* blk);
 void bm_DiscardBlock(RuntimeBlockInfo* block);
+u32 bm_DiscardCodeRange(void* start, void* end);
 void bm_Reset();
 void bm_ResetCache();
 void bm_ResetTempCache(bool full);
@@ -110,9 +112,22 @@ void bm_Periodical_1s();
 void bm_Init();
 void bm_Term();
 
+// Persistent block cache
+u32 bm_HashCode(u32 addr, u32 size);
+void bm_LoadBlockCache();
+void bm_SaveBlockCache();
+void bm_WarmPage(u32 addr);
+
 void bm_vmem_pagefill(void** ptr,u32 size_bytes);
 bool bm_RamWriteAccess(void *p);
 void bm_RamWriteAccess(u32 addr);
+void bm_RamPageChanged(u32 addr);
+void bm_LockProtectedPages();
+// RAM dirty page tracking
+bool bm_DirtyTrackingStart();
+bool bm_DirtyTrackingActive();
+u32 bm_DirtyTrackingRearm();
+bool bm_RamPageDirty(u32 offset, u32 epoch);
 static inline bool bm_IsRamPageProtected(u32 addr)
 {
 	extern bool unprotected_pages[RAM_SIZE_MAX/PAGE_SIZE];
@@ -17,6 +17,8 @@
 
 #define BLOCK_MAX_SH_OPS_SOFT 500
 #define BLOCK_MAX_SH_OPS_HARD 511
+// Max number of bytes a superblock can skip over when following a static branch (literal pools, etc.)
+#define SUPERBLOCK_MAX_SKIP 512
 
 static RuntimeBlockInfo* blk;
 
@@ -967,13 +969,31 @@ static void state_Setup(u32 rpc,fpscr_t fpu_cfg)
    state.info.has_fpu=false;
 }
 
-bool dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles)
+// A block ending with an unconditional static branch to a nearby forward address
+// can be followed by decoding the branch target in the same block.
+// The skipped bytes become part of the block so that SMC checks and page protection still cover all its code.
+static bool dec_CanFollow(BlockEndType type, u32 end_pc, u32 target)
+{
+	if (type != BET_StaticJump && type != BET_StaticCall)
+		return false;
+
+	return target > end_pc && target - end_pc <= SUPERBLOCK_MAX_SKIP;
+}
+
+bool dec_CanExtendBlock(const RuntimeBlockInfo* rbi)
+{
+	return dec_CanFollow(rbi->BlockType, rbi->vaddr + rbi->sh4_code_size, rbi->BranchBlock);
+}
+
+bool dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles,bool superblock)
 {
 	blk=rbi;
 	state_Setup(blk->vaddr, blk->fpu_cfg);
 	ngen_GetFeatures(&state.ngen);
 	
 	blk->guest_opcodes=0;
+	// FPSCR changed by a fallback opcode: the following code must be compiled with a different fpu config
+	bool fpscr_written = false;
 	// If full MMU, don't allow the block to extend past the end of the current 4K page
 	u32 max_pc = mmu_enabled() ? ((state.cpu.rpc >> 12) + 1) << 12 : 0xFFFFFFFF;
 	
@@ -1031,9 +1051,11 @@ bool dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles)
 								dec_DynamicSet(reg_nextpc);
 								dec_End(0xFFFFFFFF,BET_DynamicJump,false);
 							}
-							if (OPCODE_SETFPSCR(OpDesc[op]->type) && !state.cpu.is_delayslot)
+							if (OPCODE_SETFPSCR(OpDesc[op]->type))
 							{
-								dec_End(state.cpu.rpc+2,BET_StaticJump,false);
+								fpscr_written = true;
+								if (!state.cpu.is_delayslot)
+									dec_End(state.cpu.rpc+2,BET_StaticJump,false);
 							}
 						}
 					}
@@ -1053,6 +1075,18 @@ bool dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles)
 			break;
 
 		case NDO_End:
+			if (superblock && !fpscr_written && !mmu_enabled()
+					&& dec_CanFollow(state.BlockType, state.cpu.rpc, state.JumpAddr))
+			{
+				// Keep decoding at the branch target
+				state.cpu.rpc = state.JumpAddr;
+				state.cpu.is_delayslot = false;
+				state.NextOp = NDO_NextOp;
+				state.BlockType = BET_SCL_Intr;
+				state.JumpAddr = 0xFFFFFFFF;
+				state.NextAddr = 0xFFFFFFFF;
+				break;
+			}
 			goto _end;
 		}
 	}
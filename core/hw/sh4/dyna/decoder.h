@@ -42,9 +42,12 @@ struct ngen_features
 {
 	bool OnlyDynamicEnds;     //if set the block endings aren't handled natively and only Dynamic block end type is used
 	bool InterpreterFallback; //if set all the non-branch opcodes are handled with the ifb opcode
+	bool TieredCompile;       //if set hot blocks are recompiled as superblocks when their staging_runs counter reaches 0
+	bool CodeEviction;        //if set parts of the code cache can be reused without flushing it entirely
 };
 struct RuntimeBlockInfo;
-bool dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles);
+bool dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles,bool superblock);
+bool dec_CanExtendBlock(const RuntimeBlockInfo* rbi);
 
 struct state_t
 {
@@ -1,7 +1,6 @@
 #include "types.h"
 #include <unordered_set>
 
-#include "deps/xxhash/xxhash.h"
 #include "../sh4_interpreter.h"
 #include "../sh4_opcode_list.h"
 #include "../sh4_core.h"
@@ -49,6 +48,22 @@ u32* emit_ptr_limit = nullptr;
 
 std::unordered_set<u32> smc_hotspots;
 
+// Number of runs after which a block is recompiled as a superblock
+#define SUPERBLOCK_PROMOTE_RUNS 1000
+static u32 promoted_blocks;
+
+// When the code cache is full, the blocks of its least recently used segment are discarded
+// and the segment is reused, instead of flushing the whole cache.
+#define CODE_SEGMENTS 8
+static u32 code_base;		// start of the block area. Anything below (arm64 main loop) is never evicted
+static u32 segment_size;	// 0 if the code cache isn't segmented
+static u32 current_segment;
+static u64 segment_clock;
+static u64 segment_stamp[CODE_SEGMENTS];
+// Code of the block that called into the driver and will be returned into. Its segment is never evicted.
+static const u8 *caller_code;
+static CodeCacheStats codecache_stats;
+
 void* emit_GetCCPtr(void)
 {
    if (emit_ptr)
@@ -69,10 +84,31 @@ void clear_temp_cache(bool full)
 	bm_ResetTempCache(full);
 }
 
+static u32 segment_start(u32 segment)
+{
+	return code_base + segment * segment_size;
+}
+
+static u32 segment_end(u32 segment)
+{
+	return segment == CODE_SEGMENTS - 1 ? CODE_SIZE : segment_start(segment + 1);
+}
+
+// Returns the segment holding the given RW code address, or CODE_SEGMENTS if none
+static u32 segment_of(const u8 *code)
+{
+	if (segment_size == 0 || code < &CodeCache[code_base] || code >= &CodeCache[CODE_SIZE])
+		return CODE_SEGMENTS;
+	return std::min((u32)(code - &CodeCache[code_base]) / segment_size, (u32)CODE_SEGMENTS - 1);
+}
+
 static void recSh4_ClearCache(void)
 {
-	INFO_LOG(DYNAREC, "recSh4:Dynarec Cache clear at %08X free space %d", next_pc, emit_FreeSpace());
+	codecache_stats.flushes++;
+	INFO_LOG(DYNAREC, "recSh4:Dynarec Cache clear at %08X free space %d flushes %d evictions %d", next_pc, emit_FreeSpace(),
+			codecache_stats.flushes, codecache_stats.evictions);
 	LastAddr=LastAddr_min;
+	segment_size = 0;
 	bm_ResetCache();
 	smc_hotspots.clear();
 	clear_temp_cache(true);
@@ -116,43 +152,79 @@ u32 emit_FreeSpace()
 {
 	if (emit_ptr)
 		return (emit_ptr_limit - emit_ptr) * sizeof(u32);
+	else if (segment_size != 0)
+		return segment_end(current_segment) - LastAddr;
 	else
 		return CODE_SIZE-LastAddr;
 }
 
-void AnalyseBlock(RuntimeBlockInfo* blk);
+// Splits the remaining code cache in segments. Called before compiling the first block.
+static void rdv_InitSegments()
+{
+	ngen_features features;
+	ngen_GetFeatures(&features);
+	if (!features.CodeEviction)
+		return;
+	code_base = LastAddr;
+	segment_size = ((CODE_SIZE - code_base) / CODE_SEGMENTS) & ~4095;
+	current_segment = 0;
+	segment_clock = 0;
+	memset(segment_stamp, 0, sizeof(segment_stamp));
+}
 
-static char block_hash[1024];
+// Discards the blocks of the least recently used segment and continues emitting code there
+static void rdv_EvictSegment()
+{
+	u32 victim = current_segment;
+	u32 caller_segment = segment_of(caller_code);
+	u64 oldest = ~0ull;
+	for (u32 i = 0; i < CODE_SEGMENTS; i++)
+	{
+		if (i != current_segment && i != caller_segment && segment_stamp[i] < oldest)
+		{
+			oldest = segment_stamp[i];
+			victim = i;
+		}
+	}
+	u32 blocks = bm_DiscardCodeRange(&CodeCache[segment_start(victim)], &CodeCache[segment_end(victim)]);
+	DEBUG_LOG(DYNAREC, "Code cache segment %d evicted: %d blocks", victim, blocks);
+	if (blocks != 0)
+	{
+		codecache_stats.evictions++;
+		codecache_stats.evicted_blocks += blocks;
+	}
+	current_segment = victim;
+	segment_stamp[victim] = ++segment_clock;
+	LastAddr = segment_start(victim);
+}
 
-const char* RuntimeBlockInfo::hash()
+// Called at the end of each timeslice: the segment holding the next block is marked as recently used
+void rdv_SampleCode()
 {
-	XXH32_hash_t hash = 0;
+	if (segment_size == 0 || mmu_enabled())
+		return;
+	u32 segment = segment_of((u8 *)CC_RX2RW((void *)bm_GetCodeByVAddr(next_pc)));
+	if (segment != CODE_SEGMENTS)
+		segment_stamp[segment] = ++segment_clock;
+}
 
-	u8* ptr = GetMemPtr(this->addr, this->sh4_code_size);
+void rdv_GetCodeCacheStats(CodeCacheStats& stats)
+{
+	stats = codecache_stats;
+}
 
-	if (ptr)
-	{
-		XXH32_state_t *state = XXH32_createState();
-		XXH32_reset(state, 7);
-			for (u32 i=0; i<this->guest_opcodes; i++)
-			{
-				u16 data=ptr[i];
-				//Do not count PC relative loads (relocated code)
-				if ((ptr[i]>>12)==0xD)
-					data=0xD000;
+void AnalyseBlock(RuntimeBlockInfo* blk);
 
-			XXH32_update(state, &data, 2);
-			}
-		hash = XXH32_digest(state);
-		XXH32_freeState(state);
-		}
+static char block_hash[1024];
 
-	sprintf(block_hash, ">:1:%02X:%08X", this->guest_opcodes, hash);
+const char* RuntimeBlockInfo::hash()
+{
+	sprintf(block_hash, ">:1:%02X:%08X", this->guest_opcodes, bm_HashCode(this->addr, this->sh4_code_size));
 
 	return block_hash;
 }
 
-bool RuntimeBlockInfo::Setup(u32 rpc,fpscr_t rfpu_cfg)
+bool RuntimeBlockInfo::Setup(u32 rpc,fpscr_t rfpu_cfg,bool rsuperblock)
 {
 	staging_runs=addr=lookups=runs=host_code_size=0;
 	guest_cycles=guest_opcodes=host_opcodes=0;
@@ -164,6 +236,7 @@ bool RuntimeBlockInfo::Setup(u32 rpc,fpscr_t rfpu_cfg)
 	BlockType=BET_SCL_Intr;
 	has_fpu_op = false;
 	temp_block = false;
+	superblock = rsuperblock;
 	
 	vaddr=rpc;
 #ifndef NO_MMU
@@ -186,7 +259,7 @@ bool RuntimeBlockInfo::Setup(u32 rpc,fpscr_t rfpu_cfg)
 #if !defined(NO_MMU)
 	try {
 #endif
-		if (!dec_DecodeBlock(this, SH4_TIMESLICE / 2))
+		if (!dec_DecodeBlock(this, SH4_TIMESLICE / 2, superblock))
 			return false;
 #if !defined(NO_MMU)
 	}
@@ -203,17 +276,18 @@ bool RuntimeBlockInfo::Setup(u32 rpc,fpscr_t rfpu_cfg)
 	return true;
 }
 
-DynarecCodeEntryPtr rdv_CompilePC(u32 blockcheck_failures)
+static bool is_cache_reset_pc(u32 pc)
 {
-	u32 pc=next_pc;
-	//printf("rdv_CompilePC next_pc %p\n", next_pc);
-
-	if (emit_FreeSpace()<16*1024 || pc==0x8c0000e0 || pc==0xac010000 || pc==0xac008300)
-		recSh4_ClearCache();
+	return pc==0x8c0000e0 || pc==0xac010000 || pc==0xac008300;
+}
 
+static RuntimeBlockInfo* rdv_CompileBlock(u32 pc, fpscr_t fpu_cfg, u32 blockcheck_failures, bool superblock = false)
+{
 	RuntimeBlockInfo* rbi = ngen_AllocateBlock();
+	if (segment_size == 0)
+		rdv_InitSegments();
 
-	if (!rbi->Setup(pc,fpscr))
+	if (!rbi->Setup(pc, fpu_cfg, superblock))
 	{
 		delete rbi;
 		return NULL;
@@ -231,8 +305,14 @@ DynarecCodeEntryPtr rdv_CompilePC(u32 blockcheck_failures)
 	}
 		bool do_opts = !rbi->temp_block;
 		rbi->staging_runs=do_opts?100:-100;
+		// Count the runs of blocks that would benefit from being extended into a superblock
+		ngen_features features;
+		ngen_GetFeatures(&features);
+		bool staging = features.TieredCompile && do_opts && !superblock && !mmu_enabled() && dec_CanExtendBlock(rbi);
+		if (staging)
+			rbi->staging_runs = SUPERBLOCK_PROMOTE_RUNS;
 		bool block_check = rbi->read_only ? false : IsOnRam(rbi->addr);
-		ngen_Compile(rbi, block_check, (pc & 0xFFFFFF) == 0x08300 || (pc & 0xFFFFFF) == 0x10000, false, do_opts);
+		ngen_Compile(rbi, block_check, (pc & 0xFFFFFF) == 0x08300 || (pc & 0xFFFFFF) == 0x10000, staging, do_opts);
 		verify(rbi->code!=0);
 
 		bm_AddBlock(rbi);
@@ -244,7 +324,69 @@ DynarecCodeEntryPtr rdv_CompilePC(u32 blockcheck_failures)
 		emit_ptr_limit = NULL;
 	}
 
-	return rbi->code;
+	return rbi;
+}
+
+DynarecCodeEntryPtr rdv_CompilePC(u32 blockcheck_failures)
+{
+	u32 pc=next_pc;
+	//printf("rdv_CompilePC next_pc %p\n", next_pc);
+
+	if (is_cache_reset_pc(pc))
+		recSh4_ClearCache();
+	else if (emit_FreeSpace() < 16 * 1024)
+	{
+		if (segment_size != 0)
+			rdv_EvictSegment();
+		else
+			recSh4_ClearCache();
+	}
+
+	RuntimeBlockInfo* rbi = rdv_CompileBlock(pc, fpscr, blockcheck_failures);
+	if (rbi == NULL)
+		return NULL;
+
+	DynarecCodeEntryPtr code = rbi->code;
+	// Compile the other known blocks of this page in one go
+	bm_WarmPage(rbi->addr);
+
+	return code;
+}
+
+bool rdv_PrecompileBlock(u32 vaddr, fpscr_t fpu_cfg)
+{
+	// Never flush the cache to make room for speculative blocks
+	if (emit_FreeSpace() < 16 * 1024 || is_cache_reset_pc(vaddr))
+		return false;
+
+	return rdv_CompileBlock(vaddr, fpu_cfg, 0) != NULL;
+}
+
+// Called by a staged block when its run counter reaches 0.
+// The block is replaced by a superblock. Returns the code of the new block.
+DynarecCodeEntryPtr DYNACALL rdv_PromoteBlock(u32 pc)
+{
+	next_pc = pc;
+	RuntimeBlockInfoPtr block = bm_GetBlock(pc);
+	if (block == NULL || mmu_enabled() || emit_FreeSpace() < 16 * 1024)
+		return rdv_FindOrCompile();
+
+	fpscr_t fpu_cfg = block->fpu_cfg;
+	u32 blockcheck_failures = block->blockcheck_failures;
+	bm_DiscardBlock(block.get());
+	RuntimeBlockInfo* rbi = rdv_CompileBlock(pc, fpu_cfg, blockcheck_failures, true);
+	if (rbi == NULL)
+	{
+		// The staged block returns into its own code after this call
+		caller_code = (const u8 *)block->code;
+		DynarecCodeEntryPtr code = rdv_FindOrCompile();
+		caller_code = NULL;
+		return code;
+	}
+	promoted_blocks++;
+	DEBUG_LOG(DYNAREC, "Promoted block %08x: %d -> %d bytes, %d superblocks", pc, block->sh4_code_size, rbi->sh4_code_size, promoted_blocks);
+
+	return (DynarecCodeEntryPtr)CC_RW2RX(rbi->code);
 }
 
 DynarecCodeEntryPtr DYNACALL rdv_FailedToFindBlock_pc()
@@ -350,7 +492,10 @@ void* DYNACALL rdv_LinkBlock(u8* code,u32 dpc)
 			next_pc=rbi->NextBlock;
 	}
 
+	// The link stub returns into the calling block, so its segment must not be evicted to make room
+	caller_code = (const u8 *)CC_RX2RW((void *)code);
 	DynarecCodeEntryPtr rv = rdv_FindOrCompile();  // Returns rx ptr
+	caller_code = NULL;
 
 	if (!mmu_enabled() && !stale_block)
 	{
@@ -421,8 +566,10 @@ static void recSh4_Reset(bool hard)
 static void recSh4_Init(void)
 {
 	INFO_LOG(DYNAREC, "recSh4 Init");
+	memset(&codecache_stats, 0, sizeof(codecache_stats));
 	Sh4_int_Init();
 	bm_Init();
+	bm_LoadBlockCache();
 
 #if 0
 	verify(rcb_noffs(p_sh4rcb->fpcb) == FPCB_OFFSET);
@@ -467,6 +614,11 @@ static void recSh4_Init(void)
 static void recSh4_Term(void)
 {
 	INFO_LOG(DYNAREC, "recSh4 Term");
+	CodeCacheStats stats;
+	rdv_GetCodeCacheStats(stats);
+	NOTICE_LOG(DYNAREC, "Code cache: %d flushes, %d segments evicted (%d blocks)",
+			stats.flushes, stats.evictions, stats.evicted_blocks);
+	bm_SaveBlockCache();
 	bm_Term();
 	Sh4_int_Term();
 }
@@ -79,8 +79,26 @@ DynarecCodeEntryPtr DYNACALL rdv_FailedToFindBlock_pc();
 DynarecCodeEntryPtr DYNACALL rdv_BlockCheckFail(u32 addr);
 //Called to compile code @pc
 DynarecCodeEntryPtr rdv_CompilePC(u32 blockcheck_failures);
+//Compiles the block @vaddr ahead of its execution. Returns false if no block was added
+bool rdv_PrecompileBlock(u32 vaddr, fpscr_t fpu_cfg);
 //Finds or compiles code @pc
 DynarecCodeEntryPtr rdv_FindOrCompile();
+//Recompiles a hot block as a superblock and returns its code
+DynarecCodeEntryPtr DYNACALL rdv_PromoteBlock(u32 pc);
+
+struct CodeCacheStats
+{
+	u32 flushes;		// full code cache flushes
+	u32 evictions;		// segments evicted to make room
+	u32 evicted_blocks;
+};
+// Code cache activity since the dynarec was initialized
+void rdv_GetCodeCacheStats(CodeCacheStats& stats);
+
+extern "C" {
+//Called by the main loop at the end of each timeslice
+__attribute__((used)) void rdv_SampleCode();
+}
 
 //code -> pointer to code of block, dpc -> if dynamic block, pc. if cond, 0 for next, 1 for branch
 void* DYNACALL rdv_LinkBlock(u8* code,u32 dpc);
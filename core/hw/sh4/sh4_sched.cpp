@@ -27,6 +27,13 @@ std::vector<sched_list> sch_list;
 
 int sh4_sched_next_id=-1;
 
+/*
+	Binary min-heap of the ids of the pending callbacks, ordered by end time then id.
+	sch_heap_pos gives the position of each id in the heap, or -1 if it isn't pending.
+*/
+static std::vector<int> sch_heap;
+static std::vector<int> sch_heap_pos;
+
 u32 sh4_sched_remaining(int id, u32 reference)
 {
 	if (sch_list[id].end != -1)
@@ -39,19 +46,83 @@ u32 sh4_sched_remaining(int id)
 	return sh4_sched_remaining(id, sh4_sched_now());
 }
 
-void sh4_sched_ffts(void)
+static bool sch_before(int a, int b)
 {
-	u32 diff=-1;
-	int slot=-1;
+	// end times are less than SH4_MAIN_CLOCK cycles apart so the wrapping difference gives their order
+	int diff = (int)((u32)sch_list[a].end - (u32)sch_list[b].end);
+	return diff < 0 || (diff == 0 && a < b);
+}
+
+static void sch_heap_set(size_t pos, int id)
+{
+	sch_heap[pos] = id;
+	sch_heap_pos[id] = pos;
+}
 
-	for (size_t i=0;i<sch_list.size();i++)
+static void sch_heap_up(size_t pos)
+{
+	int id = sch_heap[pos];
+	while (pos > 0)
 	{
-		if (sh4_sched_remaining(i)<diff)
-		{
-			slot=i;
-			diff=sh4_sched_remaining(i);
-		}
+		size_t parent = (pos - 1) / 2;
+		if (!sch_before(id, sch_heap[parent]))
+			break;
+		sch_heap_set(pos, sch_heap[parent]);
+		pos = parent;
 	}
+	sch_heap_set(pos, id);
+}
+
+static void sch_heap_down(size_t pos)
+{
+	int id = sch_heap[pos];
+	for (;;)
+	{
+		size_t child = pos * 2 + 1;
+		if (child >= sch_heap.size())
+			break;
+		if (child + 1 < sch_heap.size() && sch_before(sch_heap[child + 1], sch_heap[child]))
+			child++;
+		if (!sch_before(sch_heap[child], id))
+			break;
+		sch_heap_set(pos, sch_heap[child]);
+		pos = child;
+	}
+	sch_heap_set(pos, id);
+}
+
+static void sch_heap_remove(int id)
+{
+	int pos = sch_heap_pos[id];
+	if (pos == -1)
+		return;
+	sch_heap_pos[id] = -1;
+	int last = sch_heap.back();
+	sch_heap.pop_back();
+	if (last == id)
+		return;
+	sch_heap_set(pos, last);
+	sch_heap_up(pos);
+	sch_heap_down(sch_heap_pos[last]);
+}
+
+// Inserts the callback in the heap or moves it according to its new end time
+static void sch_heap_update(int id)
+{
+	if (sch_heap_pos[id] == -1)
+	{
+		sch_heap.push_back(id);
+		sch_heap_pos[id] = sch_heap.size() - 1;
+	}
+	sch_heap_up(sch_heap_pos[id]);
+	sch_heap_down(sch_heap_pos[id]);
+}
+
+// Sets the time of the next event from the top of the heap
+static void sh4_sched_update_next()
+{
+	int slot = sch_heap.empty() ? -1 : sch_heap[0];
+	u32 diff = slot == -1 ? -1 : sh4_sched_remaining(slot);
 
 	sh4_sched_ffb-=Sh4cntx.sh4_sched_next;
 
@@ -64,11 +135,24 @@ void sh4_sched_ffts(void)
 	sh4_sched_ffb+=Sh4cntx.sh4_sched_next;
 }
 
+// Rebuilds the heap from sch_list, which is directly modified when loading a savestate
+void sh4_sched_ffts(void)
+{
+	sch_heap.clear();
+	sch_heap_pos.assign(sch_list.size(), -1);
+	for (size_t i = 0; i < sch_list.size(); i++)
+		if (sch_list[i].end != -1)
+			sch_heap_update(i);
+
+	sh4_sched_update_next();
+}
+
 int sh4_sched_register(int tag, sh4_sched_callback* ssc)
 {
 	sched_list t={ssc,tag,-1,-1};
 
 	sch_list.push_back(t);
+	sch_heap_pos.push_back(-1);
 
 	return sch_list.size()-1;
 }
@@ -100,9 +184,12 @@ void sh4_sched_request(int id, int cycles)
 		sch_list[id].end = sch_list[id].start + cycles;
 		if (sch_list[id].end == -1)
 			sch_list[id].end++;
+		sch_heap_update(id);
 	}
+	else
+		sch_heap_remove(id);
 
-	sh4_sched_ffts();
+	sh4_sched_update_next();
 }
 
 /* Returns how much time has passed for this callback */
@@ -123,12 +210,40 @@ static void handle_cb(int id)
 	int jitter=elapsd-remain;
 
 	sch_list[id].end=-1;
+	sch_heap_remove(id);
 	int re_sch=sch_list[id].cb(sch_list[id].tag,remain,jitter);
 
 	if (re_sch > 0)
 		sh4_sched_request(id, std::max(0, re_sch - jitter));
 }
 
+/*
+	Returns the lowest id >= min_id of the callbacks expiring in the [fztime, fztime + cycles] range, or -1.
+	Only the top of the heap needs to be visited.
+*/
+static int sh4_sched_first_due(size_t pos, u32 fztime, int cycles, int min_id)
+{
+	if (pos >= sch_heap.size())
+		return -1;
+	int id = sch_heap[pos];
+	if ((int)((u32)sch_list[id].end - fztime - cycles) > 0)
+		// This one and its children expire later
+		return -1;
+
+	int rv = -1;
+	int remaining = sh4_sched_remaining(id, fztime);
+	verify(remaining >= 0);
+	if (remaining <= cycles && id >= min_id)
+		rv = id;
+	for (size_t child = pos * 2 + 1; child <= pos * 2 + 2; child++)
+	{
+		int child_id = sh4_sched_first_due(child, fztime, cycles, min_id);
+		if (child_id != -1 && (rv == -1 || child_id < rv))
+			rv = child_id;
+	}
+	return rv;
+}
+
 void sh4_sched_tick(int cycles)
 {
 	/*
@@ -141,14 +256,79 @@ void sh4_sched_tick(int cycles)
 		u32 fztime=sh4_sched_now()-cycles;
 		if (sh4_sched_next_id!=-1)
 		{
-			for (int i = 0; i < sch_list.size(); i++)
-			{
-				int remaining = sh4_sched_remaining(i, fztime);
-				verify(remaining >= 0 || remaining == -1);
-				if (remaining >= 0 && remaining <= (u32)cycles)
-					handle_cb(i);
-			}
+			// Expired callbacks are handled in id order
+			int id = -1;
+			while ((id = sh4_sched_first_due(0, fztime, cycles, id + 1)) != -1)
+				handle_cb(id);
 		}
-		sh4_sched_ffts();
+		sh4_sched_update_next();
 	}
 }
+
+#ifdef NO_REND
+#include "oslib/oslib.h"
+
+extern void dc_prepare_system(void);
+bool _vmem_reserve();
+
+static u32 bench_seed;
+static u32 bench_rand(u32 max)
+{
+	bench_seed = bench_seed * 1103515245 + 12345;
+	return (bench_seed >> 8) % max;
+}
+
+// Half of the callbacks are periodic like the TMU and SPG ones, the others fire once
+static int bench_callback(int tag, int sch_cycl, int jitter)
+{
+	return (tag & 1) ? sch_cycl : 0;
+}
+
+bool sh4_sched_bench(u32 callbacks, u32 timeslices)
+{
+	if (!sch_list.empty())
+	{
+		ERROR_LOG(SH4, "The scheduler benchmark must be run before dc_init()");
+		return false;
+	}
+	dc_prepare_system();
+	if (!_vmem_reserve())
+	{
+		ERROR_LOG(SH4, "Failed to alloc mem");
+		return false;
+	}
+	bench_seed = 1;
+	sh4_sched_ffb = 0;
+	Sh4cntx.sh4_sched_next = 0;
+	for (u32 i = 0; i < callbacks; i++)
+		sh4_sched_register(i, bench_callback);
+	for (u32 i = 0; i < callbacks; i++)
+		sh4_sched_request(i, 448 + bench_rand(SH4_MAIN_CLOCK / 100));
+
+	// The emulation loop of the interpreter. Devices reprogram their timers
+	// about every 8 timeslices.
+	u32 requests = 0;
+	double start_time = os_GetSeconds();
+	for (u32 i = 0; i < timeslices; i++)
+	{
+		Sh4cntx.sh4_sched_next -= 448;
+		if (Sh4cntx.sh4_sched_next < 0)
+			sh4_sched_tick(448);
+		if (bench_rand(8) == 0)
+		{
+			sh4_sched_request(bench_rand(callbacks), 448 + bench_rand(SH4_MAIN_CLOCK / 100));
+			requests++;
+		}
+	}
+	double time = os_GetSeconds() - start_time;
+	NOTICE_LOG(SH4, "Scheduler benchmark: %d callbacks, %d timeslices, %d requests: %.1f ns per timeslice",
+			callbacks, timeslices, requests, time * 1e9 / timeslices);
+
+	sch_list.clear();
+	sh4_sched_ffts();
+	sh4_sched_ffb = 0;
+	Sh4cntx.sh4_sched_next = 0;
+
+	return true;
+}
+#endif
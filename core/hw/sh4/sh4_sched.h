@@ -41,6 +41,16 @@ void sh4_sched_tick(int cycles);
 
 void sh4_sched_ffts();
 
+#ifdef NO_REND
+// About as many callbacks as the emulated devices register
+#define SCHED_BENCH_CALLBACKS 16
+#define SCHED_BENCH_TIMESLICES 10000000
+
+// Runs the scheduler with synthetic callbacks and logs the time spent per timeslice.
+// Must be called before dc_init().
+bool sh4_sched_bench(u32 callbacks, u32 timeslices);
+#endif
+
 struct sched_list
 {
 	sh4_sched_callback* cb;
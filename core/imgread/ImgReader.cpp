@@ -7,19 +7,121 @@
 
 void GetSessionInfo(u8* out,u8 ses);
 
+/*
+	Asynchronous sector reads
+
+	The read thread handles one request at a time, so that host I/O and CHD
+	decompression overlap with emulation. Discs aren't thread safe: every
+	other disc access waits for the pending request first.
+*/
+#if !defined(TARGET_NO_THREADS)
+struct AsyncReadRequest
+{
+	u8* buff;
+	u32 start_sector;
+	u32 sector_count;
+	u32 secsz;
+};
+// Protected by read_mutex
+static AsyncReadRequest read_request;
+static bool read_pending;
+static bool read_exit;
+static cMutex read_mutex;
+static cResetEvent read_requested;
+static cResetEvent read_done;
+
+static void *ReadThreadEntry(void *param)
+{
+	while (true)
+	{
+		read_requested.Wait();
+		read_mutex.lock();
+		bool pending = read_pending;
+		bool exit = read_exit;
+		AsyncReadRequest request = read_request;
+		read_mutex.unlock();
+		if (exit)
+			return nullptr;
+		if (!pending)
+			continue;
+
+		GetDriveSector(request.buff, request.start_sector, request.sector_count, request.secsz);
+
+		read_mutex.lock();
+		read_pending = false;
+		read_mutex.unlock();
+		read_done.Set();
+	}
+}
+static cThread read_thread(ReadThreadEntry, nullptr);
+
+static void StopReadThread()
+{
+	if (read_thread.hThread == NULL)
+		return;
+	libGDR_WaitRead();
+	read_mutex.lock();
+	read_exit = true;
+	read_mutex.unlock();
+	read_requested.Set();
+	read_thread.WaitToEnd();
+	read_exit = false;
+}
+#endif
+
+void libGDR_WaitRead()
+{
+#if !defined(TARGET_NO_THREADS)
+	while (true)
+	{
+		read_mutex.lock();
+		bool pending = read_pending;
+		read_mutex.unlock();
+		if (!pending)
+			break;
+		read_done.Wait();
+	}
+#endif
+}
+
+void libGDR_ReadSectorAsync(u8 * buff,u32 StartSector,u32 SectorCount,u32 secsz)
+{
+	libGDR_WaitRead();
+#if !defined(TARGET_NO_THREADS)
+	if (read_thread.hThread == NULL)
+		read_thread.Start();
+	read_mutex.lock();
+	read_request = { buff, StartSector, SectorCount, secsz };
+	read_pending = true;
+	read_mutex.unlock();
+	read_requested.Set();
+#else
+	GetDriveSector(buff,StartSector,SectorCount,secsz);
+#endif
+}
+
 void libGDR_ReadSubChannel(u8 * buff, u32 format, u32 len)
 {
+	libGDR_WaitRead();
 	if (format==0)
 		memcpy(buff,q_subchannel,len);
 }
 
 void libGDR_ReadSector(u8 * buff,u32 StartSector,u32 SectorCount,u32 secsz)
 {
+	libGDR_WaitRead();
 	GetDriveSector(buff,StartSector,SectorCount,secsz);
 	//if (CurrDrive)
 	//	CurrDrive->ReadSector(buff,StartSector,SectorCount,secsz);
 }
 
+void libGDR_ReadAhead(u32 StartSector,u32 SectorCount)
+{
+	libGDR_WaitRead();
+	if (disc != NULL)
+		disc->ReadAhead(StartSector, SectorCount);
+}
+
 void libGDR_GetToc(u32* toc,u32 area)
 {
 	GetDriveToc(toc,(DiskArea)area);
@@ -90,5 +192,8 @@ s32 libGDR_Init()
 //called when exiting from sh4 thread , from the new thread context (for any thread specific init) :P
 void libGDR_Term()
 {
+#if !defined(TARGET_NO_THREADS)
+	StopReadThread();
+#endif
 	TermDrive();
 }
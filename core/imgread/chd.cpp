@@ -1,4 +1,5 @@
 #include "common.h"
+#include "stdclass.h"
 
 #include "deps/libchdr/include/libchdr/chd.h"
 
@@ -8,27 +9,64 @@ const uint32_t CD_TRACK_PADDING = 4;
 struct CHDDisc : Disc
 {
 	chd_file* chd;
-	u8* hunk_mem;
-	u32 old_hunk;
 
 	u32 hunkbytes;
 	u32 sph;
+	u32 hunkcount;
 
 	CHDDisc()
+#if !defined(TARGET_NO_THREADS)
+		: prefetch_thread(PrefetchEntry, this)
+#endif
 	{
 		chd=0;
-		hunk_mem=0;
 	}
 
 	bool TryOpen(const char* file);
 
-	~CHDDisc()
+	~CHDDisc();
+
+	void ReadHunk(u32 hunk, u32 offset, u8 *dst, u32 len);
+	virtual void ReadAhead(u32 FAD, u32 count) override;
+
+private:
+	// LRU cache of decompressed hunks.
+	// Entries are only replaced with both chd_mutex and cache_mutex held.
+	struct CachedHunk
 	{
-		if (hunk_mem)
-			delete [] hunk_mem;
-		if (chd)
-			chd_close(chd);
-	}
+		u32 hunk;
+		u32 last_used;
+		u8 *data;
+	};
+	std::vector<CachedHunk> cache;
+	u32 use_count = 0;
+	cMutex cache_mutex;
+	// chd_read isn't thread safe
+	cMutex chd_mutex;
+	u8 *read_mem = nullptr;		// decompression buffer of the reading thread
+	u32 last_hunk = ~0u;
+	u32 readahead_hunks = 0;
+
+	u32 hits = 0;
+	u32 misses = 0;
+	u32 prefetched = 0;
+
+	CachedHunk *FindHunk(u32 hunk);
+	CachedHunk *InsertHunk(u32 hunk, u8 *&buffer);
+	void Prefetch(u32 hunk, u32 count);
+
+#if !defined(TARGET_NO_THREADS)
+	// Read-ahead thread, decompresses [prefetch_next, prefetch_end)
+	u32 prefetch_next = 0;
+	u32 prefetch_end = 0;
+	u8 *prefetch_mem = nullptr;
+	bool prefetch_exit = false;
+	cResetEvent prefetch_event;
+	cThread prefetch_thread;
+
+	static void *PrefetchEntry(void *param);
+	void PrefetchLoop();
+#endif
 };
 
 struct CHDTrack : TrackFile
@@ -52,15 +90,9 @@ struct CHDTrack : TrackFile
 	{
 		u32 fad_offs = FAD + Offset;
 		u32 hunk=(fad_offs)/disc->sph;
-		if (disc->old_hunk!=hunk)
-		{
-			chd_read(disc->chd,hunk,disc->hunk_mem); //CHDERR_NONE
-			disc->old_hunk = hunk;
-		}
-
 		u32 hunk_ofs=fad_offs%disc->sph;
 
-		memcpy(dst,disc->hunk_mem+hunk_ofs*(2352+96),fmt);
+		disc->ReadHunk(hunk, hunk_ofs*(2352+96), dst, fmt);
 
 		if (swap_bytes)
 		{
@@ -80,6 +112,173 @@ struct CHDTrack : TrackFile
 	}
 };
 
+CHDDisc::~CHDDisc()
+{
+#if !defined(TARGET_NO_THREADS)
+	if (prefetch_thread.hThread != NULL)
+	{
+		cache_mutex.lock();
+		prefetch_exit = true;
+		cache_mutex.unlock();
+		prefetch_event.Set();
+		prefetch_thread.WaitToEnd();
+	}
+	delete [] prefetch_mem;
+#endif
+	if (!cache.empty())
+		INFO_LOG(GDROM, "chd: hunk cache: %d hits, %d misses, %d prefetched", hits, misses, prefetched);
+	for (CachedHunk& entry : cache)
+		delete [] entry.data;
+	delete [] read_mem;
+	if (chd)
+		chd_close(chd);
+}
+
+CHDDisc::CachedHunk *CHDDisc::FindHunk(u32 hunk)
+{
+	for (CachedHunk& entry : cache)
+		if (entry.hunk == hunk)
+			return &entry;
+	return nullptr;
+}
+
+// Replaces the least recently used entry with the hunk decompressed in buffer.
+// buffer gets the memory of the evicted entry.
+CHDDisc::CachedHunk *CHDDisc::InsertHunk(u32 hunk, u8 *&buffer)
+{
+	CachedHunk *victim = &cache[0];
+	for (CachedHunk& entry : cache)
+		if (entry.last_used < victim->last_used)
+			victim = &entry;
+	std::swap(victim->data, buffer);
+	victim->hunk = hunk;
+	victim->last_used = ++use_count;
+
+	return victim;
+}
+
+void CHDDisc::ReadHunk(u32 hunk, u32 offset, u8 *dst, u32 len)
+{
+	if (hunk != last_hunk)
+	{
+		// Sequential access: start reading the next hunks in the background
+		if (hunk == last_hunk + 1)
+			Prefetch(hunk + 1, readahead_hunks);
+		last_hunk = hunk;
+	}
+
+	cache_mutex.lock();
+	CachedHunk *entry = FindHunk(hunk);
+	if (entry != nullptr)
+	{
+		entry->last_used = ++use_count;
+		memcpy(dst, entry->data + offset, len);
+		hits++;
+		cache_mutex.unlock();
+		return;
+	}
+	cache_mutex.unlock();
+
+	chd_mutex.lock();
+	// The read-ahead thread may have loaded it in the meantime
+	entry = FindHunk(hunk);
+	if (entry == nullptr)
+	{
+		chd_read(chd, hunk, read_mem); //CHDERR_NONE
+		cache_mutex.lock();
+		entry = InsertHunk(hunk, read_mem);
+		misses++;
+	}
+	else
+	{
+		cache_mutex.lock();
+		entry->last_used = ++use_count;
+		hits++;
+	}
+	memcpy(dst, entry->data + offset, len);
+	cache_mutex.unlock();
+	chd_mutex.unlock();
+}
+
+void CHDDisc::Prefetch(u32 hunk, u32 count)
+{
+#if !defined(TARGET_NO_THREADS)
+	if (count == 0 || hunk >= hunkcount)
+		return;
+	cache_mutex.lock();
+	prefetch_next = hunk;
+	prefetch_end = std::min(hunk + count, hunkcount);
+	cache_mutex.unlock();
+
+	if (prefetch_thread.hThread == NULL)
+	{
+		prefetch_mem = new u8[hunkbytes];
+		prefetch_thread.Start();
+	}
+	prefetch_event.Set();
+#endif
+}
+
+void CHDDisc::ReadAhead(u32 FAD, u32 count)
+{
+	for (const Track& track : tracks)
+	{
+		if (FAD >= track.StartFAD && FAD <= track.EndFAD)
+		{
+			const CHDTrack *chdTrack = (const CHDTrack *)track.file;
+			count = std::min(count, track.EndFAD - FAD + 1);
+			u32 first = (FAD + chdTrack->Offset) / sph;
+			u32 last = (FAD + count - 1 + chdTrack->Offset) / sph;
+			Prefetch(first, std::min(last - first + 1, readahead_hunks));
+			break;
+		}
+	}
+}
+
+#if !defined(TARGET_NO_THREADS)
+void *CHDDisc::PrefetchEntry(void *param)
+{
+	((CHDDisc *)param)->PrefetchLoop();
+	return nullptr;
+}
+
+void CHDDisc::PrefetchLoop()
+{
+	while (true)
+	{
+		prefetch_event.Wait();
+		while (true)
+		{
+			cache_mutex.lock();
+			if (prefetch_exit || prefetch_next >= prefetch_end)
+			{
+				bool exit = prefetch_exit;
+				cache_mutex.unlock();
+				if (exit)
+					return;
+				break;
+			}
+			u32 hunk = prefetch_next++;
+			bool cached = FindHunk(hunk) != nullptr;
+			cache_mutex.unlock();
+			if (cached)
+				continue;
+
+			chd_mutex.lock();
+			if (FindHunk(hunk) == nullptr)
+			{
+				chd_read(chd, hunk, prefetch_mem);
+				cache_mutex.lock();
+				InsertHunk(hunk, prefetch_mem);
+				prefetched++;
+				cache_mutex.unlock();
+			}
+			chd_mutex.unlock();
+		}
+	}
+}
+#endif
+
 bool CHDDisc::TryOpen(const char* file)
 {
 	chd_error err=chd_open(file,CHD_OPEN_READ,0,&chd);
@@ -95,8 +294,7 @@ bool CHDDisc::TryOpen(const char* file)
 	const chd_header* head = chd_get_header(chd);
 
 	hunkbytes = head->hunkbytes;
-	hunk_mem = new u8[hunkbytes];
-	old_hunk=0xFFFFFFF;
+	hunkcount = head->totalhunks;
 
 	sph = hunkbytes/(2352+96);
 
@@ -106,6 +304,19 @@ bool CHDDisc::TryOpen(const char* file)
 		return false;
 	}
 
+	u32 cache_hunks = std::max(2u, (u32)(settings.imgread.ChdCacheSize * 1024 * 1024 / hunkbytes));
+	cache.resize(cache_hunks);
+	for (CachedHunk& entry : cache)
+	{
+		entry.hunk = ~0u;
+		entry.last_used = 0;
+		entry.data = new u8[hunkbytes];
+	}
+	read_mem = new u8[hunkbytes];
+	// Leave room in the cache for the hunks being read
+	readahead_hunks = std::min(cache_hunks / 2, 16u);
+	DEBUG_LOG(GDROM, "chd: caching %d hunks of %d bytes", cache_hunks, hunkbytes);
+
 	u32 tag;
 	u8 flags;
 	char temp[512];
@@ -55,7 +55,7 @@ static void PatchRegion_6(u8* sector,int size)
 	memcpy(&p_area_text[4 + 32 + 32],"For EUROPE.                 ",28);
 }
 
-bool ConvertSector(u8* in_buff , u8* out_buff , int from , int to,int sector)
+bool ConvertSector(const u8* in_buff , u8* out_buff , int from , int to,int sector)
 {
    //get subchannel data, if any
    if (from==2448)
@@ -238,6 +238,8 @@ bool DiscSwap(u32 fileflags)
 
 void TermDrive()
 {
+	// The read thread may be using the disc
+	libGDR_WaitRead();
 	if (disc != NULL)
 		delete disc;
 
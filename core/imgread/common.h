@@ -1,6 +1,7 @@
 #pragma once
 #include "gd_driver.h"
 #include <vector>
+#include <algorithm>
 
 #include "deps/coreio/coreio.h"
 
@@ -80,7 +81,7 @@ enum SubcodeFormat
 	SUBFMT_96					//raw 96-byte subcode info
 };
 
-bool ConvertSector(u8* in_buff , u8* out_buff , int from , int to,int sector);
+bool ConvertSector(const u8* in_buff , u8* out_buff , int from , int to,int sector);
 
 bool InitDrive(u32 fileflags=0);
 void TermDrive();
@@ -110,6 +111,17 @@ struct Session
 struct TrackFile
 {
 	virtual void Read(u32 FAD,u8* dst,SectorFormat* sector_type,u8* subcode,SubcodeFormat* subcode_type)=0;
+	// Reads count consecutive sectors. Sector i is stored at dst + i * stride.
+	virtual void ReadSectors(u32 FAD,u32 count,u8* dst,u32 stride,SectorFormat* sector_type,u8* subcode,SubcodeFormat* subcode_type)
+	{
+		for (u32 i = 0; i < count; i++)
+			Read(FAD + i, dst + i * stride, sector_type, subcode, subcode_type);
+	}
+	// Returns the count consecutive sectors starting at FAD if they can be read in place,
+	// stored contiguously with sector_size bytes each. NULL otherwise.
+	virtual const u8* GetSectors(u32 FAD,u32 count,SectorFormat* sector_type,u32* sector_size) { return NULL; }
+	// Hint that the sectors [FAD, FAD + count) are going to be read
+	virtual void ReadAhead(u32 FAD, u32 count) { }
 	virtual ~TrackFile() {};
 };
 
@@ -129,9 +141,13 @@ struct Track
 		CTRL = 0;
 		ADDR = 0;
 	}
+	bool Contains(u32 FAD) const
+	{
+		return FAD>=StartFAD && (FAD<=EndFAD || EndFAD==0) && file;
+	}
 	bool Read(u32 FAD,u8* dst,SectorFormat* sector_type,u8* subcode,SubcodeFormat* subcode_type)
 	{
-		if (FAD>=StartFAD && (FAD<=EndFAD || EndFAD==0) && file)
+		if (Contains(FAD))
 		{
 			file->Read(FAD,dst,sector_type,subcode,subcode_type);
 			return true;
@@ -149,66 +165,117 @@ struct Disc
 	Track LeadOut;				//info for lead out track (can't read from here)
 	u32 EndFAD;					//Last valid disc sector
 	DiscType type;
+	std::vector<u8> read_buffer;	//raw sectors read by ReadSectors
 
 	//functions !
-	bool ReadSector(u32 FAD,u8* dst,SectorFormat* sector_type,u8* subcode,SubcodeFormat* subcode_type)
+	Track* FindTrack(u32 FAD)
 	{
+		// Tracks are sorted by StartFAD, so the last one starting at or before FAD is the one
+		auto it = std::upper_bound(tracks.begin(), tracks.end(), FAD,
+				[](u32 fad, const Track& track) { return fad < track.StartFAD; });
+		if (it != tracks.begin() && (it - 1)->Contains(FAD))
+			return &*(it - 1);
+		// Gaps and overlapping tracks
 		for (size_t i=tracks.size();i-->0;)
-		{
-			*subcode_type=SUBFMT_NONE;
-			if (tracks[i].Read(FAD,dst,sector_type,subcode,subcode_type))
-				return true;
-		}
+			if (tracks[i].Contains(FAD))
+				return &tracks[i];
+
+		return NULL;
+	}
+
+	bool ReadSector(u32 FAD,u8* dst,SectorFormat* sector_type,u8* subcode,SubcodeFormat* subcode_type)
+	{
+		*subcode_type=SUBFMT_NONE;
+		Track* track = FindTrack(FAD);
 
-		return false;
+		return track != NULL && track->Read(FAD,dst,sector_type,subcode,subcode_type);
 	}
 
 	void ReadSectors(u32 FAD,u32 count,u8* dst,u32 fmt)
 	{
-		u8 temp[2448];
+		const u32 stride = 2448;
+		const u32 max_run = 64;
+		if (read_buffer.size() < max_run * stride)
+			read_buffer.resize(max_run * stride);
 		SectorFormat secfmt;
 		SubcodeFormat subfmt;
 
 		while(count)
 		{
-			if (ReadSector(FAD,temp,&secfmt,q_subchannel,&subfmt))
+			Track* track = FindTrack(FAD);
+			if (track == NULL)
 			{
-				//TODO: Proper sector conversions
-				if (secfmt==SECFMT_2352)
-				{
-					ConvertSector(temp,dst,2352,fmt,FAD);
-				}
-				else if (fmt == 2048 && secfmt==SECFMT_2336_MODE2)
-					memcpy(dst,temp+8,2048);
-				else if (fmt==2048 && (secfmt==SECFMT_2048_MODE1 || secfmt==SECFMT_2048_MODE2_FORM1 ))
-				{
-					memcpy(dst,temp,2048);
-				}
-				else if (fmt==2352 && (secfmt==SECFMT_2048_MODE1 || secfmt==SECFMT_2048_MODE2_FORM1 ))
-				{
-					INFO_LOG(GDROM, "GDR:fmt=2352;secfmt=2048");
-					memcpy(dst,temp,2048);
-				}
-				else if (fmt==2048 && secfmt==SECFMT_2448_MODE2)
-				{
-					// Pier Solar and the Great Architects
-					ConvertSector(temp, dst, 2448, fmt, FAD);
-				}
-				else
-				{
-					WARN_LOG(GDROM, "ERROR: UNABLE TO CONVERT SECTOR. THIS IS FATAL. Format: %d Sector format: %d", fmt, secfmt);
-					//verify(false);
-				}
+				INFO_LOG(GDROM, "Sector Read miss FAD: %d", FAD);
+				dst+=fmt;
+				FAD++;
+				count--;
+				continue;
 			}
-			else
+			// Read as many sectors of this track as possible in one go
+			u32 run = std::min(count, max_run);
+			if (track->EndFAD != 0)
+				run = std::min(run, track->EndFAD - FAD + 1);
+			// Convert from the mapped image when possible, saving a copy
+			u32 src_stride;
+			const u8* src = track->file->GetSectors(FAD, run, &secfmt, &src_stride);
+			if (src == NULL)
 			{
-				INFO_LOG(GDROM, "Sector Read miss FAD: %d", FAD);
+				subfmt = SUBFMT_NONE;
+				track->file->ReadSectors(FAD, run, &read_buffer[0], stride, &secfmt, q_subchannel, &subfmt);
+				src = &read_buffer[0];
+				src_stride = stride;
+			}
+
+			for (u32 i = 0; i < run; i++)
+			{
+				ConvertSector(src + i * src_stride, secfmt, dst, fmt, FAD);
+				dst+=fmt;
+				FAD++;
 			}
-			dst+=fmt;
-			FAD++;
-			count--;
+			count -= run;
+		}
+	}
+
+	void ConvertSector(const u8* temp, SectorFormat secfmt, u8* dst, u32 fmt, u32 FAD)
+	{
+		//TODO: Proper sector conversions
+		if (secfmt==SECFMT_2352)
+		{
+			::ConvertSector(temp,dst,2352,fmt,FAD);
+		}
+		else if (fmt == 2048 && secfmt==SECFMT_2336_MODE2)
+			memcpy(dst,temp+8,2048);
+		else if (fmt==2048 && (secfmt==SECFMT_2048_MODE1 || secfmt==SECFMT_2048_MODE2_FORM1 ))
+		{
+			memcpy(dst,temp,2048);
+		}
+		else if (fmt==2352 && (secfmt==SECFMT_2048_MODE1 || secfmt==SECFMT_2048_MODE2_FORM1 ))
+		{
+			INFO_LOG(GDROM, "GDR:fmt=2352;secfmt=2048");
+			memcpy(dst,temp,2048);
+		}
+		else if (fmt==2048 && secfmt==SECFMT_2448_MODE2)
+		{
+			// Pier Solar and the Great Architects
+			::ConvertSector(temp, dst, 2448, fmt, FAD);
+		}
+		else
+		{
+			WARN_LOG(GDROM, "ERROR: UNABLE TO CONVERT SECTOR. THIS IS FATAL. Format: %d Sector format: %d", fmt, secfmt);
+			//verify(false);
 		}
 	}
+	// Hint that the sectors [FAD, FAD + count) are going to be read
+	virtual void ReadAhead(u32 FAD, u32 count)
+	{
+		Track* track = FindTrack(FAD);
+		if (track == NULL)
+			return;
+		if (track->EndFAD != 0)
+			count = std::min(count, track->EndFAD - FAD + 1);
+		track->file->ReadAhead(FAD, count);
+	}
+
 	virtual ~Disc() 
 	{
 		for (size_t i=0;i<tracks.size();i++)
@@ -263,12 +330,17 @@ extern Disc* disc;
 
 Disc* OpenDisc(const char* fn);
 
+// Uncompressed track. The image file is memory-mapped when possible, and read
+// with core_fread otherwise.
 struct RawTrackFile : TrackFile
 {
 	core_file* file;
 	s32 offset;
 	u32 fmt;
 	bool cleanup;
+	const u8* map;
+	size_t map_size;
+	u32 readahead_end;	// end of the last ReadAhead range, to detect streaming
 
 	RawTrackFile(core_file* file,u32 file_offs,u32 first_fad,u32 secfmt)
 	{
@@ -277,33 +349,76 @@ struct RawTrackFile : TrackFile
 		this->offset=file_offs-first_fad*secfmt;
 		this->fmt=secfmt;
 		this->cleanup=true;
+		this->map=core_fmap(file, &map_size);
+		this->readahead_end=0;
 	}
 
-	virtual void Read(u32 FAD,u8* dst,SectorFormat* sector_type,u8* subcode,SubcodeFormat* subcode_type)
+	SectorFormat GetSectorFormat()
 	{
 		//for now hackish
       switch (fmt)
       {
          case 2352:
-            *sector_type=SECFMT_2352;
-            break;
+            return SECFMT_2352;
          case 2048:
-            *sector_type=SECFMT_2048_MODE2_FORM1;
-            break;
+            return SECFMT_2048_MODE2_FORM1;
          case 2336:
-            *sector_type=SECFMT_2336_MODE2;
-            break;
+            return SECFMT_2336_MODE2;
          case 2448:
-            *sector_type=SECFMT_2448_MODE2;
-            break;
+            return SECFMT_2448_MODE2;
          default:
             verify(false);
-            break;
+            return SECFMT_2352;
       }
+	}
 
+	virtual void Read(u32 FAD,u8* dst,SectorFormat* sector_type,u8* subcode,SubcodeFormat* subcode_type)
+	{
+		u32 sector_size;
+		const u8* src = GetSectors(FAD, 1, sector_type, &sector_size);
+		if (src != NULL)
+		{
+			memcpy(dst, src, fmt);
+			return;
+		}
 		core_fseek(file,offset+FAD*fmt,SEEK_SET);
 		core_fread(file, dst, fmt);
 	}
+	virtual const u8* GetSectors(u32 FAD,u32 count,SectorFormat* sector_type,u32* sector_size)
+	{
+		*sector_type = GetSectorFormat();
+		*sector_size = fmt;
+		s64 start = offset + (s64)FAD * fmt;
+		if (map == NULL || start < 0 || start + (s64)count * fmt > (s64)map_size)
+			return NULL;
+		return map + start;
+	}
+	virtual void ReadAhead(u32 FAD, u32 count)
+	{
+		s64 start = offset + (s64)FAD * fmt;
+		if (map != NULL && start >= 0)
+			core_fadvise(file, (size_t)start, (size_t)count * fmt, FAD == readahead_end);
+		readahead_end = FAD + count;
+	}
+	virtual void ReadSectors(u32 FAD,u32 count,u8* dst,u32 stride,SectorFormat* sector_type,u8* subcode,SubcodeFormat* subcode_type)
+	{
+		if (count == 0)
+			return;
+		u32 sector_size;
+		const u8* src = GetSectors(FAD, count, sector_type, &sector_size);
+		if (src != NULL)
+		{
+			for (u32 i = 0; i < count; i++)
+				memcpy(dst + i * stride, src + i * fmt, fmt);
+			return;
+		}
+		// Read the sectors contiguously, then spread them from the last one
+		core_fseek(file,offset+FAD*fmt,SEEK_SET);
+		core_fread(file, dst, count * fmt);
+		if (stride != fmt)
+			for (u32 i = count; i-- > 1; )
+				memmove(dst + i * stride, dst + i * fmt, fmt);
+	}
 	virtual ~RawTrackFile()
 	{
 		if (cleanup && file)
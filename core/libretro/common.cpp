@@ -1,6 +1,7 @@
 #include "types.h"
 
 #include <errno.h>
+#include <thread>
 
 #ifdef __MACH__
 #define _XOPEN_SOURCE 1
@@ -474,6 +475,128 @@ void cThread::WaitToEnd()
 //End thread class
 #endif
 
+WorkerPool worker_pool;
+
+void WorkerPool::Init(int count)
+{
+	verify(!started);
+	started = true;
+	busy = false;
+#if !defined(TARGET_NO_THREADS)
+	mutx = slock_new();
+	start_cond = scond_new();
+	done_cond = scond_new();
+	stopping = false;
+	for (int i = 0; i < count; i++)
+		threads.push_back(sthread_create(WorkerEntry, this));
+	INFO_LOG(COMMON, "Worker pool started with %d threads", count);
+#endif
+}
+
+void WorkerPool::Term()
+{
+	if (!started)
+		return;
+	started = false;
+#if !defined(TARGET_NO_THREADS)
+	slock_lock(mutx);
+	stopping = true;
+	scond_broadcast(start_cond);
+	slock_unlock(mutx);
+	for (sthread_t *thread : threads)
+		sthread_join(thread);
+	threads.clear();
+	scond_free(done_cond);
+	scond_free(start_cond);
+	slock_free(mutx);
+	mutx = nullptr;
+#endif
+}
+
+void WorkerPool::WorkerEntry(void *param)
+{
+	((WorkerPool *)param)->Work();
+}
+
+void WorkerPool::RunTasks()
+{
+	for (int i = next_task++; i < task_count; i = next_task++)
+		(*task)(i);
+}
+
+void WorkerPool::Work()
+{
+#if !defined(TARGET_NO_THREADS)
+	u32 last_batch = 0;
+	slock_lock(mutx);
+	while (true)
+	{
+		while (!stopping && (!batch_open || batch == last_batch))
+			scond_wait(start_cond, mutx);
+		if (stopping)
+			break;
+		last_batch = batch;
+		active_workers++;
+		slock_unlock(mutx);
+
+		RunTasks();
+
+		slock_lock(mutx);
+		if (--active_workers == 0)
+			scond_signal(done_cond);
+	}
+	slock_unlock(mutx);
+#endif
+}
+
+void WorkerPool::Run(int count, const std::function<void(int)>& task)
+{
+	bool expected = false;
+	if (threads.empty() || count <= 1 || !busy.compare_exchange_strong(expected, true))
+	{
+		for (int i = 0; i < count; i++)
+			task(i);
+		return;
+	}
+#if !defined(TARGET_NO_THREADS)
+	slock_lock(mutx);
+	this->task = &task;
+	task_count = count;
+	next_task = 0;
+	batch++;
+	batch_open = true;
+	scond_broadcast(start_cond);
+	slock_unlock(mutx);
+
+	RunTasks();
+
+	// Wait for the workers that joined this batch. Others can't join anymore.
+	slock_lock(mutx);
+	batch_open = false;
+	while (active_workers > 0)
+		scond_wait(done_cond, mutx);
+	this->task = nullptr;
+	slock_unlock(mutx);
+#endif
+	busy = false;
+}
+
+static int getThreadCount()
+{
+	int tcount = (int)std::thread::hardware_concurrency() - 1;
+	if (tcount < 1)
+		tcount = 1;
+	return std::min(tcount, (int)settings.pvr.MaxThreads);
+}
+
+void StartWorkerPool()
+{
+	// The pool is stopped by retro_deinit and restarted on the next frame
+	if (!worker_pool.IsRunning())
+		// The render thread is the last worker
+		worker_pool.Init(getThreadCount() - 1);
+}
+
 //cResetEvent Class
 cResetEvent::cResetEvent()
 {
@@ -42,17 +42,20 @@ char* strdup(const char *str)
 #include "../hw/sh4/sh4_mem.h"
 #include "../hw/sh4/sh4_sched.h"
 #include "../hw/sh4/dyna/blockmanager.h"
+#include "../hw/pvr/ta_capture.h"
 #include "keyboard_map.h"
 #include "hw/maple/maple_cfg.h"
 #include "hw/maple/maple_if.h"
 #include "hw/maple/maple_cfg.h"
 #include "../hw/pvr/spg.h"
 #include "../hw/naomi/naomi_cart.h"
+#include "../network/naomi_network.h"
 #include "../imgread/common.h"
 #include "../hw/aica/dsp.h"
 #include "log/LogManager.h"
 #include "cheats.h"
 #include "rend/CustomTexture.h"
+#include "rend/soft/softrend.h"
 
 #if defined(_XBOX) || defined(_WIN32)
 char slash = '\\';
@@ -360,6 +363,7 @@ void retro_deinit(void)
    mtx_serialization.unlock();
 
    libretro_supports_bitmasks = false;
+   worker_pool.Term();
    LogManager::Shutdown();
 }
 
@@ -422,6 +426,9 @@ static void set_variable_visibility(void)
    option_display.key = CORE_OPTION_NAME "_synchronous_rendering";
    environ_cb(RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY, &option_display);
 
+   option_display.key = CORE_OPTION_NAME "_render_queue_size";
+   environ_cb(RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY, &option_display);
+
    option_display.key = CORE_OPTION_NAME "_delay_frame_swapping";
    environ_cb(RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY, &option_display);
 
@@ -589,6 +596,22 @@ static void update_variables(bool first_startup)
       DEBUG_LOG(COMMON, "Got size: %u x %u.\n", screen_width, screen_height);
    }
 
+#ifdef HAVE_SOFTREND
+   if (first_startup)
+   {
+      var.key = CORE_OPTION_NAME "_renderer";
+
+      if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value && !strcmp(var.value, "software"))
+         settings.pvr.rend = 6;
+   }
+   if (settings.pvr.rend == 6)
+   {
+      // Frames are always rendered at 640x480
+      screen_width = 640;
+      screen_height = 480;
+   }
+#endif
+
 
    var.key = CORE_OPTION_NAME "_cpu_mode";
 
@@ -624,6 +647,13 @@ static void update_variables(bool first_startup)
    else
       GDROM_TICK      = 1500000;
 
+   var.key = CORE_OPTION_NAME "_chd_cache_size";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+      settings.imgread.ChdCacheSize = atoi(var.value);
+   else
+      settings.imgread.ChdCacheSize = 4;
+
    var.key = CORE_OPTION_NAME "_alpha_sorting";
    int previous_renderer = settings.pvr.rend;
 
@@ -957,6 +987,12 @@ static void update_variables(bool first_startup)
    else
 	   settings.pvr.SynchronousRendering = 0;
 
+   var.key = CORE_OPTION_NAME "_render_queue_size";
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+	   settings.pvr.RenderQueueSize = atoi(var.value);
+   else
+	   settings.pvr.RenderQueueSize = 2;
+
    var.key = CORE_OPTION_NAME "_delay_frame_swapping";
    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
    {
@@ -1008,20 +1044,12 @@ static void update_variables(bool first_startup)
    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
    {
       if (!strcmp("enabled", var.value))
-      {
          settings.aica.DSPEnabled = true;
-         settings.aica.NoBatch    = 1;
-      }
       else
-      {
          settings.aica.DSPEnabled = false;
-      }
    }
    else if (first_run)
-   {
       settings.aica.DSPEnabled = true;
-      settings.aica.NoBatch    = 1;
-   }
 
    var.key = CORE_OPTION_NAME "_digital_triggers";
 
@@ -1083,6 +1111,19 @@ static void update_variables(bool first_startup)
    else
 	  settings.rend.DumpTextures = false;
 
+   var.key = CORE_OPTION_NAME "_ta_capture";
+   {
+      u32 capture_frames = 0;
+      if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value && strcmp("disabled", var.value))
+         capture_frames = atoi(var.value);
+      // Only start a new capture when the option is changed
+      if (capture_frames != settings.pvr.TACaptureFrames)
+      {
+         settings.pvr.TACaptureFrames = capture_frames;
+         ta_capture_start(capture_frames);
+      }
+   }
+
    key[0] = '\0' ;
 
    var.key = CORE_OPTION_NAME "_gunx_ratio";
@@ -1276,9 +1317,21 @@ void retro_run (void)
    {
 	   dc_run();
    }
+#ifdef HAVE_SOFTREND
+   if (settings.pvr.rend == 6)
+   {
+      u32 width = screen_width;
+      u32 height = screen_height;
+      const u32 *frame = rend_soft_framebuffer(width, height);
+      video_cb(is_dupe ? NULL : frame, width, height, width * sizeof(u32));
+   }
+   else
+#endif
+   {
 #if defined(HAVE_OPENGL) || defined(HAVE_OPENGLES) || defined(HAVE_VULKAN)
    video_cb(is_dupe ? 0 : RETRO_HW_FRAME_BUFFER_VALID, screen_width, screen_height, 0);
 #endif
+   }
 #if !defined(TARGET_NO_THREADS)
    if (!settings.rend.ThreadedRendering)
 #endif
@@ -1954,6 +2007,27 @@ bool retro_load_game(const struct retro_game_info *game)
 				environ_cb(RETRO_ENVIRONMENT_SET_MESSAGE, &msg);
 			}
          }
+#ifdef NO_REND
+         // Headless benchmark of a TA capture. No game is loaded.
+         else if (!strcmp(".tacap", ext))
+         {
+            ta_replay(game->path, TA_REPLAY_ITERATIONS);
+            return false;
+         }
+         // Headless benchmark of the scheduler. The content file isn't read.
+         else if (!strcmp(".schedbench", ext))
+         {
+            sh4_sched_bench(SCHED_BENCH_CALLBACKS, SCHED_BENCH_TIMESLICES);
+            return false;
+         }
+         // Headless loopback test of the Naomi network with 2, 3 and 4 nodes
+         else if (!strcmp(".nettest", ext))
+         {
+            for (int nodes = 2; nodes <= 4; nodes++)
+               naomi_network_loopback_test(nodes, NAOMI_LOOPBACK_FRAMES);
+            return false;
+         }
+#endif
          // If m3u playlist found load the paths into array
          else if (!strcmp(".m3u", ext) || !strcmp(".M3U", ext))
          {
@@ -2025,6 +2099,12 @@ bool retro_load_game(const struct retro_game_info *game)
       preferred = RETRO_HW_CONTEXT_DUMMY;
    bool foundRenderApi = false;
 
+#ifdef HAVE_SOFTREND
+   if (settings.pvr.rend == 6)
+      // The software renderer doesn't need a hardware context
+      foundRenderApi = true;
+   else
+#endif
    if (preferred == RETRO_HW_CONTEXT_OPENGL || preferred == RETRO_HW_CONTEXT_OPENGL_CORE
     || preferred == RETRO_HW_CONTEXT_OPENGLES2 || preferred == RETRO_HW_CONTEXT_OPENGLES3
     || preferred == RETRO_HW_CONTEXT_OPENGLES_VERSION)
@@ -2254,13 +2334,22 @@ bool retro_unserialize(const void * data, size_t size)
 #ifndef NO_MMU
     mmu_flush_table();
 #endif
-    bm_Reset();
+    // A delta restore only writes the pages dirtied since the state was saved,
+    // and keeps RAM write-protected to track them.
+    bool delta = dc_can_restore_delta(data, size);
+    // Otherwise unlock the whole RAM. Only the blocks in pages that differ are discarded.
+    if (!delta)
+       bm_Reset();
     custom_texture.Terminate();
 
+    bool mmu_was_enabled = mmu_enabled();
     result = dc_unserialize(&data_ptr, &total_size, size) ;
 
     mmu_set_state();
-    sh4_cpu.ResetCache();
+    if (!result || mmu_was_enabled || mmu_enabled())
+       sh4_cpu.ResetCache();
+    else if (!delta)
+       bm_LockProtectedPages();
     dsp.dyndirty = true;
     sh4_sched_ffts();
     CalculateSync();
@@ -2310,7 +2399,11 @@ void retro_get_system_info(struct retro_system_info *info)
 #define GIT_VERSION ""
 #endif
    info->library_version = "0.1" GIT_VERSION;
+#ifdef NO_REND
+   info->valid_extensions = "chd|cdi|elf|cue|gdi|lst|bin|dat|zip|7z|m3u|tacap|schedbench|nettest";
+#else
    info->valid_extensions = "chd|cdi|elf|cue|gdi|lst|bin|dat|zip|7z|m3u";
+#endif
    info->need_fullpath = true;
    info->block_extract = true;
 }
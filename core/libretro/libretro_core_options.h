@@ -160,6 +160,22 @@ struct retro_core_option_v2_definition option_defs_us[] = {
       },
       "512MB",
    },
+#endif
+#ifdef HAVE_SOFTREND
+   {
+      CORE_OPTION_NAME "_renderer",
+      "Renderer (Restart Required)",
+      NULL,
+      "The software renderer runs on the CPU and doesn't need a GPU. It is slower, renders at 640x480 and doesn't support modifier volumes or mipmaps.",
+      NULL,
+      "video",
+      {
+         { "hardware", "Hardware" },
+         { "software", "Software" },
+         { NULL, NULL },
+      },
+      "hardware",
+   },
 #endif
    {
       CORE_OPTION_NAME "_internal_resolution",
@@ -257,6 +273,23 @@ struct retro_core_option_v2_definition option_defs_us[] = {
       "disabled",
 #endif
    },
+   {
+      CORE_OPTION_NAME "_chd_cache_size",
+      "CHD Cache Size (Restart Required)",
+      NULL,
+      "Memory used to keep decompressed CHD data. A larger cache reduces stuttering in games streaming data or music from the disc.",
+      NULL,
+      NULL,
+      {
+         { "1",  "1 MB" },
+         { "2",  "2 MB" },
+         { "4",  "4 MB" },
+         { "8",  "8 MB" },
+         { "16", "16 MB" },
+         { NULL, NULL },
+      },
+      "4",
+   },
    {/* TODO: needs explanation */
       CORE_OPTION_NAME "_mipmapping",
       "Mipmapping",
@@ -638,6 +671,22 @@ struct retro_core_option_v2_definition option_defs_us[] = {
       "enabled",
 #endif
    },
+   {
+      CORE_OPTION_NAME "_render_queue_size",
+      "Render Queue Size",
+      NULL,
+      "Maximum number of frames waiting for the GPU. Higher values let the CPU run ahead of a slow GPU at the cost of latency. When the queue is full, emulation waits for the GPU to finish a frame. Note: This setting only applies when 'Threaded Rendering' is enabled.",
+      NULL,
+      "video",
+      {
+         { "1", NULL },
+         { "2", NULL },
+         { "3", NULL },
+         { "4", NULL },
+         { NULL, NULL },
+      },
+      "2",
+   },
    {
       CORE_OPTION_NAME "_delay_frame_swapping",
       "Delay Frame Swapping",
@@ -742,6 +791,22 @@ struct retro_core_option_v2_definition option_defs_us[] = {
       },
       "disabled",
    },
+   {
+      CORE_OPTION_NAME "_ta_capture",
+      "Capture TA Frames",
+      NULL,
+      "Saves the display lists, PowerVR registers and VRAM of the next frames to the 'tacapture' folder of the system directory. The captures can be replayed to measure the TA parsing and sorting performance by loading them as content in a build made with NO_REND=1.",
+      NULL,
+      "video",
+      {
+         { "disabled", NULL },
+         { "1",  NULL },
+         { "10", NULL },
+         { "60", NULL },
+         { NULL, NULL },
+      },
+      "disabled",
+   },
    {
       CORE_OPTION_NAME "_per_content_vmus",
       "Per-Game Visual Memory Units/Systems (VMU)",
@@ -17,7 +17,12 @@
 
 #include "types.h"
 #include <chrono>
+#include <cinttypes>
+#include <cmath>
 #include <thread>
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
 #ifndef __LIBRETRO__
 // FIXME implement gui_display_notification with libretro widgets
 #include "rend/gui.h"
@@ -61,11 +66,14 @@ bool NaomiNetwork::init()
 		return false;
 	}
 #endif
-	if (settings.network.ActAsServer)
+	if (act_as_server)
    {
 #ifdef ENABLE_MODEM
-        miniupnp.Init();
-		miniupnp.AddPortMapping(SERVER_PORT, true);
+		if (port_mapping)
+		{
+			miniupnp.Init();
+			miniupnp.AddPortMapping(SERVER_PORT, true);
+		}
 #endif // ENABLE_MODEM
 		return createBeaconSocket() && createServerSocket();
    }
@@ -201,6 +209,13 @@ bool NaomiNetwork::findServer()
 
 bool NaomiNetwork::startNetwork()
 {
+	port_mapping = settings.network.ActAsServer;
+	return startNetwork(settings.network.ActAsServer, settings.network.server);
+}
+
+bool NaomiNetwork::startNetwork(bool asServer, const std::string& serverAddress)
+{
+	act_as_server = asServer;
 	network_stopping = false;
 	if (!init())
 		return false;
@@ -210,11 +225,15 @@ bool NaomiNetwork::startNetwork()
 	packet_number = 0;
 	slaves.clear();
 	got_token = false;
+	rx_received = 0;
+	tx_pending.clear();
+	send_time_valid = false;
+	stats = NaomiNetworkStats{};
 
 	using namespace std::chrono;
 	const auto timeout = seconds(10);
 
-	if (settings.network.ActAsServer)
+	if (act_as_server)
 	{
 		NOTICE_LOG(NETWORK, "Waiting for slave connections");
 		steady_clock::time_point start_time = steady_clock::now();
@@ -281,11 +300,11 @@ bool NaomiNetwork::startNetwork()
 	}
 	else
 	{
-		if (!settings.network.server.empty())
+		if (!serverAddress.empty())
 		{
 			struct addrinfo *resultAddr;
-			if (getaddrinfo(settings.network.server.c_str(), 0, nullptr, &resultAddr))
-				WARN_LOG(NETWORK, "Server %s is unknown", settings.network.server.c_str());
+			if (getaddrinfo(serverAddress.c_str(), 0, nullptr, &resultAddr))
+				WARN_LOG(NETWORK, "Server %s is unknown", serverAddress.c_str());
 			else
 				for (struct addrinfo *ptr = resultAddr; ptr != nullptr; ptr = ptr->ai_next)
 					if (ptr->ai_family == AF_INET)
@@ -368,6 +387,57 @@ void NaomiNetwork::pipeSlaves()
 	}
 }
 
+sock_t NaomiNetwork::sendSocket() const
+{
+	if (isMaster())
+		return slaves.empty() ? INVALID_SOCKET : slaves.front();
+	else
+		return client_sock;
+}
+
+// Waits until the socket or one of the slaves to pipe has data to read,
+// or until the rest of a partially sent frame can be written
+void NaomiNetwork::waitForData(sock_t sockfd, int timeoutMs)
+{
+	fd_set read_fds;
+	FD_ZERO(&read_fds);
+	FD_SET(sockfd, &read_fds);
+	int max_fd = (int)sockfd;
+	if (isMaster() && slot_count >= 3)
+	{
+		for (auto it = slaves.begin(); it != slaves.end() - 1; it++)
+			if (*it != INVALID_SOCKET)
+			{
+				FD_SET(*it, &read_fds);
+				max_fd = std::max(max_fd, (int)*it);
+			}
+	}
+	fd_set write_fds;
+	FD_ZERO(&write_fds);
+	sock_t sendfd = tx_pending.empty() ? INVALID_SOCKET : sendSocket();
+	if (sendfd != INVALID_SOCKET)
+	{
+		FD_SET(sendfd, &write_fds);
+		max_fd = std::max(max_fd, (int)sendfd);
+	}
+	timeval tv;
+	tv.tv_sec = 0;
+	tv.tv_usec = timeoutMs * 1000;
+	select(max_fd + 1, &read_fds, sendfd != INVALID_SOCKET ? &write_fds : nullptr, nullptr, &tv);
+}
+
+// Waits until the socket can be written to
+void NaomiNetwork::waitForWrite(sock_t sockfd, int timeoutMs)
+{
+	fd_set write_fds;
+	FD_ZERO(&write_fds);
+	FD_SET(sockfd, &write_fds);
+	timeval tv;
+	tv.tv_sec = 0;
+	tv.tv_usec = timeoutMs * 1000;
+	select((int)sockfd + 1, nullptr, &write_fds, nullptr, &tv);
+}
+
 bool NaomiNetwork::receive(u8 *data, u32 size)
 {
 	sock_t sockfd = INVALID_SOCKET;
@@ -376,50 +446,113 @@ bool NaomiNetwork::receive(u8 *data, u32 size)
 	else
 		sockfd = client_sock;
 	if (sockfd == INVALID_SOCKET)
+	{
+		// Don't spin without a connection
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
 		return false;
+	}
+	if (!tx_pending.empty())
+	{
+		sock_t sendfd = sendSocket();
+		if (sendfd != INVALID_SOCKET)
+			flushSend(sendfd);
+	}
 
-	u16 pktnum;
-	ssize_t l = ::recv(sockfd, (char *)&pktnum, sizeof(pktnum), 0);
-	if (l <= 0)
+	const u32 frame_size = sizeof(u16) + size;
+	if (rx_frame.size() != frame_size)
 	{
-		if (get_last_error() != L_EAGAIN && get_last_error() != L_EWOULDBLOCK)
+		rx_frame.resize(frame_size);
+		rx_received = 0;
+	}
+	// Read what's available, then sleep until more data arrives unless the token must be sent.
+	// send() waits for the socket to be writable if it can't send the token.
+	for (int i = 0; i < 2 && rx_received < frame_size; i++)
+	{
+		if (i == 1)
 		{
-			WARN_LOG(NETWORK, "receiveNetwork: read failed. errno=%d", get_last_error());
+			if (got_token || network_stopping)
+				break;
+			waitForData(sockfd, 5);
+		}
+		ssize_t l = ::recv(sockfd, (char *)&rx_frame[rx_received], frame_size - rx_received, 0);
+		if (l == 0 || (l < 0 && get_last_error() != L_EAGAIN && get_last_error() != L_EWOULDBLOCK))
+		{
+			// Sockets are closed by shutdown()
+			if (network_stopping)
+				return false;
+			if (l == 0)
+				WARN_LOG(NETWORK, "receiveNetwork: connection closed");
+			else
+				WARN_LOG(NETWORK, "receiveNetwork: read failed. errno=%d", get_last_error());
 			if (isMaster())
 			{
 				slaves.back() = -1;
-				closesocket(sockfd);
 				got_token = false;
 			}
+			else
+				client_sock = INVALID_SOCKET;
+			closesocket(sockfd);
+			rx_received = 0;
+			return false;
 		}
+		if (l > 0)
+			rx_received += l;
+	}
+	if (rx_received < frame_size)
 		return false;
+
+	rx_received = 0;
+	memcpy(&packet_number, &rx_frame[0], sizeof(u16));
+	memcpy(data, &rx_frame[sizeof(u16)], size);
+	DEBUG_LOG(NETWORK, "[%d] Received %d bytes", slot_id, size);
+	got_token = true;
+	updateStats();
+
+	return true;
+}
+
+void NaomiNetwork::updateStats()
+{
+	stats.framesReceived++;
+	if (send_time_valid)
+	{
+		send_time_valid = false;
+
+		double round_trip = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - send_time).count();
+		stats.roundTripSamples++;
+		stats.avgRoundTrip += (round_trip - stats.avgRoundTrip) / stats.roundTripSamples;
+		stats.maxRoundTrip = std::max(stats.maxRoundTrip, round_trip);
+		if (last_round_trip != 0)
+			stats.jitter += (std::abs(round_trip - last_round_trip) - stats.jitter) / 16;
+		last_round_trip = round_trip;
 	}
-	packet_number = pktnum;
 
-	ssize_t received = 0;
-	while (received != size && !network_stopping)
+	if (stats.framesReceived % 3600 == 0)
+		NOTICE_LOG(NETWORK, "[%d] %" PRIu64 " frames: round trip avg %.2f ms, max %.2f ms, jitter %.2f ms, %" PRIu64 " partial sends",
+				slot_id, stats.framesReceived, stats.avgRoundTrip, stats.maxRoundTrip, stats.jitter, stats.partialSends);
+}
+
+// Sends the rest of the last frame. Returns true once it's completely sent.
+bool NaomiNetwork::flushSend(sock_t sockfd)
+{
+	ssize_t l = ::send(sockfd, (const char *)&tx_pending[0], tx_pending.size(), 0);
+	if (l < 0)
 	{
-		l = ::recv(sockfd, (char*)(data + received), size - received, 0);
-		if (l <= 0)
+		if (get_last_error() != L_EAGAIN && get_last_error() != L_EWOULDBLOCK)
 		{
-			if (get_last_error() != L_EAGAIN && get_last_error() != L_EWOULDBLOCK)
+			WARN_LOG(NETWORK, "send failed. errno=%d", get_last_error());
+			tx_pending.clear();
+			if (isMaster())
 			{
-				WARN_LOG(NETWORK, "receiveNetwork: read failed. errno=%d", get_last_error());
-				if (isMaster())
-				{
-					slaves.back() = -1;
-					closesocket(sockfd);
-					got_token = false;
-				}
-				return false;
+				slaves.front() = -1;
+				closesocket(sockfd);
 			}
 		}
-		else
-			received += l;
+		return false;
 	}
-	DEBUG_LOG(NETWORK, "[%d] Received %d bytes", slot_id, size);
-	got_token = true;
-	return true;
+	tx_pending.erase(tx_pending.begin(), tx_pending.begin() + l);
+
+	return tx_pending.empty();
 }
 
 void NaomiNetwork::send(u8 *data, u32 size)
@@ -427,18 +560,46 @@ void NaomiNetwork::send(u8 *data, u32 size)
 	if (!got_token)
 		return;
 
-	sock_t sockfd;
-	if (isMaster())
-		sockfd = slaves.empty() ? INVALID_SOCKET : slaves.front();
-	else
-		sockfd = client_sock;
+	sock_t sockfd = sendSocket();
 	if (sockfd == INVALID_SOCKET)
+	{
+		// Don't spin holding a token that can't be passed on
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		return;
+	}
+	if (!tx_pending.empty() && !flushSend(sockfd))
+	{
+		// Keep the token until the previous frame is out, without spinning
+		if (!tx_pending.empty())
+			waitForWrite(sockfd, 5);
 		return;
+	}
 
+	// Packet number and payload are sent with a single system call
 	u16 pktnum = packet_number + 1;
-	if (::send(sockfd, (const char *)&pktnum, sizeof(pktnum), 0) < 2)
+	ssize_t l;
+#ifdef _WIN32
+	WSABUF bufs[2];
+	bufs[0].buf = (char *)&pktnum;
+	bufs[0].len = sizeof(pktnum);
+	bufs[1].buf = (char *)data;
+	bufs[1].len = size;
+	DWORD sent;
+	if (WSASend(sockfd, bufs, 2, &sent, 0, nullptr, nullptr) == 0)
+		l = sent;
+	else
+		l = -1;
+#else
+	iovec iov[2];
+	iov[0].iov_base = &pktnum;
+	iov[0].iov_len = sizeof(pktnum);
+	iov[1].iov_base = data;
+	iov[1].iov_len = size;
+	l = writev(sockfd, iov, 2);
+#endif
+	if (l < 0)
 	{
-		if (errno != L_EAGAIN && errno != L_EWOULDBLOCK)
+		if (get_last_error() != L_EAGAIN && get_last_error() != L_EWOULDBLOCK)
 		{
 			WARN_LOG(NETWORK, "send failed. errno=%d", get_last_error());
 			if (isMaster())
@@ -447,23 +608,26 @@ void NaomiNetwork::send(u8 *data, u32 size)
 				closesocket(sockfd);
 			}
 		}
+		else
+			// Socket buffer full: keep the token and try again once it's writable
+			waitForWrite(sockfd, 5);
 		return;
 	}
-	if (::send(sockfd, (const char *)data, size, 0) < size)
+	if (l < (ssize_t)(sizeof(pktnum) + size))
 	{
-		WARN_LOG(NETWORK, "send failed. errno=%d", get_last_error());
-		if (isMaster())
-		{
-			slaves.front() = -1;
-			closesocket(sockfd);
-		}
-	}
-	else
-	{
-		DEBUG_LOG(NETWORK, "[%d] Sent %d bytes", slot_id, size);
-		got_token = false;
-		packet_number = pktnum;
+		// Keep the rest for later. The next frame can't be received before this one is complete.
+		const u8 *header = (const u8 *)&pktnum;
+		for (; l < (ssize_t)sizeof(pktnum); l++)
+			tx_pending.push_back(header[l]);
+		tx_pending.insert(tx_pending.end(), data + l - sizeof(pktnum), data + size);
+		stats.partialSends++;
 	}
+	DEBUG_LOG(NETWORK, "[%d] Sent %d bytes", slot_id, size);
+	got_token = false;
+	packet_number = pktnum;
+	stats.framesSent++;
+	send_time = std::chrono::steady_clock::now();
+	send_time_valid = true;
 }
 
 void NaomiNetwork::shutdown()
@@ -485,7 +649,7 @@ void NaomiNetwork::terminate()
 {
 	shutdown();
 #ifdef ENABLE_MODEM
-   if (settings.network.ActAsServer)
+   if (port_mapping)
 		miniupnp.Term();
 #endif // ENABLE_MODEM
 	if (beacon_sock != INVALID_SOCKET)
@@ -499,3 +663,105 @@ void NaomiNetwork::terminate()
 		server_sock = INVALID_SOCKET;
 	}
 }
+
+#ifdef NO_REND
+struct LoopbackNode
+{
+	NaomiNetwork network;
+	std::thread thread;
+	bool connected = false;
+	u64 payloadErrors = 0;
+};
+
+static const u32 LOOPBACK_SLOT_SIZE = 256;
+
+static void loopbackPayload(u8 *data, u32 size, u16 packetNumber)
+{
+	for (u32 i = 0; i < size; i++)
+		data[i] = (u8)(packetNumber * 7 + i);
+}
+
+bool naomi_network_loopback_test(int nodes, u32 frames)
+{
+	if (nodes < 2 || nodes > 4)
+	{
+		ERROR_LOG(NETWORK, "Loopback test: 2 to 4 nodes are supported");
+		return false;
+	}
+	LoopbackNode node[4];
+	std::atomic<int> ready{ 0 };
+	std::atomic<bool> done{ false };
+	std::atomic<u64> masterFrames{ 0 };
+
+	NOTICE_LOG(NETWORK, "Loopback test: %d nodes, %d frames", nodes, frames);
+	for (int i = 0; i < nodes; i++)
+	{
+		node[i].thread = std::thread([&, i]() {
+			LoopbackNode& self = node[i];
+			self.connected = self.network.startNetwork(i == 0, "127.0.0.1");
+			ready++;
+			while (ready < nodes)
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			for (int j = 0; j < nodes; j++)
+				if (!node[j].connected)
+					return;
+
+			const u32 size = LOOPBACK_SLOT_SIZE * self.network.slotCount();
+			std::vector<u8> buf(size);
+			std::vector<u8> reference(size);
+			while (!done)
+			{
+				self.network.pipeSlaves();
+				if (self.network.receive(&buf[0], size))
+				{
+					loopbackPayload(&reference[0], size, self.network.packetNumber());
+					if (buf != reference)
+						self.payloadErrors++;
+					if (i == 0 && ++masterFrames >= frames)
+						done = true;
+				}
+				if (self.network.hasToken())
+				{
+					loopbackPayload(&buf[0], size, self.network.packetNumber() + 1);
+					self.network.send(&buf[0], size);
+				}
+			}
+		});
+		if (i == 0)
+			// Let the master listen before the slaves connect
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	}
+
+	// Bounded run time in case the token is lost
+	const auto timeout = std::chrono::seconds(60);
+	auto start_time = std::chrono::steady_clock::now();
+	while (!done && std::chrono::steady_clock::now() - start_time < timeout)
+	{
+		bool all_ready = ready == nodes;
+		bool all_connected = true;
+		for (int i = 0; i < nodes; i++)
+			all_connected = all_connected && node[i].connected;
+		if (all_ready && !all_connected)
+			break;
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	done = true;
+	for (int i = 0; i < nodes; i++)
+		node[i].thread.join();
+
+	bool success = masterFrames >= frames;
+	for (int i = 0; i < nodes; i++)
+	{
+		const NaomiNetworkStats& stats = node[i].network.getStats();
+		NOTICE_LOG(NETWORK, "  node %d: %s, %" PRIu64 " frames sent, %" PRIu64 " received, %" PRIu64 " bad payloads, %" PRIu64 " partial sends",
+				i, node[i].connected ? "connected" : "not connected", stats.framesSent, stats.framesReceived,
+				node[i].payloadErrors, stats.partialSends);
+		NOTICE_LOG(NETWORK, "          round trip avg %.3f ms, max %.3f ms, jitter %.3f ms",
+				stats.avgRoundTrip, stats.maxRoundTrip, stats.jitter);
+		success = success && node[i].connected && node[i].payloadErrors == 0;
+	}
+	NOTICE_LOG(NETWORK, "Loopback test with %d nodes %s", nodes, success ? "passed" : "FAILED");
+
+	return success;
+}
+#endif
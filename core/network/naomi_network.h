@@ -17,11 +17,26 @@
 #include "types.h"
 #include <cstdint>
 #include <atomic>
+#include <chrono>
 #include <mutex>
 #include <vector>
 #include "net_platform.h"
 #include "miniupnp.h"
 
+struct NaomiNetworkStats
+{
+	u64 framesSent;
+	u64 framesReceived;
+	u64 partialSends;
+	// Received frames that had a round trip measurement
+	u64 roundTripSamples;
+	// Time between sending the token and getting it back, in ms
+	double avgRoundTrip;
+	double maxRoundTrip;
+	// Smoothed round trip variation (RFC 3550), in ms
+	double jitter;
+};
+
 class NaomiNetwork
 {
 public:
@@ -35,6 +50,8 @@ public:
 	~NaomiNetwork() { terminate(); }
 	bool init();
 	bool startNetwork();
+	// Connects to the given server, or waits for slaves. No UPnP port mapping.
+	bool startNetwork(bool asServer, const std::string& serverAddress);
 	void pipeSlaves();
 	bool receive(u8 *data, u32 size);
 	void send(u8 *data, u32 size);
@@ -44,6 +61,7 @@ public:
 	int slotId() const { return slot_id; }
 	u16 packetNumber() const { return packet_number; }
 	bool hasToken() const { return got_token; }
+	const NaomiNetworkStats& getStats() const { return stats; }
 
 private:
 	bool createServerSocket();
@@ -52,6 +70,11 @@ private:
 	bool findServer();
 	sock_t createAndBind(int protocol);
 	bool isMaster() const { return slot_id == 0; }
+	bool flushSend(sock_t sockfd);
+	sock_t sendSocket() const;
+	void waitForData(sock_t sockfd, int timeoutMs);
+	void waitForWrite(sock_t sockfd, int timeoutMs);
+	void updateStats();
 
 	struct in_addr server_ip;
 	std::string server_name;
@@ -62,13 +85,32 @@ private:
 	// client stuff
 	sock_t client_sock = INVALID_SOCKET;
 	// common stuff
+	bool act_as_server = false;
+	bool port_mapping = false;
 	int slot_count = 0;
 	int slot_id = 0;
 	bool got_token = false;
 	u16 packet_number = 0;
 	std::atomic<bool> network_stopping{ false };
+	// Frame being received: packet number followed by the payload
+	std::vector<u8> rx_frame;
+	u32 rx_received = 0;
+	// End of the last frame that couldn't be sent at once
+	std::vector<u8> tx_pending;
+	std::chrono::steady_clock::time_point send_time;
+	bool send_time_valid = false;
+	double last_round_trip = 0;
+	NaomiNetworkStats stats{};
 	std::mutex mutex;
    MiniUPnP miniupnp;
 
 	static const uint16_t SERVER_PORT = 37391;
 };
+
+#ifdef NO_REND
+#define NAOMI_LOOPBACK_FRAMES 10000
+
+// Passes the token between nodes connected through the loopback interface, in this process,
+// checks the payloads and logs the round trip statistics of each node
+bool naomi_network_loopback_test(int nodes, u32 frames);
+#endif
@@ -22,6 +22,7 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <sys/select.h>
+#include <poll.h>
 #else
 #include <ws2tcpip.h>
 #endif
@@ -85,6 +86,51 @@ static inline bool set_recv_timeout(sock_t fd, int delayms)
 #endif
 }
 
+#if defined(_WIN32) && _WIN32_WINNT >= 0x0600
+#define poll WSAPoll
+#elif defined(_WIN32)
+// No WSAPoll before Vista. Winsock fd_sets are arrays of up to FD_SETSIZE sockets,
+// so unlike on other platforms the socket values don't matter.
+struct pollfd
+{
+	SOCKET fd;
+	short events;
+	short revents;
+};
+#define POLLIN 0x0001
+#define POLLOUT 0x0004
+
+static inline int poll(pollfd *fds, unsigned nfds, int timeout)
+{
+	fd_set read_fds;
+	fd_set write_fds;
+	FD_ZERO(&read_fds);
+	FD_ZERO(&write_fds);
+	for (unsigned i = 0; i < nfds && i < FD_SETSIZE; i++)
+	{
+		if (fds[i].events & POLLIN)
+			FD_SET(fds[i].fd, &read_fds);
+		if (fds[i].events & POLLOUT)
+			FD_SET(fds[i].fd, &write_fds);
+	}
+	timeval tv;
+	tv.tv_sec = timeout / 1000;
+	tv.tv_usec = (timeout % 1000) * 1000;
+	int r = select(0, &read_fds, &write_fds, NULL, &tv);
+	if (r <= 0)
+		return r;
+	r = 0;
+	for (unsigned i = 0; i < nfds; i++)
+	{
+		fds[i].revents = (FD_ISSET(fds[i].fd, &read_fds) ? POLLIN : 0)
+				| (FD_ISSET(fds[i].fd, &write_fds) ? POLLOUT : 0);
+		if (fds[i].revents != 0)
+			r++;
+	}
+	return r;
+}
+#endif
+
 #if defined(_WIN32) && _WIN32_WINNT < 0x0600
 static inline const char *inet_ntop(int af, const void* src, char* dst, int cnt)
 {
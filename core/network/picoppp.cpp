@@ -48,6 +48,7 @@ extern "C" {
 #include "network/miniupnp.h"
 #include "reios/reios.h"
 
+#include <atomic>
 #include <map>
 #include <mutex>
 #include <queue>
@@ -232,6 +233,15 @@ static std::map<uint16_t, sock_t> tcp_listening_sockets;
 
 static bool pico_stack_inited;
 static bool pico_thread_running = false;
+
+// Maximum time the pico thread sleeps without any event
+#define PICO_MAX_WAIT_MS 100
+
+// Written to by the emulator thread to wake up the pico thread
+#ifndef _WIN32
+static int wakeup_pipe[2] = { -1, -1 };
+#endif
+static std::atomic<bool> wakeup_pending;
 extern "C"
 {
    int dont_reject_opt_vj_hack;
@@ -284,11 +294,27 @@ static int modem_write(pico_device *dev, const void *data, int len)
     return len;
 }
 
+static void wakeup_pico_thread()
+{
+	// Only one wake up is needed until the pico thread handles it
+	if (wakeup_pending.exchange(true))
+		return;
+#ifndef _WIN32
+	if (wakeup_pipe[1] != -1)
+	{
+		char c = 0;
+		if (write(wakeup_pipe[1], &c, 1) < 0 && errno != EAGAIN)
+			perror("write wakeup pipe");
+	}
+#endif
+}
+
 void write_pico(u8 b)
 {
 	out_buffer_lock.lock();
 	out_buffer.push(b);
 	out_buffer_lock.unlock();
+	wakeup_pico_thread();
 }
 
 int read_pico()
@@ -658,6 +684,95 @@ static void read_native_sockets()
 	}
 }
 
+// Returns how long the pico thread can sleep before it has work to do
+static int get_wait_timeout()
+{
+	int timeout = pico_stack_next_timeout();
+	if (timeout < 0 || timeout > PICO_MAX_WAIT_MS)
+		timeout = PICO_MAX_WAIT_MS;
+#ifdef _WIN32
+	// No wake up on emulator writes
+	timeout = std::min(timeout, 5);
+#endif
+	// DNS answers are polled
+	if (afo_ip.addr == 0)
+		timeout = std::min(timeout, 10);
+
+	out_buffer_lock.lock();
+	if (!out_buffer.empty())
+		timeout = 0;
+	out_buffer_lock.unlock();
+
+	// Data waiting for room in the pico socket send queue
+	for (const auto& it : tcp_sockets)
+		if (!it.second.in_buffer.empty() || (it.second.native_sock == INVALID_SOCKET && !it.second.shutdown))
+		{
+			timeout = std::min(timeout, 1);
+			break;
+		}
+
+	return timeout;
+}
+
+// Sleeps until a native socket or the emulator needs attention, or the timeout expires.
+// Returns true if woken up by an event.
+static bool wait_for_events(int timeout)
+{
+	// poll() has no limit on the fd values, unlike select() and FD_SETSIZE
+	static std::vector<pollfd> fds;
+	fds.clear();
+	auto add_fd = [](sock_t fd, short events) {
+		pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = events;
+		pfd.revents = 0;
+		fds.push_back(pfd);
+	};
+
+#ifndef _WIN32
+	if (wakeup_pipe[0] != -1)
+		add_fd(wakeup_pipe[0], POLLIN);
+#endif
+	for (const auto& it : tcp_listening_sockets)
+		add_fd(it.second, POLLIN);
+	for (const auto& it : tcp_connecting_sockets)
+		add_fd(it.second, POLLOUT);
+	for (const auto& it : udp_sockets)
+		if (VALID(it.second))
+			add_fd(it.second, POLLIN);
+	for (const auto& it : tcp_sockets)
+		if (VALID(it.second.native_sock))
+			add_fd(it.second.native_sock, POLLIN);
+
+	if (fds.empty())
+	{
+		// WSAPoll() fails without any socket
+		if (timeout > 0)
+		{
+#ifdef __LIBRETRO__
+			retro_sleep(timeout);
+#else
+			usleep(timeout * 1000);
+#endif
+		}
+		return false;
+	}
+
+	int r = poll(&fds[0], fds.size(), timeout);
+	if (r < 0 && get_last_error() != EINTR)
+		perror("poll");
+#ifndef _WIN32
+	if (r > 0 && wakeup_pipe[0] != -1 && fds[0].revents != 0)
+	{
+		char buf[64];
+		while (read(wakeup_pipe[0], buf, sizeof(buf)) > 0)
+			;
+		wakeup_pending = false;
+	}
+#endif
+	return r > 0;
+}
+
 static void close_native_sockets()
 {
 	for (auto it = udp_sockets.begin(); it != udp_sockets.end(); it++)
@@ -791,6 +906,7 @@ void pico_receive_eth_frame(const u8 *frame, u32 size)
 {
 	dumpFrame(frame, size);
 	pico_stack_recv(pico_dev, (u8 *)frame, size);
+	wakeup_pico_thread();
 }
 
 static int send_eth_frame(pico_device *dev, void *data, int len)
@@ -852,6 +968,7 @@ static void *pico_thread_func(void *)
 	}
 
 	// Empty queues
+	wakeup_pending = false;
     {
 		std::queue<u8> empty;
 		in_buffer_lock.lock();
@@ -998,16 +1115,17 @@ static void *pico_thread_func(void *)
 		}
 	}
 
+	bool active = false;
 	while (pico_thread_running)
     {
     	read_native_sockets();
     	pico_stack_tick();
     	check_dns_entries();
-#ifdef __LIBRETRO__
-      retro_sleep(5);
-#else
-    	usleep(5000);
-#endif
+    	int timeout = get_wait_timeout();
+    	// Frames may still be queued in the stack after an event
+    	if (active)
+    		timeout = std::min(timeout, 1);
+    	active = wait_for_events(timeout);
     }
 
     for (auto it = tcp_listening_sockets.begin(); it != tcp_listening_sockets.end(); it++)
@@ -1043,6 +1161,21 @@ bool start_pico()
 {
 	if (pico_thread_running)
 		return false;
+#ifndef _WIN32
+	if (wakeup_pipe[0] == -1)
+	{
+		if (pipe(wakeup_pipe) < 0)
+		{
+			perror("pipe");
+			wakeup_pipe[0] = wakeup_pipe[1] = -1;
+		}
+		else
+		{
+			fcntl(wakeup_pipe[0], F_SETFL, O_NONBLOCK);
+			fcntl(wakeup_pipe[1], F_SETFL, O_NONBLOCK);
+		}
+	}
+#endif
 	pico_thread_running = true;
 	pico_thread.Start();
 
@@ -1052,6 +1185,8 @@ bool start_pico()
 void stop_pico()
 {
 	pico_thread_running = false;
+	wakeup_pending = false;
+	wakeup_pico_thread();
 	pico_thread.WaitToEnd();
 }
 
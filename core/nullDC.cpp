@@ -489,6 +489,7 @@ void dc_term()
 	plugins_Term();
 	mem_Term();
 	_vmem_release();
+	wb_term();
 }
 
 void dc_stop()
@@ -532,6 +533,7 @@ void LoadSettings(void)
 	settings.pvr.Emulation.zMax         = 1.0f;
 
 	settings.pvr.MaxThreads			       = 3;
+	settings.pvr.RenderQueueSize		   = 2;
 #ifndef __LIBRETRO__
 	settings.pvr.Emulation.ModVol       = true;
 	settings.rend.RenderToTextureBuffer  = false;
@@ -2481,6 +2481,8 @@ void ngen_GetFeatures(ngen_features* dst)
 {
 	dst->InterpreterFallback = false;
 	dst->OnlyDynamicEnds     = false;
+	dst->TieredCompile       = false;
+	dst->CodeEviction        = false;
 }
 
 RuntimeBlockInfo* ngen_AllocateBlock()
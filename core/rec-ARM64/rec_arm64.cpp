@@ -107,6 +107,8 @@ void ngen_GetFeatures(ngen_features* dst)
 {
 	dst->InterpreterFallback = false;
 	dst->OnlyDynamicEnds     = false;
+	dst->TieredCompile       = true;
+	dst->CodeEviction        = true;
 }
 
 template<typename T>
@@ -311,6 +313,22 @@ public:
 		this->block = block;
 		CheckBlock(force_checks, block);
 
+		if (staging)
+		{
+			// Recompile the block as a superblock once it's hot
+			Label not_hot;
+			Mov(x9, reinterpret_cast<uintptr_t>(&block->staging_runs));
+			Ldr(w10, MemOperand(x9));
+			Subs(w10, w10, 1);
+			Str(w10, MemOperand(x9));
+			B(&not_hot, ne);
+			Mov(w0, block->vaddr);
+			GenCallRuntime(rdv_PromoteBlock);
+			Mov(w29, block->vaddr);
+			GenBranch(*arm64_no_update);
+			Bind(&not_hot);
+		}
+
 		// run register allocator
 		regalloc.DoAlloc(block);
 
@@ -1428,6 +1446,7 @@ public:
 			Str(w0, MemOperand(x1));
 		}
 		Mov(x29, lr);				// Trashing pc here but it will be reset at the end of the block or in DoInterrupts
+		GenCallRuntime(rdv_SampleCode);
 		GenCallRuntime(UpdateSystem);
 		Mov(lr, x29);
 		Cbnz(w0, &do_interrupts);
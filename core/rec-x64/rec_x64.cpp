@@ -128,6 +128,7 @@ WIN32_ONLY(     ".seh_pushreg %r14                              \n\t")
 
                         "addl $" _S(SH4_TIMESLICE) ", %ecx              \n\t"
                         "movl %ecx, " _U "cycle_counter(%rip)   \n\t"
+                        "call " _U "rdv_SampleCode              \n\t"
                         "call " _U "UpdateSystem_INTC           \n\t"
                         "jmp 1b                                                         \n"             // run_loop
 
@@ -172,6 +173,8 @@ void ngen_GetFeatures(ngen_features* dst)
 {
 	dst->InterpreterFallback = false;
 	dst->OnlyDynamicEnds = false;
+	dst->TieredCompile = true;
+	dst->CodeEviction = true;
 }
 
 RuntimeBlockInfo* ngen_AllocateBlock(void)
@@ -183,6 +186,10 @@ void ngen_blockcheckfail(u32 pc) {
 	//printf("X64 JIT: SMC invalidation at %08X\n", pc);
 	rdv_BlockCheckFail(pc);
 }
+
+static void ngen_promoteblock(u32 pc) {
+	rdv_PromoteBlock(pc);
+}
 static void handle_mem_exception(u32 exception_raised, u32 pc)
 {
 	if (exception_raised)
@@ -298,6 +305,14 @@ public:
       if (force_checks) {
 			CheckBlock(block);
 		}
+		if (staging)
+		{
+			// Recompile the block as a superblock once it's hot
+			mov(rax, (uintptr_t)&block->staging_runs);
+			mov(call_regs[0], block->vaddr);
+			sub(dword[rax], 1);
+			jz(reinterpret_cast<const void*>(&ngen_promoteblock));
+		}
 
 #ifdef _WIN32
 		sub(rsp, 0x28);		// 32-byte shadow space + 8 byte alignment
@@ -22,6 +22,8 @@ void ngen_GetFeatures(ngen_features* dst)
 {
 	dst->InterpreterFallback = false;
 	dst->OnlyDynamicEnds     = false;
+	dst->TieredCompile       = false;
+	dst->CodeEviction        = false;
 }
 
 RuntimeBlockInfo* ngen_AllocateBlock(void)
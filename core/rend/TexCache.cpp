@@ -12,12 +12,9 @@
 #include <mutex>
 #include <deps/xxhash/xxhash.h>
 
-#if defined(HAVE_TEXUPSCALE) && !defined(TARGET_NO_OPENMP)
-#include <omp.h>
-#endif
-
-u8* vq_codebook;
-u32 palette_index;
+// Per thread since textures are decoded in parallel
+thread_local u8* vq_codebook;
+thread_local u32 palette_index;
 bool KillTex=false;
 u32 palette16_ram[1024];
 u32 palette32_ram[1024];
@@ -175,6 +172,11 @@ void vramlock_list_add(vram_block* block)
  
 cMutex vramlist_lock;
 
+// Dirty page tracking for delta savestates: epoch of the last write to each VRAM page
+static bool vram_dirty_tracking;
+static u32 vram_dirty_epoch = 1;
+static u32 vram_page_epoch[VRAM_SIZE_MAX / PAGE_SIZE];
+
 void libCore_vramlock_Lock(u32 start_offset64, u32 end_offset64, BaseTextureCacheData *texture)
 {
 	vram_block* block=(vram_block* )malloc(sizeof(vram_block));
@@ -239,6 +241,8 @@ bool VramLockedWriteOffset(size_t offset)
 			}
 		}
 		list.clear();
+		if (vram_dirty_tracking)
+			vram_page_epoch[addr_hash] = vram_dirty_epoch;
 
 		_vmem_unprotect_vram((u32)(offset & ~PAGE_MASK), PAGE_SIZE);
 	}
@@ -246,6 +250,39 @@ bool VramLockedWriteOffset(size_t offset)
 	return true;
 }
 
+// Write-protects the whole VRAM so that all the pages written from now on are recorded
+void VramDirtyTrackingStart()
+{
+	std::lock_guard<cMutex> lock(vramlist_lock);
+	_vmem_protect_vram(0, VRAM_SIZE);
+	vram_dirty_epoch++;
+	vram_dirty_tracking = true;
+}
+
+// The pages still protected only for tracking are unprotected on their next write
+void VramDirtyTrackingStop()
+{
+	std::lock_guard<cMutex> lock(vramlist_lock);
+	vram_dirty_tracking = false;
+}
+
+// Ends the current epoch: the pages written during it are protected again
+u32 VramDirtyTrackingRearm()
+{
+	std::lock_guard<cMutex> lock(vramlist_lock);
+	if (vram_dirty_tracking)
+		for (u32 page = 0; page < VRAM_SIZE / PAGE_SIZE; page++)
+			if (vram_page_epoch[page] == vram_dirty_epoch)
+				_vmem_protect_vram(page * PAGE_SIZE, PAGE_SIZE);
+	return ++vram_dirty_epoch;
+}
+
+// True if the VRAM page at offset has been written during or after the given epoch
+bool VramPageDirty(u32 offset, u32 epoch)
+{
+	return vram_page_epoch[(offset & VRAM_MASK) / PAGE_SIZE] >= epoch;
+}
+
 bool VramLockedWrite(u8* address)
 {
 	u32 offset = _vmem_get_vram_offset(address);
@@ -271,48 +308,16 @@ void libCore_vramlock_Unlock_block(vram_block* block)
 }
 
 #ifdef HAVE_TEXUPSCALE
-#ifndef TARGET_NO_OPENMP
-static inline int getThreadCount()
-{
-	int tcount = omp_get_num_procs() - 1;
-	if (tcount < 1)
-		tcount = 1;
-	return std::min(tcount, (int)settings.pvr.MaxThreads);
-}
-
-template<typename Func>
-void parallelize(Func func, int start, int end)
-{
-	int tcount = getThreadCount();
-#pragma omp parallel num_threads(tcount)
-	{
-		int num_threads = omp_get_num_threads();
-		int thread = omp_get_thread_num();
-		int chunk = (end - start) / num_threads;
-		func(start + chunk * thread,
-				num_threads == thread + 1 ? end
-						: (start + chunk * (thread + 1)));
-	}
-}
-
-#endif
-
 static struct xbrz::ScalerCfg xbrz_cfg;
 
 void UpscalexBRZ(int factor, u32* source, u32* dest, int width, int height, bool has_alpha)
 {
-#ifndef TARGET_NO_OPENMP
-	parallelize([=](int start, int end) {
+	// Runs serially when called from a texture decoding task since the pool is busy
+	const int slices = std::min(worker_pool.ThreadCount(), height);
+	worker_pool.Run(slices, [=](int slice) {
 		xbrz::scale(factor, source, dest, width, height, has_alpha ? xbrz::ColorFormat::ARGB : xbrz::ColorFormat::RGB,
-				xbrz_cfg, start, end);
-	}, 0, height);
-#else
-	xbrz::scale(factor, source, dest, width, height, has_alpha ? xbrz::ColorFormat::ARGB : xbrz::ColorFormat::RGB, xbrz_cfg);
-#endif
-}
-
-void shutdown_thread_pool()
-{
+				xbrz_cfg, height * slice / slices, height * (slice + 1) / slices);
+	});
 }
 #endif
 
@@ -333,7 +338,7 @@ struct PvrTexInfo
 	TexConvFP8 *TW8;
 };
 
-static const PvrTexInfo format[8] =
+static PvrTexInfo format[8] =
 {	// name     bpp Final format			   Planar		Twiddled	 VQ				Planar(32b)    Twiddled(32b)  VQ (32b)      Palette (8b)
 	{"1555", 	16,	TextureType::_5551,        tex1555_PL,  tex1555_TW,  tex1555_VQ,    tex1555_PL32,  tex1555_TW32,  tex1555_VQ32, nullptr },	    //1555
 	{"565", 	16, TextureType::_565,         tex565_PL,   tex565_TW,   tex565_VQ,     tex565_PL32,   tex565_TW32,   tex565_VQ32,  nullptr },	    //565
@@ -345,6 +350,24 @@ static const PvrTexInfo format[8] =
 	{"ns/1555", 0},	                                                                                                                                // Not supported (1555)
 };
 
+static void SetSIMDTexConv()
+{
+	for (u32 i = 0; i < sizeof(format) / sizeof(format[0]); i++)
+	{
+		SIMDTexConv conv = GetSIMDTexConv(i);
+		if (conv.TW != nullptr)
+			format[i].TW = conv.TW;
+		if (conv.VQ != nullptr)
+			format[i].VQ = conv.VQ;
+		if (conv.TW32 != nullptr)
+			format[i].TW32 = conv.TW32;
+		if (conv.VQ32 != nullptr)
+			format[i].VQ32 = conv.VQ32;
+	}
+}
+
+static OnLoad simd_texconv(&SetSIMDTexConv);
+
 static const u32 VQMipPoint[11] =
 {
 	0x00000,//1
@@ -440,6 +463,8 @@ void BaseTextureCacheData::Create()
 	lock_block = nullptr;
 	custom_image_data = nullptr;
 	custom_load_in_progress = 0;
+	update_pending = false;
+	temp_tex_buffer = nullptr;
 
 	//decode info from tsp/tcw into the texture struct
 	tex = &format[tcw.PixelFmt == PixelReserved ? Pixel1555 : tcw.PixelFmt];	//texture format table entry
@@ -525,6 +550,19 @@ void BaseTextureCacheData::ComputeHash()
 }
 
 void BaseTextureCacheData::Update()
+{
+	if (PrepareUpdate())
+	{
+		double start_time = render_stage_timing ? os_GetSeconds() : 0;
+		Decode();
+		Upload();
+		render_stage_stats.texture_updates++;
+		if (render_stage_timing)
+			render_stage_stats.texture_time += os_GetSeconds() - start_time;
+	}
+}
+
+bool BaseTextureCacheData::PrepareUpdate()
 {
 	//texture state tracking stuff
 	Updates++;
@@ -532,7 +570,7 @@ void BaseTextureCacheData::Update()
 
 	tex_type = tex->type;
 
-	bool has_alpha = false;
+	has_alpha = false;
 	if (IsPaletted())
 	{
 		if (IsGpuHandledPaletted(tsp, tcw))
@@ -551,16 +589,13 @@ void BaseTextureCacheData::Update()
 			palette_hash = pal_hash_256[tcw.PalSelect >> 4];
 	}
 
-	::palette_index = this->palette_index; // might be used if pal. tex
-	::vq_codebook = &vram[vq_codebook];    // might be used if VQ tex
-
 	//texture conversion work
-	u32 stride = w;
+	stride = w;
 
 	if (tcw.StrideSel && tcw.ScanOrder && (tex->PL || tex->PL32))
 		stride = (TEXT_CONTROL & 31) * 32;
 
-	u32 original_h = h;
+	original_h = h;
 	if (sa_tex > VRAM_SIZE || size == 0 || sa + size > VRAM_SIZE)
 	{
 		if (sa < VRAM_SIZE && sa + size > VRAM_SIZE && tcw.ScanOrder && stride > 0)
@@ -573,45 +608,49 @@ void BaseTextureCacheData::Update()
 		else
 		{
 			WARN_LOG(RENDERER, "Warning: invalid texture. Address %08X %08X size %d", sa_tex, sa, size);
-			return;
+			return false;
 		}
 	}
 	if (settings.rend.CustomTextures)
 		custom_texture.LoadCustomTextureAsync(this);
 
-	void *temp_tex_buffer = NULL;
-	u32 upscaled_w = w;
-	u32 upscaled_h = h;
-
-	PixelBuffer<u16> pb16;
-	PixelBuffer<u32> pb32;
-	PixelBuffer<u8> pb8;
+	upscaled_w = w;
+	upscaled_h = h;
 
 	// Figure out if we really need to use a 32-bit pixel buffer
-	bool textureUpscaling = settings.rend.TextureUpscale > 1
+	upscaling = settings.rend.TextureUpscale > 1
 			// Don't process textures that are too big
 			&& (int)(w * h) <= settings.rend.MaxFilteredTextureSize * settings.rend.MaxFilteredTextureSize
 			// Don't process YUV textures
 			&& tcw.PixelFmt != PixelYUV;
-	bool need_32bit_buffer = true;
-	if (!textureUpscaling
+	need_32bit_buffer = true;
+	if (!upscaling
 		&& (!IsPaletted() || tex_type != TextureType::_8888)
 		&& texconv != NULL
 		&& !Force32BitTexture(tex_type))
 		need_32bit_buffer = false;
 	// TODO avoid upscaling/depost. textures that change too often
 
-	bool mipmapped = IsMipmapped() && !settings.rend.DumpTextures;
+	mipmapped_data = IsMipmapped() && !settings.rend.DumpTextures;
+
+	return true;
+}
+
+// Converts the texture data from vram. Only touches this texture so it can run on any thread.
+void BaseTextureCacheData::Decode()
+{
+	::palette_index = this->palette_index; // might be used if pal. tex
+	::vq_codebook = &vram[vq_codebook];    // might be used if VQ tex
 
 	if (texconv32 != NULL && need_32bit_buffer)
 	{
-		if (textureUpscaling)
+		if (upscaling)
 			// don't use mipmaps if upscaling
-			mipmapped = false;
+			mipmapped_data = false;
 		// Force the texture type since that's the only 32-bit one we know
 		tex_type = TextureType::_8888;
 
-		if (mipmapped)
+		if (mipmapped_data)
 		{
 			pb32.init(w, h, true);
 			for (u32 i = 0; i <= tsp.TexU + 3u; i++)
@@ -648,7 +687,7 @@ void BaseTextureCacheData::Update()
 
 #ifdef HAVE_TEXUPSCALE
 			// xBRZ scaling
-			if (textureUpscaling)
+			if (upscaling)
 			{
 				PixelBuffer<u32> tmp_buf;
 				tmp_buf.init(w * settings.rend.TextureUpscale, h * settings.rend.TextureUpscale);
@@ -667,7 +706,7 @@ void BaseTextureCacheData::Update()
 	}
 	else if (texconv8 != NULL && tex_type == TextureType::_8)
 	{
-		if (mipmapped)
+		if (mipmapped_data)
 		{
 			pb8.init(w, h, true);
 			for (u32 i = 0; i <= tsp.TexU + 3u; i++)
@@ -687,7 +726,7 @@ void BaseTextureCacheData::Update()
 	}
 	else if (texconv != NULL)
 	{
-		if (mipmapped)
+		if (mipmapped_data)
 		{
 			pb16.init(w, h, true);
 			for (u32 i = 0; i <= tsp.TexU + 3u; i++)
@@ -726,15 +765,18 @@ void BaseTextureCacheData::Update()
 		pb16.init(w, h);
 		memset(pb16.data(), 0x80, w * h * 2);
 		temp_tex_buffer = pb16.data();
-		mipmapped = false;
+		mipmapped_data = false;
 	}
 	// Restore the original texture height if it was constrained to VRAM limits above
 	h = original_h;
+}
 
+void BaseTextureCacheData::Upload()
+{
 	//lock the texture to detect changes in it
    libCore_vramlock_Lock(sa_tex, sa + size - 1, this);
 
-	UploadToGPU(upscaled_w, upscaled_h, (u8*)temp_tex_buffer, IsMipmapped(), mipmapped);
+	UploadToGPU(upscaled_w, upscaled_h, (u8*)temp_tex_buffer, IsMipmapped(), mipmapped_data);
 	if (settings.rend.DumpTextures)
 	{
 		ComputeHash();
@@ -742,6 +784,23 @@ void BaseTextureCacheData::Update()
 		NOTICE_LOG(RENDERER, "Dumped texture %x.png. Old hash %x", texture_hash, old_texture_hash);
 	}
 	PrintTextureName();
+
+	temp_tex_buffer = nullptr;
+	pb16.deinit();
+	pb32.deinit();
+	pb8.deinit();
+}
+
+void DecodeTextures(const std::vector<BaseTextureCacheData *>& textures)
+{
+	double start_time = render_stage_timing ? os_GetSeconds() : 0;
+	StartWorkerPool();
+	worker_pool.Run((int)textures.size(), [&textures](int i) {
+		textures[i]->Decode();
+	});
+	render_stage_stats.texture_updates += textures.size();
+	if (render_stage_timing)
+		render_stage_stats.texture_time += os_GetSeconds() - start_time;
 }
 
 void BaseTextureCacheData::CheckCustomTexture()
@@ -7,9 +7,10 @@
 #include <atomic>
 #include <memory>
 #include <unordered_map>
+#include <vector>
 
-extern u8* vq_codebook;
-extern u32 palette_index;
+extern thread_local u8* vq_codebook;
+extern thread_local u32 palette_index;
 extern u32 palette16_ram[1024];
 extern u32 palette32_ram[1024];
 extern bool pal_needs_update,fog_needs_update;
@@ -571,6 +572,7 @@ template<class PixelConvertor, class pixel_type>
 void texture_VQ(PixelBuffer<pixel_type>* pb,u8* p_in,u32 Width,u32 Height)
 {
 	p_in += 256 * 4 * 2;	// Skip VQ codebook
+	u8 *codebook = vq_codebook;
 	pb->amove(0, 0);
 
 	const u32 divider = PixelConvertor::xpp * PixelConvertor::ypp;
@@ -582,7 +584,7 @@ void texture_VQ(PixelBuffer<pixel_type>* pb,u8* p_in,u32 Width,u32 Height)
 		for (u32 x = 0; x < Width; x += PixelConvertor::xpp)
 		{
 			u8 p = p_in[twop(x, y, bcx, bcy) / divider];
-			PixelConvertor::Convert(pb, &vq_codebook[p * 8]);
+			PixelConvertor::Convert(pb, &codebook[p * 8]);
 
 			pb->rmovex(PixelConvertor::xpp);
 		}
@@ -639,6 +641,10 @@ void texture_VQ(PixelBuffer<pixel_type>* pb,u8* p_in,u32 Width,u32 Height)
 class BaseTextureCacheData;
 
 bool VramLockedWriteOffset(size_t offset);
+void VramDirtyTrackingStart();
+void VramDirtyTrackingStop();
+u32 VramDirtyTrackingRearm();
+bool VramPageDirty(u32 offset, u32 epoch);
 void libCore_vramlock_Lock(u32 start_offset, u32 end_offset, BaseTextureCacheData *texture);
 
 #ifdef HAVE_TEXUPSCALE
@@ -650,6 +656,17 @@ template <class pixel_type> class PixelBuffer;
 typedef void TexConvFP(PixelBuffer<u16>* pb,u8* p_in,u32 Width,u32 Height);
 typedef void TexConvFP8(PixelBuffer<u8>* pb, u8* p_in, u32 Width, u32 Height);
 typedef void TexConvFP32(PixelBuffer<u32>* pb,u8* p_in,u32 Width,u32 Height);
+
+// Vectorized twiddled and VQ decoders for the host cpu. Null when not available for a format.
+struct SIMDTexConv
+{
+	TexConvFP *TW;
+	TexConvFP *VQ;
+	TexConvFP32 *TW32;
+	TexConvFP32 *VQ32;
+};
+SIMDTexConv GetSIMDTexConv(u32 pixelFmt);
+
 enum class TextureType { _565, _5551, _4444, _8888, _8 };
 
 class BaseTextureCacheData
@@ -687,6 +704,21 @@ public:
 	u32 custom_height;
 	std::atomic_int custom_load_in_progress;
 
+	// Update state, kept between PrepareUpdate(), Decode() and Upload()
+	bool update_pending = false;
+	bool has_alpha;
+	bool upscaling;
+	bool need_32bit_buffer;
+	bool mipmapped_data;
+	u32 stride;
+	u32 original_h;
+	u32 upscaled_w;
+	u32 upscaled_h;
+	void *temp_tex_buffer = nullptr;
+	PixelBuffer<u16> pb16;
+	PixelBuffer<u32> pb32;
+	PixelBuffer<u8> pb8;
+
 	void PrintTextureName();
 	virtual std::string GetId() = 0;
 
@@ -723,6 +755,11 @@ public:
 	void Create();
 	void ComputeHash();
 	void Update();
+	// Update() split for batched updates. Decode() can run on any thread,
+	// PrepareUpdate() and Upload() must run on the render thread.
+	bool PrepareUpdate();
+	void Decode();
+	void Upload();
 	virtual void UploadToGPU(int width, int height, u8 *temp_tex_buffer, bool mipmapped, bool mipmapsIncluded = false) = 0;
 	virtual bool Force32BitTexture(TextureType type) const { return false; }
 	void CheckCustomTexture();
@@ -744,6 +781,8 @@ public:
 	}
 };
 
+void DecodeTextures(const std::vector<BaseTextureCacheData *>& textures);
+
 template<typename Texture>
 class BaseTextureCache
 {
@@ -774,6 +813,7 @@ public:
 		else //create if not existing
 		{
 			texture = &cache[key];
+			render_stage_stats.storage_growths++;
 
 			texture->tsp = tsp;
 			texture->tcw = tcw;
@@ -806,8 +846,39 @@ public:
 		}
 	}
 
+	// Queues the update of a texture until UpdateTextures() is called.
+	// The textures are then decoded in parallel by the worker pool.
+	void QueueUpdate(Texture *texture)
+	{
+		if (texture->update_pending || !texture->PrepareUpdate())
+			return;
+		texture->update_pending = true;
+		pendingUpdates.push_back(texture);
+	}
+
+	// Decodes the queued textures and uploads them from the calling thread
+	template<typename Func>
+	void UpdateTextures(Func upload)
+	{
+		if (pendingUpdates.empty())
+			return;
+		DecodeTextures(pendingUpdates);
+		for (BaseTextureCacheData *texture : pendingUpdates)
+		{
+			texture->update_pending = false;
+			upload(static_cast<Texture *>(texture));
+		}
+		pendingUpdates.clear();
+	}
+
+	void UpdateTextures()
+	{
+		UpdateTextures([](Texture *texture) { texture->Upload(); });
+	}
+
 	void Clear()
 	{
+		pendingUpdates.clear();
 		for (auto& pair : cache)
 			pair.second.Delete();
 
@@ -818,6 +889,7 @@ public:
 
 protected:
 	std::unordered_map<u64, Texture> cache;
+	std::vector<BaseTextureCacheData *> pendingUpdates;
 	// Only use TexU and TexV from TSP in the cache key
 	//     TexV : 7, TexU : 7
 	const TSP TSPTextureCacheMask = { { 7, 7 } };
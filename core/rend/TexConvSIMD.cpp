@@ -0,0 +1,430 @@
+/*
+	SIMD texture decoders
+
+	Twiddled textures are decoded by 4x4 tiles. With both dimensions >= 4, the 16 texels
+	of a tile are stored contiguously in the order y0 x0 y1 x1 (from the lowest address bit).
+	A VQ tile is made of 4 consecutive codebook indices whose 2x2 entries follow the same order.
+	The conversions use the same bit operations as the scalar decoders so the output is identical.
+*/
+#include "TexCache.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define TEXCONV_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) && (HOST_CPU == CPU_X64 || HOST_CPU == CPU_X86)
+#define TEXCONV_AVX2
+#include <immintrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define TEXCONV_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(TEXCONV_SSE2) || defined(TEXCONV_NEON)
+
+#ifdef TEXCONV_SSE2
+typedef __m128i v32;
+typedef __m128i v16;
+
+#define VFIELD32(w, shr, mask, shl) _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(w, shr), _mm_set1_epi32(mask)), shl)
+#define VOR(a, b) _mm_or_si128(a, b)
+#define VAND(a, b) _mm_and_si128(a, b)
+#define VSUB(a, b) _mm_sub_epi32(a, b)
+#define VSET32(x) _mm_set1_epi32(x)
+#define VROTL16(w, n) _mm_or_si128(_mm_slli_epi16(w, n), _mm_srli_epi16(w, 16 - (n)))
+
+// Untwiddles a 16-bit tile: a and b hold texels 0-7 and 8-15.
+// Rows 0 and 2 are returned in the low and high halves of r02, rows 1 and 3 in r13.
+static inline void untwiddle_tile(v16 a, v16 b, v16& r02, v16& r13)
+{
+	v16 even = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16), _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+	v16 odd = _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+	r02 = _mm_shuffle_epi32(even, _MM_SHUFFLE(3, 1, 2, 0));
+	r13 = _mm_shuffle_epi32(odd, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+static inline v16 load_tile_half(const u8 *p)
+{
+	return _mm_loadu_si128((const __m128i *)p);
+}
+
+static inline v16 load_vq_half(const u8 *codebook, u8 i0, u8 i1)
+{
+	return _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)&codebook[i0 * 8]),
+			_mm_loadl_epi64((const __m128i *)&codebook[i1 * 8]));
+}
+
+static inline v32 low_row32(v16 rows)
+{
+	return _mm_unpacklo_epi16(rows, _mm_setzero_si128());
+}
+
+static inline v32 high_row32(v16 rows)
+{
+	return _mm_unpackhi_epi16(rows, _mm_setzero_si128());
+}
+
+static inline void store_row32(u32 *dst, v32 row)
+{
+	_mm_storeu_si128((__m128i *)dst, row);
+}
+
+static inline void store_rows16(u16 *dst_low, u16 *dst_high, v16 rows)
+{
+	_mm_storel_epi64((__m128i *)dst_low, rows);
+	_mm_storel_epi64((__m128i *)dst_high, _mm_srli_si128(rows, 8));
+}
+
+#else	// TEXCONV_NEON
+typedef uint32x4_t v32;
+typedef uint16x8_t v16;
+
+#define VFIELD32(w, shr, mask, shl) vshlq_u32(vandq_u32(vshlq_u32(w, vdupq_n_s32(-(shr))), vdupq_n_u32(mask)), vdupq_n_s32(shl))
+#define VOR(a, b) vorrq_u32(a, b)
+#define VAND(a, b) vandq_u32(a, b)
+#define VSUB(a, b) vsubq_u32(a, b)
+#define VSET32(x) vdupq_n_u32(x)
+#define VROTL16(w, n) vorrq_u16(vshlq_n_u16(w, n), vshrq_n_u16(w, 16 - (n)))
+
+static inline void untwiddle_tile(v16 a, v16 b, v16& r02, v16& r13)
+{
+	uint16x8x2_t eo = vuzpq_u16(a, b);
+	uint32x4x2_t even = vuzpq_u32(vreinterpretq_u32_u16(eo.val[0]), vreinterpretq_u32_u16(eo.val[0]));
+	uint32x4x2_t odd = vuzpq_u32(vreinterpretq_u32_u16(eo.val[1]), vreinterpretq_u32_u16(eo.val[1]));
+	r02 = vreinterpretq_u16_u32(vcombine_u32(vget_low_u32(even.val[0]), vget_low_u32(even.val[1])));
+	r13 = vreinterpretq_u16_u32(vcombine_u32(vget_low_u32(odd.val[0]), vget_low_u32(odd.val[1])));
+}
+
+static inline v16 load_tile_half(const u8 *p)
+{
+	return vld1q_u16((const u16 *)p);
+}
+
+static inline v16 load_vq_half(const u8 *codebook, u8 i0, u8 i1)
+{
+	return vcombine_u16(vld1_u16((const u16 *)&codebook[i0 * 8]), vld1_u16((const u16 *)&codebook[i1 * 8]));
+}
+
+static inline v32 low_row32(v16 rows)
+{
+	return vmovl_u16(vget_low_u16(rows));
+}
+
+static inline v32 high_row32(v16 rows)
+{
+	return vmovl_u16(vget_high_u16(rows));
+}
+
+static inline void store_row32(u32 *dst, v32 row)
+{
+	vst1q_u32(dst, row);
+}
+
+static inline void store_rows16(u16 *dst_low, u16 *dst_high, v16 rows)
+{
+	vst1_u16(dst_low, vget_low_u16(rows));
+	vst1_u16(dst_high, vget_high_u16(rows));
+}
+#endif
+
+// Same bit operations as the ARGBxxxx_32 and ARGBxxxx macros
+struct Fmt565
+{
+	static v32 to32(v32 w)
+	{
+		return VOR(VOR(VOR(VFIELD32(w, 11, 0x1F, 3), VFIELD32(w, 13, 0x7, 0)),
+				VOR(VFIELD32(w, 5, 0x3F, 10), VFIELD32(w, 9, 0x3, 8))),
+				VOR(VOR(VFIELD32(w, 0, 0x1F, 19), VFIELD32(w, 2, 0x7, 16)), VSET32(0xFF000000)));
+	}
+	static v16 to16(v16 w)
+	{
+		return w;
+	}
+	static TexConvFP *const TW;
+	static TexConvFP *const VQ;
+	static TexConvFP32 *const TW32;
+	static TexConvFP32 *const VQ32;
+};
+
+struct Fmt1555
+{
+	static v32 to32(v32 w)
+	{
+		// 0xFF000000 if bit 15 is set
+		v32 alpha = VAND(VSUB(VSET32(0), VFIELD32(w, 15, 1, 0)), VSET32(0xFF000000));
+		return VOR(VOR(alpha, VOR(VFIELD32(w, 10, 0x1F, 3), VFIELD32(w, 12, 0x7, 0))),
+				VOR(VOR(VFIELD32(w, 5, 0x1F, 11), VFIELD32(w, 7, 0x7, 8)),
+					VOR(VFIELD32(w, 0, 0x1F, 19), VFIELD32(w, 2, 0x7, 16))));
+	}
+	static v16 to16(v16 w)
+	{
+		return VROTL16(w, 1);
+	}
+	static TexConvFP *const TW;
+	static TexConvFP *const VQ;
+	static TexConvFP32 *const TW32;
+	static TexConvFP32 *const VQ32;
+};
+
+struct Fmt4444
+{
+	static v32 to32(v32 w)
+	{
+		return VOR(VOR(VOR(VFIELD32(w, 12, 0xF, 28), VFIELD32(w, 12, 0xF, 24)),
+					VOR(VFIELD32(w, 8, 0xF, 4), VFIELD32(w, 8, 0xF, 0))),
+				VOR(VOR(VFIELD32(w, 4, 0xF, 12), VFIELD32(w, 4, 0xF, 8)),
+					VOR(VFIELD32(w, 0, 0xF, 20), VFIELD32(w, 0, 0xF, 16))));
+	}
+	static v16 to16(v16 w)
+	{
+		return VROTL16(w, 4);
+	}
+	static TexConvFP *const TW;
+	static TexConvFP *const VQ;
+	static TexConvFP32 *const TW32;
+	static TexConvFP32 *const VQ32;
+};
+
+// Scalar decoders used for the mipmap levels smaller than a tile
+TexConvFP *const Fmt565::TW = tex565_TW;
+TexConvFP *const Fmt565::VQ = tex565_VQ;
+TexConvFP32 *const Fmt565::TW32 = tex565_TW32;
+TexConvFP32 *const Fmt565::VQ32 = tex565_VQ32;
+TexConvFP *const Fmt1555::TW = tex1555_TW;
+TexConvFP *const Fmt1555::VQ = tex1555_VQ;
+TexConvFP32 *const Fmt1555::TW32 = tex1555_TW32;
+TexConvFP32 *const Fmt1555::VQ32 = tex1555_VQ32;
+TexConvFP *const Fmt4444::TW = tex4444_TW;
+TexConvFP *const Fmt4444::VQ = tex4444_VQ;
+TexConvFP32 *const Fmt4444::TW32 = tex4444_TW32;
+TexConvFP32 *const Fmt4444::VQ32 = tex4444_VQ32;
+
+template<typename Fmt>
+static void store_tile(PixelBuffer<u16>* pb, u32 x, u32 y, v16 a, v16 b)
+{
+	v16 r02, r13;
+	untwiddle_tile(a, b, r02, r13);
+	store_rows16(pb->data(x, y), pb->data(x, y + 2), Fmt::to16(r02));
+	store_rows16(pb->data(x, y + 1), pb->data(x, y + 3), Fmt::to16(r13));
+}
+
+template<typename Fmt>
+static void store_tile(PixelBuffer<u32>* pb, u32 x, u32 y, v16 a, v16 b)
+{
+	v16 r02, r13;
+	untwiddle_tile(a, b, r02, r13);
+	store_row32(pb->data(x, y), Fmt::to32(low_row32(r02)));
+	store_row32(pb->data(x, y + 1), Fmt::to32(low_row32(r13)));
+	store_row32(pb->data(x, y + 2), Fmt::to32(high_row32(r02)));
+	store_row32(pb->data(x, y + 3), Fmt::to32(high_row32(r13)));
+}
+
+template<typename Fmt, typename pixel_type>
+static void texture_TW_simd(PixelBuffer<pixel_type>* pb, u8* p_in, u32 Width, u32 Height)
+{
+	const u32 bcx = bitscanrev(Width);
+	const u32 bcy = bitscanrev(Height);
+
+	for (u32 y = 0; y < Height; y += 4)
+		for (u32 x = 0; x < Width; x += 4)
+		{
+			const u8 *p = &p_in[twop(x, y, bcx, bcy) * 2];
+			store_tile<Fmt>(pb, x, y, load_tile_half(p), load_tile_half(p + 16));
+		}
+}
+
+template<typename Fmt, typename pixel_type>
+static void texture_VQ_simd(PixelBuffer<pixel_type>* pb, u8* p_in, u32 Width, u32 Height)
+{
+	const u8 *codebook = vq_codebook;
+	p_in += 256 * 4 * 2;	// Skip VQ codebook
+	const u32 bcx = bitscanrev(Width);
+	const u32 bcy = bitscanrev(Height);
+
+	for (u32 y = 0; y < Height; y += 4)
+		for (u32 x = 0; x < Width; x += 4)
+		{
+			const u8 *p = &p_in[twop(x, y, bcx, bcy) / 4];
+			store_tile<Fmt>(pb, x, y, load_vq_half(codebook, p[0], p[1]), load_vq_half(codebook, p[2], p[3]));
+		}
+}
+
+template<typename Fmt>
+static void texture_TW16(PixelBuffer<u16>* pb, u8* p_in, u32 Width, u32 Height)
+{
+	if (Width < 4 || Height < 4)
+		Fmt::TW(pb, p_in, Width, Height);
+	else
+		texture_TW_simd<Fmt>(pb, p_in, Width, Height);
+}
+
+template<typename Fmt>
+static void texture_VQ16(PixelBuffer<u16>* pb, u8* p_in, u32 Width, u32 Height)
+{
+	if (Width < 4 || Height < 4)
+		Fmt::VQ(pb, p_in, Width, Height);
+	else
+		texture_VQ_simd<Fmt>(pb, p_in, Width, Height);
+}
+
+template<typename Fmt>
+static void texture_TW32(PixelBuffer<u32>* pb, u8* p_in, u32 Width, u32 Height)
+{
+	if (Width < 4 || Height < 4)
+		Fmt::TW32(pb, p_in, Width, Height);
+	else
+		texture_TW_simd<Fmt>(pb, p_in, Width, Height);
+}
+
+template<typename Fmt>
+static void texture_VQ32(PixelBuffer<u32>* pb, u8* p_in, u32 Width, u32 Height)
+{
+	if (Width < 4 || Height < 4)
+		Fmt::VQ32(pb, p_in, Width, Height);
+	else
+		texture_VQ_simd<Fmt>(pb, p_in, Width, Height);
+}
+
+template<typename Fmt>
+static void set_simd_texconv(SIMDTexConv& conv)
+{
+	conv.TW = texture_TW16<Fmt>;
+	conv.VQ = texture_VQ16<Fmt>;
+	conv.TW32 = texture_TW32<Fmt>;
+	conv.VQ32 = texture_VQ32<Fmt>;
+}
+#endif
+
+#ifdef TEXCONV_AVX2
+// Paletted textures: the palette entries of a 4x4 tile are fetched with two 8-wide gathers
+// Order of the tile texels in row-major order
+#define PAL_TILE_ROWS 0, 2, 8, 10, 1, 3, 9, 11, 4, 6, 12, 14, 5, 7, 13, 15
+
+__attribute__((target("avx2")))
+static inline void gather_tile(const u32 *pal, __m128i indices, __m256i& rows01, __m256i& rows23)
+{
+	indices = _mm_shuffle_epi8(indices, _mm_setr_epi8(PAL_TILE_ROWS));
+	rows01 = _mm256_i32gather_epi32((const int *)pal, _mm256_cvtepu8_epi32(indices), 4);
+	rows23 = _mm256_i32gather_epi32((const int *)pal, _mm256_cvtepu8_epi32(_mm_srli_si128(indices, 8)), 4);
+}
+
+__attribute__((target("avx2")))
+static inline void store_pal_rows(PixelBuffer<u32>* pb, u32 x, u32 y, __m256i rows01, __m256i rows23)
+{
+	_mm_storeu_si128((__m128i *)pb->data(x, y), _mm256_castsi256_si128(rows01));
+	_mm_storeu_si128((__m128i *)pb->data(x, y + 1), _mm256_extracti128_si256(rows01, 1));
+	_mm_storeu_si128((__m128i *)pb->data(x, y + 2), _mm256_castsi256_si128(rows23));
+	_mm_storeu_si128((__m128i *)pb->data(x, y + 3), _mm256_extracti128_si256(rows23, 1));
+}
+
+__attribute__((target("avx2")))
+static inline void store_pal_rows(PixelBuffer<u16>* pb, u32 x, u32 y, __m256i rows01, __m256i rows23)
+{
+	// Keep the low 16 bits of each entry, like the scalar version
+	const __m256i low_words = _mm256_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1,
+			0, 1, 4, 5, 8, 9, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1);
+	__m128i r01 = _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_shuffle_epi8(rows01, low_words), 0x08));
+	__m128i r23 = _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_shuffle_epi8(rows23, low_words), 0x08));
+	_mm_storel_epi64((__m128i *)pb->data(x, y), r01);
+	_mm_storel_epi64((__m128i *)pb->data(x, y + 1), _mm_srli_si128(r01, 8));
+	_mm_storel_epi64((__m128i *)pb->data(x, y + 2), r23);
+	_mm_storel_epi64((__m128i *)pb->data(x, y + 3), _mm_srli_si128(r23, 8));
+}
+
+template<typename pixel_type>
+static const u32 *get_palette()
+{
+	return sizeof(pixel_type) == 2 ? &palette16_ram[palette_index] : &palette32_ram[palette_index];
+}
+
+template<typename pixel_type>
+__attribute__((target("avx2")))
+static void texture_PAL4_TW_avx2(PixelBuffer<pixel_type>* pb, u8* p_in, u32 Width, u32 Height)
+{
+	if (Width < 4 || Height < 4)
+	{
+		texture_TW<convPAL4_TW<pixel_type>, pixel_type>(pb, p_in, Width, Height);
+		return;
+	}
+	const u32 *pal = get_palette<pixel_type>();
+	const u32 bcx = bitscanrev(Width);
+	const u32 bcy = bitscanrev(Height);
+	const __m128i nibble_mask = _mm_set1_epi8(0xF);
+
+	for (u32 y = 0; y < Height; y += 4)
+		for (u32 x = 0; x < Width; x += 4)
+		{
+			__m128i packed = _mm_loadl_epi64((const __m128i *)&p_in[twop(x, y, bcx, bcy) / 2]);
+			// Low nibble first
+			__m128i indices = _mm_unpacklo_epi8(_mm_and_si128(packed, nibble_mask),
+					_mm_and_si128(_mm_srli_epi16(packed, 4), nibble_mask));
+			__m256i rows01, rows23;
+			gather_tile(pal, indices, rows01, rows23);
+			store_pal_rows(pb, x, y, rows01, rows23);
+		}
+}
+
+template<typename pixel_type>
+__attribute__((target("avx2")))
+static void texture_PAL8_TW_avx2(PixelBuffer<pixel_type>* pb, u8* p_in, u32 Width, u32 Height)
+{
+	if (Width < 4 || Height < 4)
+	{
+		texture_TW<convPAL8_TW<pixel_type>, pixel_type>(pb, p_in, Width, Height);
+		return;
+	}
+	const u32 *pal = get_palette<pixel_type>();
+	const u32 bcx = bitscanrev(Width);
+	const u32 bcy = bitscanrev(Height);
+
+	for (u32 y = 0; y < Height; y += 4)
+		for (u32 x = 0; x < Width; x += 4)
+		{
+			__m128i indices = _mm_loadu_si128((const __m128i *)&p_in[twop(x, y, bcx, bcy)]);
+			__m256i rows01, rows23;
+			gather_tile(pal, indices, rows01, rows23);
+			store_pal_rows(pb, x, y, rows01, rows23);
+		}
+}
+#endif
+
+SIMDTexConv GetSIMDTexConv(u32 pixelFmt)
+{
+	SIMDTexConv conv = {};
+#if defined(TEXCONV_SSE2) || defined(TEXCONV_NEON)
+	switch (pixelFmt)
+	{
+	case Pixel565:
+		set_simd_texconv<Fmt565>(conv);
+		break;
+	case Pixel1555:
+		set_simd_texconv<Fmt1555>(conv);
+		break;
+	case Pixel4444:
+	case PixelBumpMap:
+		set_simd_texconv<Fmt4444>(conv);
+		break;
+#ifdef TEXCONV_AVX2
+	case PixelPal4:
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+		{
+			conv.TW = texture_PAL4_TW_avx2<u16>;
+			conv.TW32 = texture_PAL4_TW_avx2<u32>;
+		}
+		break;
+	case PixelPal8:
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+		{
+			conv.TW = texture_PAL8_TW_avx2<u16>;
+			conv.TW32 = texture_PAL8_TW_avx2<u32>;
+		}
+		break;
+#endif
+	default:
+		break;
+	}
+#endif
+	return conv;
+}
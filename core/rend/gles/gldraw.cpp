@@ -279,20 +279,17 @@ static void SortTriangles(int first, int count)
 	if (!pidx_sort.empty())
 	{
 		//Bind and upload sorted index buffer
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gl.vbo.idxs2); glCheck();
+		StreamBuffer& idxs2 = gl.stream.idxs2;
 		if (gl.index_type == GL_UNSIGNED_SHORT)
 		{
-			static bool overrun;
-			static List<u16> short_vidx;
-			if (short_vidx.daty != NULL)
-				short_vidx.Free();
-			short_vidx.Init(vidx_sort.size(), &overrun, NULL);
+			u16 *dst = (u16 *)idxs2.Map(vidx_sort.size() * sizeof(u16));
 			for (u32 i = 0; i < vidx_sort.size(); i++)
-				*(short_vidx.Append()) = vidx_sort[i];
-			glBufferData(GL_ELEMENT_ARRAY_BUFFER, short_vidx.bytes(), short_vidx.head(), GL_STREAM_DRAW);
+				dst[i] = vidx_sort[i];
+			idxs2.Unmap();
 		}
 		else
-			glBufferData(GL_ELEMENT_ARRAY_BUFFER, vidx_sort.size() * sizeof(u32), &vidx_sort[0], GL_STREAM_DRAW);
+			idxs2.Upload(&vidx_sort[0], vidx_sort.size() * sizeof(u32));
+		glCheck();
 	}
 }
 
@@ -302,6 +299,8 @@ void DrawSorted(bool multipass)
 	if (!pidx_sort.empty())
 	{
 		u32 count=pidx_sort.size();
+		// The sorted indices may share the buffer with the ones of previous passes
+		size_t idxs_offset = gl.stream.idxs2.Offset();
 
 		{
 			//set some 'global' modes for all primitives
@@ -317,7 +316,7 @@ void DrawSorted(bool multipass)
 				{
 					SetGPState<ListType_Translucent, true>(params);
 					glDrawElements(GL_TRIANGLES, pidx_sort[p].count, gl.index_type,
-						(GLvoid*)(gl.get_index_size() * pidx_sort[p].first));
+						(GLvoid*)(idxs_offset + gl.get_index_size() * pidx_sort[p].first));
 				}
 				params++;
 			}
@@ -347,7 +346,7 @@ void DrawSorted(bool multipass)
 						SetCull(params->isp.CullMode ^ gcflip);
 
 						glDrawElements(GL_TRIANGLES, pidx_sort[p].count, gl.index_type,
-							(GLvoid*)(gl.get_index_size() * pidx_sort[p].first));
+							(GLvoid*)(idxs_offset + gl.get_index_size() * pidx_sort[p].first));
 					}
 				}
 				glcache.StencilMask(0xFF);
@@ -356,7 +355,7 @@ void DrawSorted(bool multipass)
 
 		}
 		// Re-bind the previous index buffer for subsequent render passes
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gl.vbo.idxs);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gl.stream.idxs.Current());
 	}
 }
 
@@ -457,11 +456,8 @@ void SetMVS_Mode(ModifierVolumeMode mv_mode, ISP_Modvol ispc)
 	}
 }
 
-static void SetupMainVBO(void)
+static void SetupVertexAttribs(void)
 {
-	glBindBuffer(GL_ARRAY_BUFFER, gl.vbo.geometry);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gl.vbo.idxs);
-
 	//setup vertex buffers attrib pointers
 	glEnableVertexAttribArray(VERTEX_POS_ARRAY);
 	glVertexAttribPointer(VERTEX_POS_ARRAY, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex,x));
@@ -476,9 +472,23 @@ static void SetupMainVBO(void)
 	glVertexAttribPointer(VERTEX_UV_ARRAY, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex,u));
 }
 
+static void SetupMainVBO(void)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, gl.stream.geometry.Current());
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gl.stream.idxs.Current());
+	SetupVertexAttribs();
+}
+
+static void SetupQuadVBO(void)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, gl.vbo.geometry);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gl.vbo.idxs);
+	SetupVertexAttribs();
+}
+
 static void SetupModvolVBO(void)
 {
-	glBindBuffer(GL_ARRAY_BUFFER, gl.vbo.modvols);
+	glBindBuffer(GL_ARRAY_BUFFER, gl.stream.modvols.Current());
 
 	//setup vertex buffers attrib pointers
 	glEnableVertexAttribArray(VERTEX_POS_ARRAY);
@@ -653,7 +663,7 @@ static void DrawQuad(GLuint texId, float x, float y, float w, float h, float u0,
 	glActiveTexture(GL_TEXTURE0);
 	glcache.BindTexture(GL_TEXTURE_2D, texId);
 
-	SetupMainVBO();
+	SetupQuadVBO();
 	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STREAM_DRAW);
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STREAM_DRAW);
 
@@ -777,7 +787,7 @@ void DrawVmuTexture(u8 vmu_screen_number)
 	glcache.Enable(GL_BLEND);
 	glcache.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-	SetupMainVBO();
+	SetupQuadVBO();
 	PipelineShader *shader = GetProgram(0, false, 1, 1, 0, 0, 0, 2, false, false, false, false, false);
 	glcache.UseProgram(shader->program);
 
@@ -871,7 +881,7 @@ void DrawGunCrosshair(u8 port)
 	glcache.Enable(GL_BLEND);
 	glcache.BlendFunc(GL_SRC_ALPHA, GL_ONE);
 
-	SetupMainVBO();
+	SetupQuadVBO();
 	PipelineShader *shader = GetProgram(0, false, 1, 1, 0, 0, 0, 2, false, false, false, false, false);
 	glcache.UseProgram(shader->program);
 
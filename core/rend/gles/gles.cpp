@@ -678,9 +678,17 @@ static void gl_term(void)
 	memset(lightgunTextureId, 0, sizeof(lightgunTextureId));
 
 	glDeleteBuffers(1, &gl.vbo.geometry);
-	glDeleteBuffers(1, &gl.vbo.modvols);
 	glDeleteBuffers(1, &gl.vbo.idxs);
-	glDeleteBuffers(1, &gl.vbo.idxs2);
+	gl.stream.geometry.Term();
+	gl.stream.modvols.Term();
+	gl.stream.idxs.Term();
+	gl.stream.idxs2.Term();
+	for (u32 i = 0; i < STREAM_FRAMES; i++)
+		if (gl.stream.fences[i] != NULL)
+		{
+			glDeleteSync(gl.stream.fences[i]);
+			gl.stream.fences[i] = NULL;
+		}
 	glDeleteTextures(1, &fbTextureId);
 	fbTextureId = 0;
 	glDeleteTextures(1, &fogTextureId);
@@ -695,12 +703,31 @@ static bool gl_create_resources(void)
 {
 	/* create VBOs */
 	glGenBuffers(1, &gl.vbo.geometry);
-	glGenBuffers(1, &gl.vbo.modvols);
 	glGenBuffers(1, &gl.vbo.idxs);
-	glGenBuffers(1, &gl.vbo.idxs2);
 
    findGLVersion();
 
+	gl.stream.mode = StreamBufferData;
+#ifndef HAVE_OPENGLES2
+	if (gl.is_gles)
+	{
+		// GLES 3.0 has glMapBufferRange and fences but no glBufferStorage
+		if (gl.gl_major >= 3)
+			gl.stream.mode = StreamMapRange;
+	}
+#ifndef HAVE_OPENGLES
+	else if (gl.gl_major > 4 || (gl.gl_major == 4 && gl.gl_minor >= 4))
+		gl.stream.mode = StreamPersistent;
+#endif
+	else if (gl.gl_major > 3 || (gl.gl_major == 3 && gl.gl_minor >= 2))
+		gl.stream.mode = StreamMapRange;
+#endif
+	gl.stream.frame = 0;
+	gl.stream.geometry.Init(GL_ARRAY_BUFFER);
+	gl.stream.modvols.Init(GL_ARRAY_BUFFER);
+	gl.stream.idxs.Init(GL_ELEMENT_ARRAY_BUFFER);
+	gl.stream.idxs2.Init(GL_ELEMENT_ARRAY_BUFFER);
+
    char vshader[8192];
    sprintf(vshader, VertexShaderSource, gl.glsl_version_header, gl.gl_version, 1);
    char fshader[8192];
@@ -770,24 +797,188 @@ void vertex_buffer_unmap(void)
    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
 
+void StreamBuffer::Init(GLenum target)
+{
+	this->target = target;
+	used = 0;
+	offset = 0;
+	for (u32 i = 0; i < STREAM_FRAMES; i++)
+	{
+		buffers[i] = 0;
+		capacity[i] = 0;
+		persistent[i] = NULL;
+	}
+	if (gl.stream.mode != StreamBufferData)
+		glGenBuffers(STREAM_FRAMES, buffers);
+	else
+		// All frames share the same buffer, which is orphaned on every upload
+		glGenBuffers(1, &buffers[0]);
+}
+
+void StreamBuffer::Term()
+{
+	for (u32 i = 0; i < STREAM_FRAMES; i++)
+	{
+		if (buffers[i] != 0)
+			glDeleteBuffers(1, &buffers[i]);
+		buffers[i] = 0;
+		capacity[i] = 0;
+		persistent[i] = NULL;
+	}
+	staging.clear();
+	staging.shrink_to_fit();
+}
+
+GLuint StreamBuffer::Current() const
+{
+	return gl.stream.mode == StreamBufferData ? buffers[0] : buffers[gl.stream.frame];
+}
+
+void StreamBuffer::Allocate(u32 frame, u32 size)
+{
+	u32 new_capacity = std::max(capacity[frame], 1024u * 1024u);
+	while (new_capacity < size)
+		new_capacity *= 2;
+	DEBUG_LOG(RENDERER, "Stream buffer %d frame %d: %d -> %d bytes", buffers[frame], frame, capacity[frame], new_capacity);
+
+#ifndef HAVE_OPENGLES
+	if (gl.stream.mode == StreamPersistent)
+	{
+		// Immutable storage can't be resized. The old buffer is kept alive by the driver
+		// until the draws of this frame that still reference it are done.
+		glDeleteBuffers(1, &buffers[frame]);
+		glGenBuffers(1, &buffers[frame]);
+		glBindBuffer(target, buffers[frame]);
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(target, new_capacity, NULL, flags);
+		persistent[frame] = (u8 *)glMapBufferRange(target, 0, new_capacity, flags);
+		verify(persistent[frame] != NULL);
+	}
+	else
+#endif
+	{
+		glBindBuffer(target, buffers[frame]);
+		glBufferData(target, new_capacity, NULL, GL_STREAM_DRAW);
+	}
+	capacity[frame] = new_capacity;
+	used = 0;
+}
+
+void *StreamBuffer::Map(u32 size)
+{
+	mapped_size = size;
+	if (gl.stream.mode == StreamBufferData)
+	{
+		offset = 0;
+		glBindBuffer(target, buffers[0]);
+		if (staging.size() < size)
+			staging.resize(size);
+		return staging.data();
+	}
+#ifndef HAVE_OPENGLES2
+	const u32 frame = gl.stream.frame;
+	offset = (used + 255) & ~255u;
+	if (buffers[frame] == 0 || offset + std::max(size, 1u) > capacity[frame])
+	{
+		Allocate(frame, offset + size);
+		offset = 0;
+	}
+	used = offset + size;
+	glBindBuffer(target, buffers[frame]);
+	if (gl.stream.mode == StreamPersistent)
+		return persistent[frame] + offset;
+
+	// The fence of this frame has been waited on, so the GPU is done with this buffer.
+	void *p = glMapBufferRange(target, offset, std::max(size, 1u),
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (p == NULL)
+	{
+		WARN_LOG(RENDERER, "glMapBufferRange failed. Falling back to glBufferData");
+		gl.stream.mode = StreamBufferData;
+		return Map(size);
+	}
+	return p;
+#else
+	die("Unsupported stream buffer mode");
+	return NULL;
+#endif
+}
+
+void StreamBuffer::Unmap()
+{
+	if (gl.stream.mode == StreamBufferData)
+		glBufferData(target, mapped_size, staging.data(), GL_STREAM_DRAW);
+#ifndef HAVE_OPENGLES2
+	else if (gl.stream.mode == StreamMapRange)
+		glUnmapBuffer(target);
+#endif
+}
+
+void StreamBuffer::Upload(const void *data, u32 size)
+{
+	if (gl.stream.mode == StreamBufferData)
+	{
+		// No need to go through the staging buffer
+		offset = 0;
+		glBindBuffer(target, buffers[0]);
+		glBufferData(target, size, data, GL_STREAM_DRAW);
+		return;
+	}
+	memcpy(Map(size), data, size);
+	Unmap();
+}
+
+void StreamBeginFrame()
+{
+#ifndef HAVE_OPENGLES2
+	if (gl.stream.mode == StreamBufferData)
+		return;
+	gl.stream.frame = (gl.stream.frame + 1) % STREAM_FRAMES;
+	void *fence = gl.stream.fences[gl.stream.frame];
+	if (fence != NULL)
+	{
+		// The buffers of this frame may still be read by the GPU: never write them before the fence is signaled
+		GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+		while (status == GL_TIMEOUT_EXPIRED)
+		{
+			WARN_LOG(RENDERER, "Still waiting for stream buffer fence");
+			status = glClientWaitSync(fence, 0, 1000000000ull);
+		}
+		if (status == GL_WAIT_FAILED)
+			WARN_LOG(RENDERER, "Stream buffer fence wait failed: %x", glGetError());
+		glDeleteSync(fence);
+		gl.stream.fences[gl.stream.frame] = NULL;
+	}
+	gl.stream.geometry.Reset();
+	gl.stream.modvols.Reset();
+	gl.stream.idxs.Reset();
+	gl.stream.idxs2.Reset();
+#endif
+}
+
+void StreamEndFrame()
+{
+#ifndef HAVE_OPENGLES2
+	if (gl.stream.mode != StreamBufferData)
+		gl.stream.fences[gl.stream.frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+#endif
+}
+
 void DoCleanup() {
 }
 
 static void upload_vertex_indices()
 {
+	StreamBuffer& idxs = gl.stream.idxs;
 	if (gl.index_type == GL_UNSIGNED_SHORT)
 	{
-		static bool overrun;
-		static List<u16> short_idx;
-		if (short_idx.daty != NULL)
-			short_idx.Free();
-		short_idx.Init(pvrrc.idx.used(), &overrun, NULL);
+		u16 *dst = (u16 *)idxs.Map(pvrrc.idx.used() * sizeof(u16));
 		for (u32 *p = pvrrc.idx.head(); p < pvrrc.idx.LastPtr(0); p++)
-			*(short_idx.Append()) = *p;
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, short_idx.bytes(), short_idx.head(), GL_STREAM_DRAW);
+			*dst++ = *p;
+		idxs.Unmap();
 	}
 	else
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER,pvrrc.idx.bytes(),pvrrc.idx.head(),GL_STREAM_DRAW);
+		idxs.Upload(pvrrc.idx.head(), pvrrc.idx.bytes());
 }
 
 static bool RenderFrame(void)
@@ -940,19 +1131,17 @@ static bool RenderFrame(void)
 
 	if (!pvrrc.isRenderFramebuffer)
 	{
-		//Main VBO
-		glBindBuffer(GL_ARRAY_BUFFER, gl.vbo.geometry); glCheck();
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gl.vbo.idxs); glCheck();
+		StreamBeginFrame();
 
-		glBufferData(GL_ARRAY_BUFFER,pvrrc.verts.bytes(),pvrrc.verts.head(),GL_STREAM_DRAW); glCheck();
+		//Main VBO
+		gl.stream.geometry.Upload(pvrrc.verts.head(), pvrrc.verts.bytes()); glCheck();
 
 		upload_vertex_indices();
 
 		//Modvol VBO
 		if (pvrrc.modtrig.used())
 		{
-			glBindBuffer(GL_ARRAY_BUFFER, gl.vbo.modvols); glCheck();
-			glBufferData(GL_ARRAY_BUFFER,pvrrc.modtrig.bytes(),pvrrc.modtrig.head(),GL_STREAM_DRAW); glCheck();
+			gl.stream.modvols.Upload(pvrrc.modtrig.head(), pvrrc.modtrig.bytes()); glCheck();
 		}
 
 		if (!wide_screen_on)
@@ -1025,6 +1214,7 @@ static bool RenderFrame(void)
 		}
 
 		DrawStrips();
+		StreamEndFrame();
 		if (settings.rend.PowerVR2Filter && !is_rtt)
 			postProcessor.Render(hw_render.get_current_framebuffer());
 	}
@@ -1082,7 +1272,9 @@ bool ProcessFrame(TA_context* ctx)
 	}
 	else
 	{
-		if (!ta_parse_vdrc(ctx))
+		bool parsed = ta_parse_vdrc(ctx);
+		TexCache.UpdateTextures();
+		if (!parsed)
 			return false;
 	}
    TexCache.CollectCleanup();
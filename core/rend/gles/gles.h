@@ -24,6 +24,12 @@
 #ifndef GL_TEXTURE_MAX_LEVEL
 #define GL_TEXTURE_MAX_LEVEL                    0x813D
 #endif
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT                   0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT                     0x0080
+#endif
 
 
 #define VERTEX_POS_ARRAY      0
@@ -75,6 +81,46 @@ struct PipelineShader
 
 
 
+// Number of frames the TA geometry buffers are cycled through
+#define STREAM_FRAMES 3
+
+// Ring of per-frame buffers used to stream the TA vertex and index data to the GPU.
+// The buffers of a frame are only written again once the fence of that frame has
+// signaled, so they can be mapped unsynchronized (GL 3.2, GLES 3.0) or stay persistently
+// mapped (GL 4.4). GLES2 and older contexts fall back to glBufferData.
+class StreamBuffer
+{
+public:
+	void Init(GLenum target);
+	void Term();
+	// Binds the buffer of the current frame and returns size writable bytes.
+	// Several regions can be mapped in the same frame. Their offsets are returned by Offset().
+	void *Map(u32 size);
+	void Unmap();
+	void Upload(const void *data, u32 size);
+	// Called when a new frame starts using the buffer
+	void Reset() { used = 0; }
+	GLuint Current() const;
+	u32 Offset() const { return offset; }
+
+private:
+	void Allocate(u32 frame, u32 size);
+
+	GLenum target = 0;
+	GLuint buffers[STREAM_FRAMES] = {};
+	u32 capacity[STREAM_FRAMES] = {};
+	u8 *persistent[STREAM_FRAMES] = {};
+	u32 used = 0;
+	u32 offset = 0;
+	u32 mapped_size = 0;
+	std::vector<u8> staging;
+};
+
+enum StreamMode { StreamBufferData, StreamMapRange, StreamPersistent };
+
+void StreamBeginFrame();
+void StreamEndFrame();
+
 struct gl_ctx
 {
 	struct
@@ -89,11 +135,21 @@ struct gl_ctx
 
 	std::unordered_map<u32, PipelineShader> shaders;
 
+	// Small quads: framebuffer, VMU screens and crosshairs
 	struct
 	{
-		GLuint geometry,modvols,idxs,idxs2;
+		GLuint geometry,idxs;
 	} vbo;
 
+	// TA vertex, modifier volume and index data
+	struct
+	{
+		StreamBuffer geometry, modvols, idxs, idxs2;
+		StreamMode mode;
+		u32 frame;
+		void *fences[STREAM_FRAMES];
+	} stream;
+
 	struct
 	{
 		u32 TexAddr;
@@ -371,12 +371,12 @@ u64 gl_GetTexture(TSP tsp, TCW tcw)
 		tf->texID = glcache.GenTexture();
 	}
 
-	//update if needed
+	//update if needed. The texture is decoded and uploaded after the frame is parsed
 	if (tf->NeedsUpdate())
-		tf->Update();
+		TexCache.QueueUpdate(tf);
    else
    {
-      if (tf->IsCustomTextureAvailable())
+      if (tf->IsCustomTextureAvailable() && !tf->update_pending)
       {
       	glcache.DeleteTextures(1, &tf->texID);
       	tf->texID = glcache.GenTexture();
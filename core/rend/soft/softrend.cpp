@@ -1,1236 +1,1104 @@
-#include <omp.h>
-#include "hw/pvr/pvr.h"
-
 /*
-	SSE/MMX based softrend
+	SSE based softrend
 
 	Initial code by skmp and gigaherz
 
-	This is a rather weird very basic pvr softrend. 
-	Renders	in some kind of tile format (that I forget now),
-	and does depth and color, but no alpha, texture, or pixel
-	processing. All of the pipeline is based on quads.
+	Polygons are binned into 32x32 pixel tiles, like the PowerVR region array,
+	and the tiles are rasterized in parallel by the worker pool. Each tile has
+	its own color and depth buffers so workers never share pixels.
+	Autosorted translucent triangles are sorted in each tile by their min z
+	in the tile rather than globally.
+	Four horizontally adjacent pixels are shaded at once.
+
+	The pixel pipeline follows the GL renderer. Modifier volumes, mipmaps
+	and bump maps aren't supported.
 */
+#include "build.h"
 
-#include <mmintrin.h>
-#include <xmmintrin.h>
+#ifdef HAVE_SOFTREND
 #include <emmintrin.h>
-#ifdef __SSE4_1__
-#include <smmintrin.h>
-#endif
 #include <cmath>
+#include <cstring>
+#include <string>
 #include <algorithm>
+#include <vector>
 
-#include "rend/gles/gles.h"
+#include "softrend.h"
+#include "hw/pvr/Renderer_if.h"
+#include "hw/pvr/pvr_mem.h"
+#include "rend/TexCache.h"
+#include "rend/sorter.h"
+#include "rend/tileclip.h"
+#include "rend/transform_matrix.h"
 
-#define MAX_RENDER_WIDTH 640
-#define MAX_RENDER_HEIGHT 480
-#define MAX_RENDER_PIXELS (MAX_RENDER_WIDTH * MAX_RENDER_HEIGHT)
+#define TILE_SIZE 32
+#define FRAME_WIDTH 640
+#define FRAME_HEIGHT 480
 
-#define STRIDE_PIXEL_OFFSET MAX_RENDER_WIDTH
-#define Z_BUFFER_PIXEL_OFFSET MAX_RENDER_PIXELS
+static std::vector<u32> frame;
+static u32 frame_width;
+static u32 frame_height;
 
-DECL_ALIGN(32) u32 render_buffer[MAX_RENDER_PIXELS * 2]; //Color + depth
-DECL_ALIGN(32) u32 pixels[MAX_RENDER_PIXELS];
+const u32 *rend_soft_framebuffer(u32& width, u32& height)
+{
+	if (frame_width == 0)
+		return nullptr;
+	width = frame_width;
+	height = frame_height;
+	return frame.data();
+}
 
-#ifdef __SSE2__
-union m128i
+class SoftTexture : public BaseTextureCacheData
 {
-	__m128i mm;
-	int8_t m128i_i8[16];
-	int16_t m128i_i16[8];
-	int32_t m128i_i32[4];
-	uint32_t m128i_u32[4];
+public:
+	// RGBA pixels, or palette indices for TextureType::_8
+	std::vector<u32> pixels;
+	u32 width = 0;
+	u32 height = 0;
+	bool created = false;
+
+	std::string GetId() override { return std::to_string((uintptr_t)this); }
+	void UploadToGPU(int width, int height, u8 *temp_tex_buffer, bool mipmapped, bool mipmapsIncluded = false) override;
+	// Palette indices are looked up when sampling, everything else is decoded to RGBA
+	bool Force32BitTexture(TextureType type) const override { return type != TextureType::_8; }
+	bool Delete() override
+	{
+		if (!BaseTextureCacheData::Delete())
+			return false;
+		pixels.clear();
+		pixels.shrink_to_fit();
+		return true;
+	}
 };
-#endif
 
-bool operator<(const PolyParam &left, const PolyParam &right)
+static u32 Convert16(u16 p, TextureType type)
 {
-/* put any condition you want to sort on here */
-	return left.zvZ<right.zvZ;
-	//return left.zMin<right.zMax;
+	u32 r, g, b, a;
+	switch (type)
+	{
+	case TextureType::_565:
+		r = (p >> 11) & 0x1F;
+		g = (p >> 5) & 0x3F;
+		b = p & 0x1F;
+		r = (r << 3) | (r >> 2);
+		g = (g << 2) | (g >> 4);
+		b = (b << 3) | (b >> 2);
+		a = 0xFF;
+		break;
+	case TextureType::_5551:
+		r = (p >> 11) & 0x1F;
+		g = (p >> 6) & 0x1F;
+		b = (p >> 1) & 0x1F;
+		r = (r << 3) | (r >> 2);
+		g = (g << 3) | (g >> 2);
+		b = (b << 3) | (b >> 2);
+		a = (p & 1) ? 0xFF : 0;
+		break;
+	default:
+		r = ((p >> 12) & 0xF) * 0x11;
+		g = ((p >> 8) & 0xF) * 0x11;
+		b = ((p >> 4) & 0xF) * 0x11;
+		a = (p & 0xF) * 0x11;
+		break;
+	}
+	return r | (g << 8) | (b << 16) | (a << 24);
 }
 
-//Sort based on min-z of each strip
-void SortPParams(int first, int count)
+void SoftTexture::UploadToGPU(int width, int height, u8 *temp_tex_buffer, bool mipmapped, bool mipmapsIncluded)
 {
-	if (pvrrc.verts.used() == 0 || count <= 1)
-		return;
-
-	Vertex* vtx_base=pvrrc.verts.head();
-	u16* idx_base=pvrrc.idx.head();
+	// Only the base level is used. Mipmaps are stored from the smallest one.
+	size_t offset = 0;
+	if (mipmapsIncluded)
+		offset = ((size_t)width * height - 1) / 3;
 
-	PolyParam* pp = &pvrrc.global_param_tr.head()[first];
-	PolyParam* pp_end = pp + count;
+	this->width = width;
+	this->height = height;
+	pixels.resize((size_t)width * height);
 
-	while(pp!=pp_end)
+	switch (tex_type)
 	{
-		if (pp->count<2)
+	case TextureType::_8888:
+		memcpy(pixels.data(), (u32 *)temp_tex_buffer + offset, pixels.size() * sizeof(u32));
+		break;
+	case TextureType::_8:
 		{
-			pp->zvZ=0;
+			const u8 *src = temp_tex_buffer + offset;
+			for (size_t i = 0; i < pixels.size(); i++)
+				pixels[i] = src[i];
 		}
-		else
+		break;
+	default:
 		{
-			u16* idx=idx_base+pp->first;
-
-			Vertex* vtx=vtx_base+idx[0];
-			Vertex* vtx_end=vtx_base + idx[pp->count-1]+1;
-
-			u32 zv=0xFFFFFFFF;
-			while(vtx!=vtx_end)
-			{
-				zv=min(zv,(u32&)vtx->z);
-				vtx++;
-			}
-
-			pp->zvZ=(f32&)zv;
+			const u16 *src = (const u16 *)temp_tex_buffer + offset;
+			for (size_t i = 0; i < pixels.size(); i++)
+				pixels[i] = Convert16(src[i], tex_type);
 		}
-		pp++;
+		break;
 	}
-
-	std::stable_sort(pvrrc.global_param_tr.head() + first, pvrrc.global_param_tr.head() + first + count);
 }
 
-static __m128 _mm_load_scaled_float(float v, float s)
-{
-	return _mm_setr_ps(v, v + s, v + s + s, v + s + s + s);
-}
-static __m128 _mm_broadcast_float(float v)
+class SoftTextureCache : public BaseTextureCache<SoftTexture>
 {
-	return _mm_setr_ps(v, v, v, v);
-}
-static __m128i _mm_broadcast_int(int v)
-{
-	__m128i rv = _mm_cvtsi32_si128(v);
-	return _mm_shuffle_epi32(rv, 0);
-}
-static __m128 _mm_load_ps_r(float a, float b, float c, float d)
+};
+
+// Interpolates an attribute over a triangle: a = ddx * x + ddy * y + c
+struct PlaneStepper
 {
-   DECL_ALIGN(128) float v[4];
-	v[0] = a;
-	v[1] = b;
-	v[2] = c;
-	v[3] = d;
+	float ddx, ddy;
+	float c;
 
-	return _mm_load_ps(v);
-}
+	void Setup(const float *x, const float *y, float v1_a, float v2_a, float v3_a)
+	{
+		float Aa = ((v3_a - v1_a) * (y[1] - y[0]) - (v2_a - v1_a) * (y[2] - y[0]));
+		float Ba = ((x[2] - x[0]) * (v2_a - v1_a) - (x[1] - x[0]) * (v3_a - v1_a));
+		float C = ((x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]));
 
-__forceinline int iround(float x)
-{
-	return _mm_cvtt_ss2si(_mm_load_ss(&x));
-}
+		ddx = -Aa / C;
+		ddy = -Ba / C;
+		c = v1_a - ddx * x[0] - ddy * y[0];
+	}
 
-float mmin(float a, float b, float c, float d)
-{
-	float rv = min(a, b);
-	rv = min(c, rv);
-	return max(d, rv);
-}
+	void SetConstant(float v)
+	{
+		ddx = ddy = 0;
+		c = v;
+	}
 
-float mmax(float a, float b, float c, float d)
-{
-	float rv = max(a, b);
-	rv = max(c, rv);
-	return min(d, rv);
-}
+	__forceinline __m128 Ip(__m128 x, __m128 y) const
+	{
+		__m128 p1 = _mm_mul_ps(x, _mm_set1_ps(ddx));
+		__m128 p2 = _mm_mul_ps(y, _mm_set1_ps(ddy));
+
+		return _mm_add_ps(_mm_add_ps(p1, p2), _mm_set1_ps(c));
+	}
+};
 
-//i think this gives false positives ...
-//yup, if ANY of the 3 tests fail the ANY tests fails.
-__forceinline void EvalHalfSpace(bool& all, bool& any, float cp, float sv, float lv)
+struct Triangle
 {
-	//bool a00 = C1 + DX12 * y0 - DY12 * x0 > 0;
-	//bool a10 = C1 + DX12 * y0 - DY12 * x0 > qDY12;
-	//bool a01 = C1 + DX12 * y0 - DY12 * x0 > -qDX12;
-	//bool a11 = C1 + DX12 * y0 - DY12 * x0 > (qDY12-qDX12);
+	// Edge functions, positive inside
+	float edge_a[3];
+	float edge_b[3];
+	float edge_c[3];
+	u32 top_left;		// bit i is set if edge i is a top or left edge
+	// Bounding box. right and bottom are excluded
+	int left, top, right, bottom;
+	u32 state;
+	u32 pass;
+	bool tile_sort;
+	float min_z;
+
+	PlaneStepper z;		// 1/w
+	PlaneStepper u, v;	// u/w, v/w
+	PlaneStepper base[4];
+	PlaneStepper offs[4];
+};
 
-	//C1 + DX12 * y0 - DY12 * x0 > 0
-	// + DX12 * y0 - DY12 * x0 > 0 - C1
-	//int pd=DX * y0 - DY * x0;
+struct PolyState
+{
+	const SoftTexture *texture;
+	u32 palette_index;
+	u32 cull_mode;
+	u32 depth_func;
+	bool depth_write;
+	bool blend;
+	u32 src_instr;
+	u32 dst_instr;
+	bool alpha_test;
+	bool use_alpha;
+	bool ignore_tex_a;
+	bool offset;
+	bool gouraud;
+	bool color_clamp;
+	bool bilinear;
+	bool clamp_u, clamp_v;
+	bool flip_u, flip_v;
+	u32 shad_instr;
+	u32 fog_ctrl;
+	TileClipping clip_mode;
+	int clip[4];		// left, top, right, bottom. right and bottom are excluded
+	bool tile_sort;		// per triangle sorting in each tile
+};
 
-	bool a = cp > sv;	//needed for ANY
-	bool b = cp > lv;	//needed for ALL
+DECL_ALIGN(16) static const u32 lane_masks[16][4] = {
+	{ 0, 0, 0, 0 }, { ~0u, 0, 0, 0 }, { 0, ~0u, 0, 0 }, { ~0u, ~0u, 0, 0 },
+	{ 0, 0, ~0u, 0 }, { ~0u, 0, ~0u, 0 }, { 0, ~0u, ~0u, 0 }, { ~0u, ~0u, ~0u, 0 },
+	{ 0, 0, 0, ~0u }, { ~0u, 0, 0, ~0u }, { 0, ~0u, 0, ~0u }, { ~0u, ~0u, 0, ~0u },
+	{ 0, 0, ~0u, ~0u }, { ~0u, 0, ~0u, ~0u }, { 0, ~0u, ~0u, ~0u }, { ~0u, ~0u, ~0u, ~0u },
+};
 
-	any &= a;
-	all &= b;
+static __forceinline __m128 LaneMask(u32 lanes)
+{
+	return _mm_load_ps((const float *)lane_masks[lanes]);
 }
 
-//return true if any is positive
-__forceinline bool EvalHalfSpaceFAny(float cp12, float cp23, float cp31)
+// Lanes of the quad starting at x that are in [start, end)
+static __forceinline u32 RangeLanes(int x, int start, int end)
 {
-	bool svt = cp12 > 0; //needed for ANY
-	svt |= cp23 > 0;
-	svt |= cp31 > 0;
+	u32 lanes = 0;
+	for (int i = 0; i < 4; i++)
+		if (x + i >= start && x + i < end)
+			lanes |= 1 << i;
+	return lanes;
+}
 
-	return svt;
+static __forceinline void Unpack(__m128i px, __m128 *ch)
+{
+	const __m128i mask = _mm_set1_epi32(0xFF);
+	ch[0] = _mm_cvtepi32_ps(_mm_and_si128(px, mask));
+	ch[1] = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 8), mask));
+	ch[2] = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 16), mask));
+	ch[3] = _mm_cvtepi32_ps(_mm_srli_epi32(px, 24));
 }
 
-__forceinline bool EvalHalfSpaceFAll(float cp12, float cp23, float cp31, float lv12, float lv23, float lv31)
+static __forceinline __m128i Pack(const __m128 *ch)
 {
-	bool lvt = (cp12 - lv12) > 0;
-	lvt &= (cp23 - lv23) > 0;
-	lvt &= (cp31 - lv31) > 0;	//needed for all
+	__m128i r = _mm_cvtps_epi32(ch[0]);
+	__m128i g = _mm_slli_epi32(_mm_cvtps_epi32(ch[1]), 8);
+	__m128i b = _mm_slli_epi32(_mm_cvtps_epi32(ch[2]), 16);
+	__m128i a = _mm_slli_epi32(_mm_cvtps_epi32(ch[3]), 24);
 
-	return lvt;
+	return _mm_or_si128(_mm_or_si128(r, g), _mm_or_si128(b, a));
 }
 
-__forceinline void PlaneMinMax(float& MIN, float& MAX, float DX, float DY, float q)
+static __forceinline __m128 Mix(__m128 a, __m128 b, __m128 f)
 {
-	float q_fp = (q - 1);
-	float v1 = 0;
-	float v2 = q_fp*DY;
-	float v3 = -q_fp*DX;
-	float v4 = q_fp*(DY - DX);
-
-	MIN = min(v1, min(v2, min(v3, v4)));
-	MAX = max(v1, max(v2, max(v3, v4)));
+	return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), f));
 }
 
-struct PlaneStepper
+static __forceinline u32 DepthTest(u32 func, __m128 z, __m128 old)
 {
-	__m128 ddx, ddy;
-	__m128 c;
-
-	void Setup(const Vertex &v1, const Vertex &v2, const Vertex &v3, int minx, int miny, int q
-		, float v1_a, float v2_a, float v3_a
-		, float v1_b, float v2_b, float v3_b
-		, float v1_c, float v2_c, float v3_c
-		, float v1_d, float v2_d, float v3_d)
+	switch (func)
 	{
-		//			float v1_z=v1.z,v2_z=v2.z,v3_z=v3.z;
-		float Aa = ((v3_a - v1_a) * (v2.y - v1.y) - (v2_a - v1_a) * (v3.y - v1.y));
-		float Ba = ((v3.x - v1.x) * (v2_a - v1_a) - (v2.x - v1.x) * (v3_a - v1_a));
-
-		float Ab = ((v3_b - v1_b) * (v2.y - v1.y) - (v2_b - v1_b) * (v3.y - v1.y));
-		float Bb = ((v3.x - v1.x) * (v2_b - v1_b) - (v2.x - v1.x) * (v3_b - v1_b));
-
-		float Ac = ((v3_c - v1_c) * (v2.y - v1.y) - (v2_c - v1_c) * (v3.y - v1.y));
-		float Bc = ((v3.x - v1.x) * (v2_c - v1_c) - (v2.x - v1.x) * (v3_c - v1_c));
-
-		float Ad = ((v3_d - v1_d) * (v2.y - v1.y) - (v2_d - v1_d) * (v3.y - v1.y));
-		float Bd = ((v3.x - v1.x) * (v2_d - v1_d) - (v2.x - v1.x) * (v3_d - v1_d));
-
-		float C = ((v2.x - v1.x) * (v3.y - v1.y) - (v3.x - v1.x) * (v2.y - v1.y));
-		float ddx_s_a = -Aa / C;
-		float ddy_s_a = -Ba / C;
-
-		float ddx_s_b = -Ab / C;
-		float ddy_s_b = -Bb / C;
-
-		float ddx_s_c = -Ac / C;
-		float ddy_s_c = -Bc / C;
-
-		float ddx_s_d = -Ad / C;
-		float ddy_s_d = -Bd / C;
-
-		ddx = _mm_load_ps_r(ddx_s_a, ddx_s_b, ddx_s_c, ddx_s_d);
-		ddy = _mm_load_ps_r(ddy_s_a, ddy_s_b, ddy_s_c, ddy_s_d);
-
-		float c_s_a = (v1_a - ddx_s_a *v1.x - ddy_s_a*v1.y);
-		float c_s_b = (v1_b - ddx_s_b *v1.x - ddy_s_b*v1.y);
-		float c_s_c = (v1_c - ddx_s_c *v1.x - ddy_s_c*v1.y);
-		float c_s_d = (v1_d - ddx_s_d *v1.x - ddy_s_d*v1.y);
-
-		c = _mm_load_ps_r(c_s_a, c_s_b, c_s_c, c_s_d);
-
-		//z = z1 + dzdx * (minx - v1.x) + dzdy * (minx - v1.y);
-		//z = (z1 - dzdx * v1.x - v1.y*dzdy) +  dzdx*inx + dzdy *iny;	
+	case 0:	return 0;
+	case 1:	return _mm_movemask_ps(_mm_cmplt_ps(z, old));
+	case 2:	return _mm_movemask_ps(_mm_cmpeq_ps(z, old));
+	case 3:	return _mm_movemask_ps(_mm_cmple_ps(z, old));
+	case 4:	return _mm_movemask_ps(_mm_cmpgt_ps(z, old));
+	case 5:	return _mm_movemask_ps(_mm_cmpneq_ps(z, old));
+	case 6:	return _mm_movemask_ps(_mm_cmpge_ps(z, old));
+	default: return 0xF;
 	}
+}
 
-	__forceinline __m128 Ip(__m128 x, __m128 y) const
+// other is the destination color for source factors and the source color for destination factors
+static __forceinline void BlendFactors(u32 instr, const __m128 *other, const __m128 *src, const __m128 *dst, __m128 *f)
+{
+	const __m128 one = _mm_set1_ps(1.f);
+	const __m128 scale = _mm_set1_ps(1.f / 255.f);
+	switch (instr)
 	{
-		__m128 p1 = _mm_mul_ps(x, ddx);
-		__m128 p2 = _mm_mul_ps(y, ddy);
-
-		__m128 s1 = _mm_add_ps(p1, p2);
-		return _mm_add_ps(s1, c);
+	case 0:
+		f[0] = f[1] = f[2] = f[3] = _mm_setzero_ps();
+		break;
+	case 1:
+		f[0] = f[1] = f[2] = f[3] = one;
+		break;
+	case 2:
+		for (int i = 0; i < 4; i++)
+			f[i] = _mm_mul_ps(other[i], scale);
+		break;
+	case 3:
+		for (int i = 0; i < 4; i++)
+			f[i] = _mm_sub_ps(one, _mm_mul_ps(other[i], scale));
+		break;
+	case 4:
+		f[0] = f[1] = f[2] = f[3] = _mm_mul_ps(src[3], scale);
+		break;
+	case 5:
+		f[0] = f[1] = f[2] = f[3] = _mm_sub_ps(one, _mm_mul_ps(src[3], scale));
+		break;
+	case 6:
+		f[0] = f[1] = f[2] = f[3] = _mm_mul_ps(dst[3], scale);
+		break;
+	default:
+		f[0] = f[1] = f[2] = f[3] = _mm_sub_ps(one, _mm_mul_ps(dst[3], scale));
+		break;
 	}
+}
 
-	__forceinline __m128 InStep(__m128 bas) const
+static __forceinline int WrapCoord(int c, int size, bool clamp, bool flip)
+{
+	if (clamp)
+		return c < 0 ? 0 : c >= size ? size - 1 : c;
+	if (flip)
 	{
-		return _mm_add_ps(bas, ddx);
+		int period = size * 2;
+		c %= period;
+		if (c < 0)
+			c += period;
+		return c >= size ? period - 1 - c : c;
 	}
-};
+	c %= size;
+	if (c < 0)
+		c += size;
+	return c;
+}
 
-struct IPs
+struct softrend : Renderer
 {
-	PlaneStepper ZUV;
-	PlaneStepper Col;
-
-	void Setup(PolyParam* pp, text_info* texture, const Vertex &v1, const Vertex &v2, const Vertex &v3, int minx, int miny, int q)
+	bool Init() override
 	{
-		u32 w = 0, h = 0;
-		if (texture) {
-			w = texture->width;
-			h = texture->height;
-		}
-
-		ZUV.Setup(v1, v2, v3, minx, miny, q,
-			v1.z, v2.z, v3.z,
-			v1.u * w * v1.z, v2.u * w* v2.z, v3.u * w* v3.z,
-			v1.v * h* v1.z, v2.v * h* v2.z, v3.v * h* v3.z,
-			0, -1, 1);
-
-		Col.Setup(v1, v2, v3, minx, miny, q,
-			v1.col[2], v2.col[2], v3.col[2],
-			v1.col[1], v2.col[1], v3.col[1],
-			v1.col[0], v2.col[0], v3.col[0],
-			v1.col[3], v2.col[3], v3.col[3]
-			);
+		return true;
 	}
-};
-
-
-#define TPL_DECL_pixel template<bool useoldmsk, int alpha_mode, bool pp_UseAlpha, bool pp_Texture, bool pp_IgnoreTexA, int pp_ShadInstr, bool pp_Offset >
-#define TPL_DECL_triangle template<int alpha_mode, bool pp_UseAlpha, bool pp_Texture, bool pp_IgnoreTexA, int pp_ShadInstr, bool pp_Offset >
-
-#define TPL_PRMS_pixel(useoldmsk) <useoldmsk, alpha_mode, pp_UseAlpha, pp_Texture, pp_IgnoreTexA, pp_ShadInstr, pp_Offset >
-#define TPL_PRMS_triangle <alpha_mode, pp_UseAlpha, pp_Texture, pp_IgnoreTexA, pp_ShadInstr, pp_Offset >
 
+	void Resize(int w, int h) override { }
 
-//<alpha_blend, pp_UseAlpha, pp_Texture, pp_IgnoreTexA, pp_ShadInstr, pp_Offset >
-typedef void(*RendtriangleFn)(PolyParam* pp, int vertex_offset, const Vertex &v1, const Vertex &v2, const Vertex &v3, u32* colorBuffer, RECT* area);
-RendtriangleFn RendtriangleFns[3][2][2][2][4][2];
-
-
-__m128i const_setAlpha;
-__m128i shuffle_alpha;
-
-TPL_DECL_pixel
-static void PixelFlush(PolyParam* pp, text_info* texture, __m128 x, __m128 y, u8* cb, __m128 oldmask, IPs& ip)
-{
-	x = _mm_shuffle_ps(x, x, 0);
-	__m128 invW = ip.ZUV.Ip(x, y);
-	__m128 u = ip.ZUV.InStep(invW);
-	__m128 v = ip.ZUV.InStep(u);
-	__m128 ws = ip.ZUV.InStep(v);
-
-	_MM_TRANSPOSE4_PS(invW, u, v, ws);
-
-	u = _mm_div_ps(u, invW);
-	v = _mm_div_ps(v, invW);
-
-	//invW : {z1,z2,z3,z4}
-	//u    : {u1,u2,u3,u4}
-	//v    : {v1,v2,v3,v4}
-	//wx   : {?,?,?,?}
-
-	__m128* zb = (__m128*)&cb[Z_BUFFER_PIXEL_OFFSET * 4];
-
-	__m128 ZMask = _mm_cmpge_ps(invW, *zb);
-	if (useoldmsk)
-		ZMask = _mm_and_ps(oldmask, ZMask);
-	u32 msk = _mm_movemask_ps(ZMask);//0xF
-
-	if (msk == 0)
-		return;
-
-	__m128i rv;
-
+	void Term() override
 	{
-		__m128 a = ip.Col.Ip(x, y);
-		__m128 b = ip.Col.InStep(a);
-		__m128 c = ip.Col.InStep(b);
-		__m128 d = ip.Col.InStep(c);
-
-		//we need : 
-
-		__m128i ab = _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b));
-		__m128i cd = _mm_packs_epi32(_mm_cvttps_epi32(c), _mm_cvttps_epi32(d));
+		textureCache.Clear();
+	}
 
-		rv = _mm_packus_epi16(ab, cd);
+	bool Process(TA_context* ctx) override
+	{
+		if (KillTex)
+			textureCache.Clear();
+		// Before parsing, so that textures referenced by this frame stay alive
+		textureCache.CollectCleanup();
 
-		if (!pp_UseAlpha) {
-			rv = _mm_or_si128(rv, const_setAlpha);
+		if (ctx->rend.isRenderFramebuffer)
+		{
+			RenderFramebuffer();
+			return true;
 		}
+		ctx->rend_inuse.lock();
+		bool parsed = ta_parse_vdrc(ctx);
+		textureCache.UpdateTextures();
 
-		if (pp_Texture) {
-
-			__m128i ui = _mm_cvttps_epi32(u);
-			__m128i vi = _mm_cvttps_epi32(v);
-
-			__m128 uf = _mm_sub_ps(u, _mm_cvtepi32_ps(ui));
-			__m128 vf = _mm_sub_ps(v, _mm_cvtepi32_ps(vi));
-
-			__m128i ufi = _mm_cvttps_epi32(_mm_mul_ps(uf, _mm_set1_ps(256)));
-			__m128i vfi = _mm_cvttps_epi32(_mm_mul_ps(vf, _mm_set1_ps(256)));
-
-			//(int)v<<x+(int)u
-         __m128i textadr;
-#ifdef __SSE4_1__
-			textadr.mm = _mm_add_epi32(_mm_slli_epi32(vi, 16), ui);//texture addresses ! 4x of em !
-#else
-			textadr    = _mm_add_epi32(_mm_slli_epi32(vi, 16), ui);//texture addresses ! 4x of em !
-#endif
-			__m128i textel;
-
-			for (int i = 0; i < 4; i++) {
-				u32 u = textadr.m128i_i16[i * 2 + 0];
-				u32 v = textadr.m128i_i16[i * 2 + 1];
-				
-				__m128i mufi_ = _mm_shuffle_epi32(ufi, _MM_SHUFFLE(0, 0, 0, 0));
-				__m128i mufi_n = _mm_sub_epi32(_mm_set1_epi32(255), mufi_);
-
-				__m128i mvfi_ = _mm_shuffle_epi32(vfi, _MM_SHUFFLE(0, 0, 0, 0));
-				__m128i mvfi_n = _mm_sub_epi32(_mm_set1_epi32(255), mvfi_);
-				
-				ufi = _mm_shuffle_epi32(ufi, _MM_SHUFFLE(0,3,2,1));
-				vfi = _mm_shuffle_epi32(vfi, _MM_SHUFFLE(0,3,2,1));
-
-				u32 pixel;
-				
-#if 0
-				u32 textel_size = 2;
-				
-				u32 pixel00 = decoded_colors[texture->textype][texture->pdata[((u + 1) % texture->width + (v + 1) % texture->height * texture->width)]];
-				u32 pixel01 = decoded_colors[texture->textype][texture->pdata[((u + 0) % texture->width + (v + 1) % texture->height * texture->width)]];
-				u32 pixel10 = decoded_colors[texture->textype][texture->pdata[((u + 1) % texture->width + (v + 0) % texture->height * texture->width)]];
-				u32 pixel11 = decoded_colors[texture->textype][texture->pdata[((u + 0) % texture->width + (v + 0) % texture->height * texture->width)]];
-
-				
-				for (int j = 0; j < 4; j++) {
-				((u8*)&pixel)[j] =
-				
-				(((u8*)&pixel00)[j] * uf.m128_f32[i] + ((u8*)&pixel01)[j] * (1 - uf.m128_f32[i])) * vf.m128_f32[i] + (((u8*)&pixel10)[j] * uf.m128_f32[i] + ((u8*)&pixel11)[j] * (1 - uf.m128_f32[i])) * (1 - vf.m128_f32[i]);
-				}
-#endif
-
-				__m128i px = ((__m128i*)texture->pdata)[((u + 0) % texture->width + (v + 0) % texture->height * texture->width)];
-
-
-				
-				__m128i tex_00 = _mm_cvtepu8_epi32(px);
-				__m128i tex_01 = _mm_cvtepu8_epi32(_mm_shuffle_epi32(px, _MM_SHUFFLE(0, 0, 0, 1)));
-				__m128i tex_10 = _mm_cvtepu8_epi32(_mm_shuffle_epi32(px, _MM_SHUFFLE(0, 0, 0, 2)));
-				__m128i tex_11 = _mm_cvtepu8_epi32(_mm_shuffle_epi32(px, _MM_SHUFFLE(0, 0, 0, 3)));
-
-				tex_00 = _mm_add_epi32(_mm_mullo_epi32(tex_00, mufi_), _mm_mullo_epi32(tex_01, mufi_n));
-				tex_10 = _mm_add_epi32(_mm_mullo_epi32(tex_10, mufi_), _mm_mullo_epi32(tex_10, mufi_n));
-				
-				tex_00 = _mm_add_epi32(_mm_mullo_epi32(tex_00, mvfi_), _mm_mullo_epi32(tex_10, mvfi_n));
-				tex_00 = _mm_srli_epi32(tex_00, 16);
-
-				tex_00 = _mm_packus_epi32(tex_00, tex_00);
-				tex_00 = _mm_packus_epi16(tex_00, tex_00);
-				pixel = _mm_cvtsi128_si32(tex_00);
-#if 0
-				//top    = c0 * a + c1 * (1-a)
-				//bottom = c2 * a + c3 * (1-a)
-
-				//[c0 c2] [c1 c3]
-				//[c0 c2]*a + [c1 c3] * (1 - a) = [cx cy]
-				//[cx * d + cy * (1-d)]
-				//cf
-				_mm_unpacklo_epi8()
-				__m128i y = _mm_cvtps_epi32(x);    // Convert them to 32-bit ints
-				y = _mm_packus_epi32(y, y);        // Pack down to 16 bits
-				y = _mm_packus_epi16(y, y);        // Pack down to 8 bits
-				*(int*)out = _mm_cvtsi128_si32(y); // Store the lower 32 bits
-
-				// 0x000000FF * 0x00010001 = 0x00FF00FF
-				
-				
-
-
-				__m128i px = ((__m128i*)texture->pdata)[((u) & ( texture->width - 1) + (v) & (texture->height-1) * texture->width)];
-
-				__m128i lo_px = _mm_cvtepu8_epi16(px);
-				__m128i hi_px = _mm_cvtepu8_epi16(_mm_shuffle_epi32(px, _MM_SHUFFLE(1, 0, 3, 2)));
-#endif
-				textel.m128i_i32[i] = pixel;
-			}
-
-			if (pp_IgnoreTexA) {
-#ifdef __SSE4_1__
-            textel.mm = _mm_or_si128(textel.mm, const_setAlpha);
-#else
-				textel = _mm_or_si128(textel, const_setAlpha);
-#endif
-			}
-
-			if (pp_ShadInstr == 0){
-					//color.rgb = texcol.rgb;
-					//color.a = texcol.a;
-#ifdef __SSE4_1__
-            rv = textel.mm;
-#else
-            rv = textel;
-#endif
-			}
-			else if (pp_ShadInstr == 1) {
-				//color.rgb *= texcol.rgb;
-				//color.a = texcol.a;
-
-				//color.a = 1
-				rv = _mm_or_si128(rv, const_setAlpha);
-
-				//color *= texcol
-				__m128i lo_rv = _mm_cvtepu8_epi16(rv);
-				__m128i hi_rv = _mm_cvtepu8_epi16(_mm_shuffle_epi32(rv, _MM_SHUFFLE(1, 0, 3, 2)));
-
-#ifdef __SSE4_1__
-            __m128i lo_fb = _mm_cvtepu8_epi16(textel.mm);
-            __m128i hi_fb = _mm_cvtepu8_epi16(_mm_shuffle_epi32(textel.mm, _MM_SHUFFLE(1, 0, 3, 2)));
-#else
-				__m128i lo_fb = _mm_cvtepu8_epi16(textel);
-				__m128i hi_fb = _mm_cvtepu8_epi16(_mm_shuffle_epi32(textel, _MM_SHUFFLE(1, 0, 3, 2)));
-#endif
-
-
-				lo_rv = _mm_mullo_epi16(lo_rv, lo_fb);
-				hi_rv = _mm_mullo_epi16(hi_rv, hi_fb);
-
-				rv = _mm_packus_epi16(_mm_srli_epi16(lo_rv, 8), _mm_srli_epi16(hi_rv, 8));
-			}
-			else if (pp_ShadInstr == 2) {
-				//color.rgb=mix(color.rgb,texcol.rgb,texcol.a);
-
-				// a bit wrong atm, as it also mixes alphas
-				__m128i lo_rv = _mm_cvtepu8_epi16(rv);
-				__m128i hi_rv = _mm_cvtepu8_epi16(_mm_shuffle_epi32(rv, _MM_SHUFFLE(1, 0, 3, 2)));
-
-
-#ifdef __SSE4_1__
-				__m128i lo_fb = _mm_cvtepu8_epi16(textel.mm);
-				__m128i hi_fb = _mm_cvtepu8_epi16(_mm_shuffle_epi32(textel.mm, _MM_SHUFFLE(1, 0, 3, 2)));
-#else
-				__m128i lo_fb = _mm_cvtepu8_epi16(textel);
-				__m128i hi_fb = _mm_cvtepu8_epi16(_mm_shuffle_epi32(textel, _MM_SHUFFLE(1, 0, 3, 2)));
-#endif
+		return parsed && !ctx->rend.Overrun;
+	}
 
-				__m128i lo_rv_alpha = _mm_shuffle_epi8(lo_fb, shuffle_alpha);
-				__m128i hi_rv_alpha = _mm_shuffle_epi8(hi_fb, shuffle_alpha);
+	bool Render() override
+	{
+		if (pvrrc.isRenderFramebuffer)
+			return true;
 
-				__m128i lo_fb_alpha = _mm_sub_epi16(_mm_set1_epi16(255), lo_rv_alpha);
-				__m128i hi_fb_alpha = _mm_sub_epi16(_mm_set1_epi16(255), hi_rv_alpha);
+		if (pvrrc.isRTT)
+		{
+			u32 width = pvrrc.fb_X_CLIP.max - pvrrc.fb_X_CLIP.min + 1;
+			u32 height = pvrrc.fb_Y_CLIP.max - pvrrc.fb_Y_CLIP.min + 1;
+			u32 stride = FB_W_LINESTRIDE.stride * 8;
+			if (stride != 0 && width * 2 > stride)
+				// Happens for Virtua Tennis
+				width = stride / 2;
+			rtt_buffer.resize(width * height);
+			SetTarget(rtt_buffer.data(), width, height, false, 1.f, 1.f);
+		}
+		else
+		{
+			TransformMatrix<false> matrices(pvrrc);
+			glm::vec2 viewport = matrices.GetDreamcastViewport();
+			frame.resize(FRAME_WIDTH * FRAME_HEIGHT);
+			SetTarget(frame.data(), FRAME_WIDTH, FRAME_HEIGHT, true, FRAME_WIDTH / viewport.x, FRAME_HEIGHT / viewport.y);
+		}
+		SetupFrame();
+		BuildTriangles();
+		BinTriangles();
 
+		StartWorkerPool();
+		worker_pool.Run(tiles_x * tiles_y, [this](int tile) {
+			RenderTile(tile);
+		});
 
-				lo_rv = _mm_mullo_epi16(lo_rv, lo_rv_alpha);
-				hi_rv = _mm_mullo_epi16(hi_rv, hi_rv_alpha);
+		if (pvrrc.isRTT)
+		{
+			WriteTextureToVRam(target_width, target_height, (u8 *)rtt_buffer.data(), (u16 *)&vram[FB_W_SOF1 & VRAM_MASK]);
+			return false;
+		}
+		frame_width = FRAME_WIDTH;
+		frame_height = FRAME_HEIGHT;
 
-				lo_fb = _mm_mullo_epi16(lo_fb, lo_fb_alpha);
-				hi_fb = _mm_mullo_epi16(hi_fb, hi_fb_alpha);
+		return true;
+	}
 
-				rv = _mm_packus_epi16(_mm_srli_epi16(_mm_adds_epu16(lo_rv, lo_fb), 8), _mm_srli_epi16(_mm_adds_epu16(hi_rv, hi_fb), 8));
-			}
-			else if (pp_ShadInstr == 3) {
-				//color*=texcol
-				__m128i lo_rv = _mm_cvtepu8_epi16(rv);
-				__m128i hi_rv = _mm_cvtepu8_epi16(_mm_shuffle_epi32(rv, _MM_SHUFFLE(1, 0, 3, 2)));
+	u64 GetTexture(TSP tsp, TCW tcw) override
+	{
+		SoftTexture *tf = textureCache.getTextureCacheData(tsp, tcw);
 
+		if (!tf->created)
+		{
+			tf->Create();
+			tf->created = true;
+		}
+		//update if needed. The texture is decoded after the frame is parsed
+		if (tf->NeedsUpdate())
+			textureCache.QueueUpdate(tf);
+		else if (tf->IsCustomTextureAvailable() && !tf->update_pending)
+			tf->CheckCustomTexture();
 
-				__m128i lo_fb = _mm_cvtepu8_epi16(textel);
-				__m128i hi_fb = _mm_cvtepu8_epi16(_mm_shuffle_epi32(textel, _MM_SHUFFLE(1, 0, 3, 2)));
+		return (u64)(uintptr_t)tf;
+	}
 
+private:
+	void RenderFramebuffer()
+	{
+		if (FB_R_SIZE.fb_x_size == 0 || FB_R_SIZE.fb_y_size == 0)
+			return;
+
+		PixelBuffer<u32> pb;
+		int width;
+		int height;
+		ReadFramebuffer(pb, width, height);
+
+		frame_width = std::min(width, FRAME_WIDTH);
+		frame_height = std::min(height, FRAME_HEIGHT);
+		frame.resize(frame_width * frame_height);
+		for (u32 y = 0; y < frame_height; y++)
+		{
+			const u32 *src = pb.data(0, y);
+			u32 *dst = &frame[y * frame_width];
+			for (u32 x = 0; x < frame_width; x++)
+				dst[x] = (src[x] & 0xFF00) | ((src[x] & 0xFF) << 16) | ((src[x] >> 16) & 0xFF);
+		}
+	}
 
-				lo_rv = _mm_mullo_epi16(lo_rv, lo_fb);
-				hi_rv = _mm_mullo_epi16(hi_rv, hi_fb);
+	void SetTarget(u32 *pixels, u32 width, u32 height, bool swap_rb, float scale_x, float scale_y)
+	{
+		target = pixels;
+		target_width = width;
+		target_height = height;
+		this->swap_rb = swap_rb;
+		this->scale_x = scale_x;
+		this->scale_y = scale_y;
+		tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+		tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+	}
 
-				rv = _mm_packus_epi16(_mm_srli_epi16(lo_rv, 8), _mm_srli_epi16(hi_rv, 8));
-			}
+	void SetupFrame()
+	{
+		//VERT and RAM fog color constants
+		u8* fog_colvert_bgra = (u8*)&FOG_COL_VERT;
+		u8* fog_colram_bgra = (u8*)&FOG_COL_RAM;
+		for (int i = 0; i < 3; i++)
+		{
+			fog_col_vert[i] = fog_colvert_bgra[2 - i];
+			fog_col_ram[i] = fog_colram_bgra[2 - i];
+		}
 
-			if (pp_Offset) {
-				//add offset
-			}
-			
+		//Fog density constant
+		u8* fog_density_reg = (u8*)&FOG_DENSITY;
+		float fog_den_mant = fog_density_reg[1] / 128.0f;  //bit 7 -> x. bit, so [6:0] -> fraction -> /128
+		s32 fog_den_exp = (s8)fog_density_reg[0];
+		fog_density = fog_den_mant * powf(2.0f, fog_den_exp);
+		MakeFogTexture(fog_table);
 
-			//textadr = _mm_add_epi32(textadr, _mm_setr_epi32(tex_addr, tex_addr, tex_addr, tex_addr));
-#ifdef __SSE4_1__
-			//rv = textel.mm; // _mm_xor_si128(rv, textadr);
-#else
-			//rv = textel; // _mm_xor_si128(rv, textadr);
-#endif
+		static const int shifts[4] = { 16, 8, 0, 24 };
+		for (int i = 0; i < 4; i++)
+		{
+			fog_clamp_min[i] = (float)((pvrrc.fog_clamp_min >> shifts[i]) & 0xFF);
+			fog_clamp_max[i] = (float)((pvrrc.fog_clamp_max >> shifts[i]) & 0xFF);
 		}
+		pt_alpha_ref = (float)(PT_ALPHA_REF & 0xFF);
 	}
 
-	//__m128i rv=ip.col;//_mm_xor_si128(_mm_cvtps_epi32(_mm_mul_ps(x,Z.c)),_mm_cvtps_epi32(y));
+	void SetTileClip(u32 val, PolyState& state)
+	{
+		state.clip_mode = TileClipping::Off;
+		if (!settings.rend.Clipping)
+			return;
+
+		u32 clipmode = val >> 28;
+		if (clipmode < 2)
+			return;	//always passes
+
+		int csx = (val & 63) * 32;
+		int cex = ((val >> 6) & 63) * 32 + 32;
+		int csy = ((val >> 12) & 31) * 32;
+		int cey = ((val >> 17) & 31) * 32 + 32;
+		if (csx <= 0 && csy <= 0 && cex >= 640 && cey >= 480)
+			return;
+
+		if (clipmode & 1)
+			state.clip_mode = TileClipping::Inside;   //render stuff outside the region
+		else
+			state.clip_mode = TileClipping::Outside;  //render stuff inside the region
+		state.clip[0] = (int)lroundf(csx * scale_x);
+		state.clip[1] = (int)lroundf(csy * scale_y);
+		state.clip[2] = (int)lroundf(cex * scale_x);
+		state.clip[3] = (int)lroundf(cey * scale_y);
+	}
 
-	//Alpha test
-	if (alpha_mode == 1) {
-		__m128i fb = *(__m128i*)cb;
+	u32 AddState(const PolyParam& pp, u32 listType, bool sorted)
+	{
+		PolyState state;
 
-#if 1
-#ifdef __SSE4_1__
-      m128i mm_rv, mm_fb;
-      mm_rv.mm = rv;
-      mm_fb.mm = fb;
-#endif
-		//ALPHA_TEST
-		for (int i = 0; i < 4; i++)
-      {
-#ifdef __SSE4_1__
-			if (mm_rv.m128i_i8[i * 4 + 3] < PT_ALPHA_REF)
-				mm_rv.m128i_u32[i] = mm_fb.m128i_u32[i];
-#else
-			if (rv.m128i_i8[i * 4 + 3] < PT_ALPHA_REF)
-				rv.m128i_u32[i] = fb.m128i_u32[i];
-#endif
+		state.texture = nullptr;
+		if (pp.pcw.Texture && pp.texid != (u64)-1)
+		{
+			state.texture = (const SoftTexture *)(uintptr_t)pp.texid;
+			if (state.texture->pixels.empty())
+				state.texture = nullptr;
 		}
+		state.palette_index = 0;
+		if (state.texture != nullptr && state.texture->tex_type == TextureType::_8)
+		{
+			if (pp.tcw.PixelFmt == PixelPal4)
+				state.palette_index = pp.tcw.PalSelect << 4;
+			else
+				state.palette_index = (pp.tcw.PalSelect >> 4) << 8;
+		}
+		state.cull_mode = pp.isp.CullMode;
 
-#ifdef __SSE4_1__
-		rv = mm_rv.mm;
-#endif
-#else
-		__m128i ALPHA_TEST = _mm_set1_epi8(PT_ALPHA_REF);
-		__m128i mask = _mm_cmplt_epi8(_mm_subs_epu16(ALPHA_TEST, rv), _mm_setzero_si128());
-
-		mask = _mm_srai_epi32(mask, 31); //FF on the pixels we want to keep
+		if (listType == ListType_Punch_Through || (listType == ListType_Translucent && sorted))
+			state.depth_func = 6;	// Greater or equal
+		else
+			state.depth_func = pp.isp.DepthMode;
+		if (sorted && settings.pvr.Emulation.AlphaSortMode == 0)
+			state.depth_write = false;
+		else
+			// Z Write Disable seems to be ignored for punch-through.
+			state.depth_write = listType == ListType_Punch_Through || !pp.isp.ZWriteDis;
+
+		// Apparently punch-through polys support blending, or at least some combinations
+		state.blend = listType != ListType_Opaque;
+		state.src_instr = pp.tsp.SrcInstr;
+		state.dst_instr = pp.tsp.DstInstr;
+		state.alpha_test = listType == ListType_Punch_Through;
+
+		state.use_alpha = pp.tsp.UseAlpha;
+		state.ignore_tex_a = pp.tsp.IgnoreTexA;
+		state.offset = pp.pcw.Offset;
+		state.gouraud = pp.pcw.Gouraud;
+		state.color_clamp = pp.tsp.ColorClamp && (pvrrc.fog_clamp_min != 0 || pvrrc.fog_clamp_max != 0xffffffff);
+		state.bilinear = pp.tsp.FilterMode != 0 && state.texture != nullptr && state.texture->tex_type != TextureType::_8;
+		state.clamp_u = pp.tsp.ClampU;
+		state.clamp_v = pp.tsp.ClampV;
+		state.flip_u = pp.tsp.FlipU;
+		state.flip_v = pp.tsp.FlipV;
+		state.shad_instr = pp.tsp.ShadInstr;
+		state.fog_ctrl = settings.rend.Fog ? pp.tsp.FogCtrl : 2;
+		SetTileClip(pp.tileclip, state);
+		state.tile_sort = listType == ListType_Translucent && sorted && settings.pvr.Emulation.AlphaSortMode == 0;
+
+		states.push_back(state);
+
+		return states.size() - 1;
+	}
 
-		rv = _mm_or_si128(_mm_and_si128(rv, mask), _mm_andnot_si128(mask, cb));
-#endif
+	void AddTriangle(const Vertex& v1, const Vertex& v2, const Vertex& v3, u32 stateIndex, u32 pass)
+	{
+		const PolyState& state = states[stateIndex];
+		const float x[3] = { v1.x * scale_x, v2.x * scale_x, v3.x * scale_x };
+		const float y[3] = { v1.y * scale_y, v2.y * scale_y, v3.y * scale_y };
+
+		float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+		if (!std::isfinite(area) || area == 0.f)
+			return;
+		// Cull if negative or positive
+		if (state.cull_mode >= 2 && ((state.cull_mode & 1) ? area > 0.f : area < 0.f))
+			return;
+
+		float minx = std::max(std::min(x[0], std::min(x[1], x[2])), 0.f);
+		float maxx = std::min(std::max(x[0], std::max(x[1], x[2])), (float)target_width);
+		float miny = std::max(std::min(y[0], std::min(y[1], y[2])), 0.f);
+		float maxy = std::min(std::max(y[0], std::max(y[1], y[2])), (float)target_height);
+		if (minx >= maxx || miny >= maxy)
+			return;
+
+		triangles.emplace_back();
+		Triangle& t = triangles.back();
+		t.left = (int)minx;
+		t.right = std::min((int)ceilf(maxx), (int)target_width);
+		t.top = (int)miny;
+		t.bottom = std::min((int)ceilf(maxy), (int)target_height);
+		t.state = stateIndex;
+		t.pass = pass;
+		t.tile_sort = state.tile_sort;
+		t.min_z = std::min(v1.z, std::min(v2.z, v3.z));
+
+		const float sign = area > 0.f ? 1.f : -1.f;
+		t.top_left = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			int j = i == 2 ? 0 : i + 1;
+			float a = (y[i] - y[j]) * sign;
+			float b = (x[j] - x[i]) * sign;
+			t.edge_a[i] = a;
+			t.edge_b[i] = b;
+			t.edge_c[i] = -(a * x[i] + b * y[i]);
+			if (a > 0.f || (a == 0.f && b > 0.f))
+				t.top_left |= 1 << i;
+		}
 
-	}
-	else if (alpha_mode == 2) {
-		__m128i fb = *(__m128i*)cb;
-#if 0
-		for (int i = 0; i < 16; i += 4) {
-			u8 src_blend[4] = { rv.m128i_u8[i + 3], rv.m128i_u8[i + 3], rv.m128i_u8[i + 3], rv.m128i_u8[i + 3] };
-			u8 dst_blend[4] = { 255 - rv.m128i_u8[i + 3], 255 - rv.m128i_u8[i + 3], 255 - rv.m128i_u8[i + 3], 255 - rv.m128i_u8[i + 3] };
-			for (int j = 0; j < 4; j++) {
-				rv.m128i_u8[i + j] = (rv.m128i_u8[i + j] * src_blend[j]) / 256 + (fb.m128i_u8[i + j] * dst_blend[j]) / 256;
+		// Attributes are interpolated as a/w for perspective correction
+		t.z.Setup(x, y, v1.z, v2.z, v3.z);
+		if (state.texture != nullptr)
+		{
+			t.u.Setup(x, y, v1.u * v1.z, v2.u * v2.z, v3.u * v3.z);
+			t.v.Setup(x, y, v1.v * v1.z, v2.v * v2.z, v3.v * v3.z);
+		}
+		for (int i = 0; i < 4; i++)
+		{
+			if (state.gouraud)
+			{
+				t.base[i].Setup(x, y, v1.col[i] * v1.z, v2.col[i] * v2.z, v3.col[i] * v3.z);
+				if (state.offset)
+					t.offs[i].Setup(x, y, v1.vtx_spc[i] * v1.z, v2.vtx_spc[i] * v2.z, v3.vtx_spc[i] * v3.z);
+			}
+			else
+			{
+				// Flat shading uses the last vertex
+				t.base[i].SetConstant(v3.col[i]);
+				t.offs[i].SetConstant(v3.vtx_spc[i]);
 			}
 		}
-#else
-
-
-		__m128i lo_rv = _mm_cvtepu8_epi16(rv);
-		__m128i hi_rv = _mm_cvtepu8_epi16(_mm_shuffle_epi32(rv, _MM_SHUFFLE(1, 0, 3, 2)));
-
-
-		__m128i lo_fb = _mm_cvtepu8_epi16(fb);
-		__m128i hi_fb = _mm_cvtepu8_epi16(_mm_shuffle_epi32(fb, _MM_SHUFFLE(1, 0, 3, 2)));
-
-		__m128i lo_rv_alpha = _mm_shuffle_epi8(lo_rv, shuffle_alpha);
-		__m128i hi_rv_alpha = _mm_shuffle_epi8(hi_rv, shuffle_alpha);
-
-		__m128i lo_fb_alpha = _mm_sub_epi16(_mm_set1_epi16(255), lo_rv_alpha);
-		__m128i hi_fb_alpha = _mm_sub_epi16(_mm_set1_epi16(255), hi_rv_alpha);
-
-
-		lo_rv = _mm_mullo_epi16(lo_rv, lo_rv_alpha);
-		hi_rv = _mm_mullo_epi16(hi_rv, hi_rv_alpha);
-
-		lo_fb = _mm_mullo_epi16(lo_fb, lo_fb_alpha);
-		hi_fb = _mm_mullo_epi16(hi_fb, hi_fb_alpha);
-
-		rv = _mm_packus_epi16(_mm_srli_epi16(_mm_adds_epu16(lo_rv, lo_fb), 8), _mm_srli_epi16(_mm_adds_epu16(hi_rv, hi_fb), 8));
-#endif
 	}
 
-	if (msk != 0xF)
+	void AddTriangles(const u32 *indices, u32 count, bool strip, u32 state, u32 pass)
 	{
-		rv = _mm_and_si128(rv, *(__m128i*)&ZMask);
-		rv = _mm_or_si128(_mm_andnot_si128(*(__m128i*)&ZMask, *(__m128i*)cb), rv);
-
-		invW = _mm_and_ps(invW, ZMask);
-		invW = _mm_or_ps(_mm_andnot_ps(ZMask, *zb), invW);
+		const Vertex *vertices = pvrrc.verts.head();
+		const u32 step = strip ? 1 : 3;
 
+		for (u32 i = 0; i + 2 < count; i += step)
+		{
+			const Vertex *v1 = &vertices[indices[i]];
+			const Vertex *v2 = &vertices[indices[i + 1]];
+			const Vertex *v3 = &vertices[indices[i + 2]];
+			// Odd triangles of a strip have their winding reversed
+			if (strip && (i & 1))
+				std::swap(v1, v2);
+			AddTriangle(*v1, *v2, *v3, state, pass);
+		}
 	}
-	*zb = invW;
-	*(__m128i*)cb = rv;
-}
 
-//u32 nok,fok;
-TPL_DECL_triangle
-static void Rendtriangle(PolyParam* pp, int vertex_offset, const Vertex &v1, const Vertex &v2, const Vertex &v3, u32* colorBuffer, RECT* area)
-{
-	text_info texture = { 0 };
-
-	if (pp_Texture) {
+	void AddList(const List<PolyParam>& list, u32 first, u32 end, u32 listType, bool sorted, u32 pass)
+	{
+		const PolyParam *params = list.head();
+		const u32 *indices = pvrrc.idx.head();
 
-		#pragma omp critical (texture_lookup)
+		for (u32 i = first; i < end; i++)
 		{
-			texture = raw_GetTexture(pp->tsp, pp->tcw);
+			const PolyParam& pp = params[i];
+			if (pp.count < 3)
+				continue;
+			u32 state = AddState(pp, listType, sorted);
+			AddTriangles(indices + pp.first, pp.count, true, state, pass);
 		}
-			
 	}
 
-	const int stride_bytes = STRIDE_PIXEL_OFFSET * 4;
-	//Plane equation
-
-
-	// 28.4 fixed-point coordinates
-	const float Y1 = v1.y;// iround(16.0f * v1.y);
-	const float Y2 = v2.y;// iround(16.0f * v2.y);
-	const float Y3 = v3.y;// iround(16.0f * v3.y);
-
-	const float X1 = v1.x;// iround(16.0f * v1.x);
-	const float X2 = v2.x;// iround(16.0f * v2.x);
-	const float X3 = v3.x;// iround(16.0f * v3.x);
-
-	int sgn = 1;
-
-	// Deltas
+	void BuildTriangles()
 	{
-		//area: (X1-X3)*(Y2-Y3)-(Y1-Y3)*(X2-X3)
-		float area = ((X1 - X3)*(Y2 - Y3) - (Y1 - Y3)*(X2 - X3));
-
-		if (area>0)
-			sgn = -1;
-
-		if (pp->isp.CullMode != 0) {
-			float abs_area = fabsf(area);
+		triangles.clear();
+		states.clear();
+		pass_z_clear.clear();
 
-			if (abs_area < FPU_CULL_VAL)
-				return;
+		RenderPass previous_pass = {};
+		for (int render_pass = 0; render_pass < pvrrc.render_passes.used(); render_pass++)
+		{
+			const RenderPass& current_pass = pvrrc.render_passes.head()[render_pass];
+			pass_z_clear.push_back(current_pass.z_clear);
 
-			if (pp->isp.CullMode >= 2) {
-				u32 mode = vertex_offset ^ pp->isp.CullMode & 1;
+			AddList(pvrrc.global_param_op, previous_pass.op_count, current_pass.op_count, ListType_Opaque, false, render_pass);
+			AddList(pvrrc.global_param_pt, previous_pass.pt_count, current_pass.pt_count, ListType_Punch_Through, false, render_pass);
 
-				if (
-					(mode == 0 && area < 0) ||
-					(mode == 1 && area > 0)) {
-					return;
+			const u32 first = previous_pass.tr_count;
+			const u32 count = current_pass.tr_count - previous_pass.tr_count;
+			if (current_pass.autosort)
+			{
+				if (settings.pvr.Emulation.AlphaSortMode == 0)
+				{
+					// Triangles are added in submission order and sorted in each tile by RenderTile
+					const u32 sorted_start = triangles.size();
+					AddList(pvrrc.global_param_tr, first, current_pass.tr_count, ListType_Translucent, true, render_pass);
+					render_stage_stats.sorts++;
+					render_stage_stats.sorted_triangles += triangles.size() - sorted_start;
+				}
+				else
+				{
+					SortPParams(first, count);
+					AddList(pvrrc.global_param_tr, first, current_pass.tr_count, ListType_Translucent, true, render_pass);
 				}
 			}
+			else
+				AddList(pvrrc.global_param_tr, first, current_pass.tr_count, ListType_Translucent, false, render_pass);
+
+			previous_pass = current_pass;
 		}
 	}
 
-	const float DX12 = sgn*(X1 - X2);
-	const float DX23 = sgn*(X2 - X3);
-	const float DX31 = sgn*(X3 - X1);
-
-	const float DY12 = sgn*(Y1 - Y2);
-	const float DY23 = sgn*(Y2 - Y3);
-	const float DY31 = sgn*(Y3 - Y1);
-
-	// Fixed-point deltas
-	const float FDX12 = DX12;// << 4;
-	const float FDX23 = DX23;// << 4;
-	const float FDX31 = DX31;// << 4;
-
-	const float FDY12 = DY12;// << 4;
-	const float FDY23 = DY23;// << 4;
-	const float FDY31 = DY31;// << 4;
-
-	// Block size, standard 4x4 (must be power of two)
-	const int q = 4;
-
-	// Bounding rectangle
-	int minx = iround(mmin(X1, X2, X3, area->left));// +0xF) >> 4;
-	int miny = iround(mmin(Y1, Y2, Y3, area->top));// +0xF) >> 4;
-
-	// Start in corner of block
-	minx &= ~(q - 1);
-	miny &= ~(q - 1);
-
-	int spanx = iround(mmax(X1 + 0.5f, X2 + 0.5f, X3 + 0.5f, area->right)) - minx;
-	int spany = iround(mmax(Y1 + 0.5f, Y2 + 0.5f, Y3 + 0.5f, area->bottom)) - miny;
-
-	//Inside scissor area?
-	if (spanx < 0 || spany < 0)
-		return;
-
-
-	// Half-edge constants
-	float C1 = DY12 * X1 - DX12 * Y1;
-	float C2 = DY23 * X2 - DX23 * Y2;
-	float C3 = DY31 * X3 - DX31 * Y3;
-
-	// Correct for fill convention
-	if (DY12 < 0 || (DY12 == 0 && DX12 > 0)) C1++;
-	if (DY23 < 0 || (DY23 == 0 && DX23 > 0)) C2++;
-	if (DY31 < 0 || (DY31 == 0 && DX31 > 0)) C3++;
-
-	float MAX_12, MAX_23, MAX_31, MIN_12, MIN_23, MIN_31;
-
-	PlaneMinMax(MIN_12, MAX_12, DX12, DY12, q);
-	PlaneMinMax(MIN_23, MAX_23, DX23, DY23, q);
-	PlaneMinMax(MIN_31, MAX_31, DX31, DY31, q);
-
-	const float FDqX12 = FDX12 * q;
-	const float FDqX23 = FDX23 * q;
-	const float FDqX31 = FDX31 * q;
+	static bool TileOverlaps(const Triangle& t, int tile_x, int tile_y)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			// Test the tile corner that is the most inside the edge
+			float x = tile_x + (t.edge_a[i] > 0.f ? TILE_SIZE - 0.5f : 0.5f);
+			float y = tile_y + (t.edge_b[i] > 0.f ? TILE_SIZE - 0.5f : 0.5f);
+			if (t.edge_a[i] * x + t.edge_b[i] * y + t.edge_c[i] < 0.f)
+				return false;
+		}
+		return true;
+	}
 
-	const float FDqY12 = FDY12 * q;
-	const float FDqY23 = FDY23 * q;
-	const float FDqY31 = FDY31 * q;
+	// Min z of the triangle in the tile. The z plane is minimized over the part of
+	// the bounding box in the tile, so this is never more than the exact value.
+	static float TileMinZ(const Triangle& t, int tile_x, int tile_y)
+	{
+		const float left = (float)std::max(t.left, tile_x);
+		const float right = (float)std::min(t.right, tile_x + TILE_SIZE);
+		const float top = (float)std::max(t.top, tile_y);
+		const float bottom = (float)std::min(t.bottom, tile_y + TILE_SIZE);
+		const float z = t.z.c + std::min(t.z.ddx * left, t.z.ddx * right) + std::min(t.z.ddy * top, t.z.ddy * bottom);
 
-	const float FDX12mq = FDX12 + FDY12*q;
-	const float FDX23mq = FDX23 + FDY23*q;
-	const float FDX31mq = FDX31 + FDY31*q;
+		return std::max(t.min_z, z);
+	}
 
-	float hs12 = C1 + FDX12 * (miny + 0.5f) - FDY12 * (minx + 0.5f) + FDqY12 - MIN_12;
-	float hs23 = C2 + FDX23 * (miny + 0.5f) - FDY23 * (minx + 0.5f) + FDqY23 - MIN_23;
-	float hs31 = C3 + FDX31 * (miny + 0.5f) - FDY31 * (minx + 0.5f) + FDqY31 - MIN_31;
+	// Builds the list of triangles touching each tile, in drawing order
+	void BinTriangles()
+	{
+		const u32 tile_count = tiles_x * tiles_y;
+		if (bins.size() < tile_count)
+			bins.resize(tile_count);
+		for (u32 i = 0; i < tile_count; i++)
+			bins[i].clear();
 
-	MAX_12 -= MIN_12;
-	MAX_23 -= MIN_23;
-	MAX_31 -= MIN_31;
+		for (u32 i = 0; i < triangles.size(); i++)
+		{
+			const Triangle& t = triangles[i];
+			for (int ty = t.top / TILE_SIZE; ty <= (t.bottom - 1) / TILE_SIZE; ty++)
+				for (int tx = t.left / TILE_SIZE; tx <= (t.right - 1) / TILE_SIZE; tx++)
+					if (TileOverlaps(t, tx * TILE_SIZE, ty * TILE_SIZE))
+						bins[ty * tiles_x + tx].push_back(i);
+		}
+	}
 
-	float C1_pm = MIN_12;
-	float C2_pm = MIN_23;
-	float C3_pm = MIN_31;
+	float FogFactor(float invW) const
+	{
+		float z = invW * fog_density;
+		if (!(z >= 1.f))
+			z = 1.f;
+		else if (z > 255.9999f)
+			z = 255.9999f;
+		int exp;
+		float m = frexpf(z, &exp) * 32.f - 16.f;
+		int idx = (int)m + (exp - 1) * 16;
+		float frac = m - (int)m;
+
+		return (fog_table[idx + 128] * (1.f - frac) + fog_table[idx] * frac) / 255.f;
+	}
 
+	__m128 FogFactors(__m128 invW) const
+	{
+		DECL_ALIGN(16) float f[4];
+		_mm_store_ps(f, invW);
+		for (int i = 0; i < 4; i++)
+			f[i] = FogFactor(f[i]);
+		return _mm_load_ps(f);
+	}
 
-	u8* cb_y = (u8*)colorBuffer;
-	cb_y += miny*stride_bytes + minx*(q * 4);
+	u32 Texel(const PolyState& state, int x, int y) const
+	{
+		const SoftTexture *texture = state.texture;
+		x = WrapCoord(x, texture->width, state.clamp_u, state.flip_u);
+		y = WrapCoord(y, texture->height, state.clamp_v, state.flip_v);
+		u32 texel = texture->pixels[y * texture->width + x];
+		if (texture->tex_type == TextureType::_8)
+			return palette32_ram[(state.palette_index + texel) & 1023];
+		return texel;
+	}
 
-   DECL_ALIGN(64) IPs ip;
+	void SampleTexture(const PolyState& state, __m128 u, __m128 v, u32 lanes, __m128 *texcol) const
+	{
+		DECL_ALIGN(16) float fu[4];
+		DECL_ALIGN(16) float fv[4];
+		_mm_store_ps(fu, _mm_mul_ps(u, _mm_set1_ps((float)state.texture->width)));
+		_mm_store_ps(fv, _mm_mul_ps(v, _mm_set1_ps((float)state.texture->height)));
 
-	ip.Setup(pp, &texture, v1, v2, v3, minx, miny, q);
-	
-	
-	__m128 y_ps = _mm_broadcast_float(miny);
-	__m128 minx_ps = _mm_load_scaled_float(minx - q, 1);
-	static DECL_ALIGN(16) float ones_ps[4] = { 1, 1, 1, 1 };
-	static DECL_ALIGN(16) float q_ps[4] = { q, q, q, q };
+		if (!state.bilinear)
+		{
+			DECL_ALIGN(16) u32 texels[4] = {};
+			for (int i = 0; i < 4; i++)
+				if (lanes & (1 << i))
+					texels[i] = Texel(state, (int)floorf(fu[i]), (int)floorf(fv[i]));
+			Unpack(_mm_load_si128((const __m128i *)texels), texcol);
+			return;
+		}
+		DECL_ALIGN(16) u32 t00[4] = {};
+		DECL_ALIGN(16) u32 t10[4] = {};
+		DECL_ALIGN(16) u32 t01[4] = {};
+		DECL_ALIGN(16) u32 t11[4] = {};
+		DECL_ALIGN(16) float wx[4] = {};
+		DECL_ALIGN(16) float wy[4] = {};
+		for (int i = 0; i < 4; i++)
+		{
+			if (!(lanes & (1 << i)))
+				continue;
+			float x = fu[i] - 0.5f;
+			float y = fv[i] - 0.5f;
+			float x0 = floorf(x);
+			float y0 = floorf(y);
+			wx[i] = x - x0;
+			wy[i] = y - y0;
+			int ix = (int)x0;
+			int iy = (int)y0;
+			t00[i] = Texel(state, ix, iy);
+			t10[i] = Texel(state, ix + 1, iy);
+			t01[i] = Texel(state, ix, iy + 1);
+			t11[i] = Texel(state, ix + 1, iy + 1);
+		}
+		__m128 c00[4], c10[4], c01[4], c11[4];
+		Unpack(_mm_load_si128((const __m128i *)t00), c00);
+		Unpack(_mm_load_si128((const __m128i *)t10), c10);
+		Unpack(_mm_load_si128((const __m128i *)t01), c01);
+		Unpack(_mm_load_si128((const __m128i *)t11), c11);
+		const __m128 fx = _mm_load_ps(wx);
+		const __m128 fy = _mm_load_ps(wy);
+		for (int i = 0; i < 4; i++)
+			texcol[i] = Mix(Mix(c00[i], c10[i], fx), Mix(c01[i], c11[i], fx), fy);
+	}
 
-	// Loop through blocks
-	for (int y = spany; y > 0; y -= q)
+	// Shades four pixels. Colors are kept in the [0, 255] range.
+	void PixelFlush(const Triangle& t, const PolyState& state, __m128 x, __m128 y, u32 lanes, u32 *cb, float *zb) const
 	{
-		float Xhs12 = hs12;
-		float Xhs23 = hs23;
-		float Xhs31 = hs31;
-		u8* cb_x = cb_y;
-		__m128 x_ps = minx_ps;
-		for (int x = spanx; x > 0; x -= q)
+		const __m128 invW = t.z.Ip(x, y);
+		const __m128 old_z = _mm_load_ps(zb);
+		lanes &= DepthTest(state.depth_func, invW, old_z);
+		if (lanes == 0)
+			return;
+		const __m128 w = _mm_div_ps(_mm_set1_ps(1.f), invW);
+		const __m128 scale = _mm_set1_ps(1.f / 255.f);
+
+		__m128 color[4];
+		__m128 offs[4];
+		for (int i = 0; i < 4; i++)
 		{
-			Xhs12 -= FDqY12;
-			Xhs23 -= FDqY23;
-			Xhs31 -= FDqY31;
-			x_ps = _mm_add_ps(x_ps, *(__m128*)q_ps);
-
-			// Corners of block
-			bool any = EvalHalfSpaceFAny(Xhs12, Xhs23, Xhs31);
-
-			// Skip block when outside an edge
-			if (!any)
+			if (state.gouraud)
 			{
-				cb_x += q*q * 4;
-				continue;
+				color[i] = _mm_mul_ps(t.base[i].Ip(x, y), w);
+				if (state.offset)
+					offs[i] = _mm_mul_ps(t.offs[i].Ip(x, y), w);
 			}
+			else
+			{
+				color[i] = _mm_set1_ps(t.base[i].c);
+				offs[i] = _mm_set1_ps(t.offs[i].c);
+			}
+		}
+		if (!state.use_alpha)
+			color[3] = _mm_set1_ps(255.f);
+		if (state.fog_ctrl == 3)
+		{
+			for (int i = 0; i < 3; i++)
+				color[i] = _mm_set1_ps(fog_col_ram[i]);
+			color[3] = _mm_mul_ps(FogFactors(invW), _mm_set1_ps(255.f));
+		}
 
-			bool all = EvalHalfSpaceFAll(Xhs12, Xhs23, Xhs31, MAX_12, MAX_23, MAX_31);
-
-			// Accept whole block when totally covered
-			if (all)
+		if (state.texture != nullptr)
+		{
+			__m128 texcol[4];
+			SampleTexture(state, _mm_mul_ps(t.u.Ip(x, y), w), _mm_mul_ps(t.v.Ip(x, y), w), lanes, texcol);
+			if (state.ignore_tex_a)
+				texcol[3] = _mm_set1_ps(255.f);
+			if (state.alpha_test)
 			{
-				__m128 yl_ps = y_ps;
-				for (int iy = q; iy > 0; iy--)
-				{
-					PixelFlush TPL_PRMS_pixel(false) (pp, &texture, x_ps, yl_ps, cb_x, x_ps, ip);
-					yl_ps = _mm_add_ps(yl_ps, *(__m128*)ones_ps);
-					cb_x += sizeof(__m128);
-				}
+				lanes &= ~_mm_movemask_ps(_mm_cmplt_ps(texcol[3], _mm_set1_ps(pt_alpha_ref)));
+				if (lanes == 0)
+					return;
 			}
-			else // Partially covered block
+			switch (state.shad_instr)
 			{
-				float CY1 = C1_pm + Xhs12;
-				float CY2 = C2_pm + Xhs23;
-				float CY3 = C3_pm + Xhs31;
-
-				__m128 pfdx12 = _mm_broadcast_float(FDX12);
-				__m128 pfdx23 = _mm_broadcast_float(FDX23);
-				__m128 pfdx31 = _mm_broadcast_float(FDX31);
-
-				__m128 pcy1 = _mm_load_scaled_float(CY1, -FDY12);
-				__m128 pcy2 = _mm_load_scaled_float(CY2, -FDY23);
-				__m128 pcy3 = _mm_load_scaled_float(CY3, -FDY31);
-
-				__m128 pzero = _mm_setzero_ps();
-
-				//bool ok=false;
-				__m128 yl_ps = y_ps;
-
-				for (int iy = q; iy > 0; iy--)
+			case 0:
+				for (int i = 0; i < 4; i++)
+					color[i] = texcol[i];
+				break;
+			case 1:
+				for (int i = 0; i < 3; i++)
+					color[i] = _mm_mul_ps(color[i], _mm_mul_ps(texcol[i], scale));
+				color[3] = texcol[3];
+				break;
+			case 2:
 				{
-					__m128 mask1 = _mm_cmple_ps(pcy1, pzero);
-					__m128 mask2 = _mm_cmple_ps(pcy2, pzero);
-					__m128 mask3 = _mm_cmple_ps(pcy3, pzero);
-					__m128 summary = _mm_or_ps(mask3, _mm_or_ps(mask2, mask1));
-
-					__m128i a = _mm_cmpeq_epi32((__m128i&)summary, (__m128i&)pzero);
-					int msk = _mm_movemask_ps((__m128&)a);
-
-					if (msk != 0)
-					{
-						if (msk != 0xF)
-							PixelFlush TPL_PRMS_pixel(true) (pp, &texture, x_ps, yl_ps, cb_x, *(__m128*)&a, ip);
-						else
-							PixelFlush TPL_PRMS_pixel(false) (pp, &texture, x_ps, yl_ps, cb_x, *(__m128*)&a, ip);
-					}
-
-					yl_ps = _mm_add_ps(yl_ps, *(__m128*)ones_ps);
-					cb_x += sizeof(__m128);
-
-					//CY1 += FDX12mq;
-					//CY2 += FDX23mq;
-					//CY3 += FDX31mq;
-					pcy1 = _mm_add_ps(pcy1, pfdx12);
-					pcy2 = _mm_add_ps(pcy2, pfdx23);
-					pcy3 = _mm_add_ps(pcy3, pfdx31);
+					const __m128 alpha = _mm_mul_ps(texcol[3], scale);
+					for (int i = 0; i < 3; i++)
+						color[i] = Mix(color[i], texcol[i], alpha);
 				}
-				/*
-				if (!ok)
-				{
-				nok++;
-				}
-				else
-				{
-				fok++;
-				}*/
+				break;
+			default:
+				for (int i = 0; i < 4; i++)
+					color[i] = _mm_mul_ps(color[i], _mm_mul_ps(texcol[i], scale));
+				break;
 			}
+			if (state.offset)
+				for (int i = 0; i < 3; i++)
+					color[i] = _mm_add_ps(color[i], offs[i]);
 		}
-	next_y:
-		hs12 += FDqX12;
-		hs23 += FDqX23;
-		hs31 += FDqX31;
-		cb_y += stride_bytes*q;
-		y_ps = _mm_add_ps(y_ps, *(__m128*)q_ps);
-	}
-}
-
-
-struct softrend : Renderer
-{
-	virtual bool Process(TA_context* ctx) {
-		//disable RTTs for now ..
-		if (ctx->rend.isRTT)
-			return false;
-
-		ctx->rend_inuse.Lock();
-
-		if (!ta_parse_vdrc(ctx))
-			return false;
-
-		return true;
-	}
-
-	
 
-	template <int alpha_mode>
-	void RenderParamList(List<PolyParam>* param_list, RECT* area) {
-		
-		Vertex* verts = pvrrc.verts.head();
-		u16* idx = pvrrc.idx.head();
+		if (state.color_clamp)
+			for (int i = 0; i < 4; i++)
+				color[i] = _mm_max_ps(_mm_min_ps(color[i], _mm_set1_ps(fog_clamp_max[i])), _mm_set1_ps(fog_clamp_min[i]));
 
-		PolyParam* params = param_list->head();
-		int param_count = param_list->used();
-
-		for (int i = 0; i < param_count; i++)
+		if (state.fog_ctrl == 0)
+		{
+			const __m128 fog = FogFactors(invW);
+			for (int i = 0; i < 3; i++)
+				color[i] = Mix(color[i], _mm_set1_ps(fog_col_ram[i]), fog);
+		}
+		else if (state.fog_ctrl == 1 && state.offset)
 		{
-			int vertex_count = params[i].count - 2;
+			const __m128 fog = _mm_mul_ps(offs[3], scale);
+			for (int i = 0; i < 3; i++)
+				color[i] = Mix(color[i], _mm_set1_ps(fog_col_vert[i]), fog);
+		}
+		if (state.alpha_test)
+			color[3] = _mm_set1_ps(255.f);
 
-			u16* poly_idx = &idx[params[i].first];
+		for (int i = 0; i < 4; i++)
+			color[i] = _mm_min_ps(_mm_max_ps(color[i], _mm_setzero_ps()), _mm_set1_ps(255.f));
 
-			for (int v = 0; v < vertex_count; v++) {
-				////<alpha_blend, pp_UseAlpha, pp_Texture, pp_IgnoreTexA, pp_ShadInstr, pp_Offset >
-				RendtriangleFn fn = RendtriangleFns[alpha_mode][params[i].tsp.UseAlpha][params[i].pcw.Texture][params[i].tsp.IgnoreTexA][params[i].tsp.ShadInstr][params[i].pcw.Offset];
+		const __m128 mask = LaneMask(lanes);
+		if (state.depth_write)
+			_mm_store_ps(zb, _mm_or_ps(_mm_and_ps(mask, invW), _mm_andnot_ps(mask, old_z)));
 
-				fn(&params[i], v, verts[poly_idx[v]], verts[poly_idx[v + 1]], verts[poly_idx[v + 2]], render_buffer, area);
+		const __m128i old_color = _mm_load_si128((const __m128i *)cb);
+		if (state.blend)
+		{
+			__m128 dst[4];
+			__m128 src_factor[4];
+			__m128 dst_factor[4];
+			Unpack(old_color, dst);
+			BlendFactors(state.src_instr, dst, color, dst, src_factor);
+			BlendFactors(state.dst_instr, color, color, dst, dst_factor);
+			for (int i = 0; i < 4; i++)
+			{
+				color[i] = _mm_add_ps(_mm_mul_ps(color[i], src_factor[i]), _mm_mul_ps(dst[i], dst_factor[i]));
+				color[i] = _mm_min_ps(color[i], _mm_set1_ps(255.f));
 			}
 		}
+		const __m128i imask = _mm_castps_si128(mask);
+		_mm_store_si128((__m128i *)cb, _mm_or_si128(_mm_and_si128(imask, Pack(color)), _mm_andnot_si128(imask, old_color)));
 	}
-	virtual bool Render() {
-		bool is_rtt = pvrrc.isRTT;
-
-		memset(render_buffer, 0, sizeof(render_buffer));
-
-		if (pvrrc.verts.used()<3)
-			return false;
-
-      if (pvrrc.render_passes.head()[0].autosort)
-			SortPParams(0, pvrrc.global_param_tr.used());
 
-		int tcount = omp_get_num_procs() - 1;
-		if (tcount == 0) tcount = 1;
-		if (tcount > settings.pvr.MaxThreads) tcount = settings.pvr.MaxThreads;
-#pragma omp parallel num_threads(tcount)
+	static __forceinline u32 EdgeLanes(const Triangle& t, __m128 x, __m128 y)
+	{
+		u32 lanes = 0xF;
+		for (int i = 0; i < 3; i++)
 		{
-			int thd = omp_get_thread_num();
-			int y_offs = 480 % omp_get_num_threads();
-			int y_thd = 480 / omp_get_num_threads();
-			int y_start = (!!thd) * y_offs + y_thd * thd;
-			int y_end =  y_offs + y_thd * (thd + 1);
-
-			RECT area = { 0, y_start, 640, y_end };
-			RenderParamList<0>(&pvrrc.global_param_op, &area);
-			RenderParamList<1>(&pvrrc.global_param_pt, &area);
-			RenderParamList<2>(&pvrrc.global_param_tr, &area);
+			__m128 e = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(t.edge_a[i])), _mm_mul_ps(y, _mm_set1_ps(t.edge_b[i]))),
+					_mm_set1_ps(t.edge_c[i]));
+			if (t.top_left & (1 << i))
+				lanes &= _mm_movemask_ps(_mm_cmpge_ps(e, _mm_setzero_ps()));
+			else
+				lanes &= _mm_movemask_ps(_mm_cmpgt_ps(e, _mm_setzero_ps()));
 		}
-
-		
-		
-
-		/*
-		for (int y = 0; y < 480; y++) {
-			for (int x = 0; x < 640; x++) {
-				color_buffer[x + y * 640] = rand();
-			}
-		} */
-
-		return !is_rtt;
+		return lanes;
 	}
 
-	HWND hWnd;
-	HBITMAP hBMP = 0, holdBMP;
-	HDC hmem;
-	
-
-
-	virtual bool Init() {
-		const_setAlpha = _mm_set1_epi32(0xFF000000);
-		u8 ushuffle[] = { 0x0E, 0x80, 0x0E, 0x80, 0x0E, 0x80, 0x0E, 0x80, 0x06, 0x80, 0x06, 0x80, 0x06, 0x80, 0x06, 0x80};
-		memcpy(&shuffle_alpha, ushuffle, sizeof(shuffle_alpha));
-
-		#define REP_16(x) ((x)* 16 + (x))
-		#define REP_32(x) ((x)* 8 + (x)/4)
-		#define REP_64(x) ((x)* 4 + (x)/16)
-
-		for (int c = 0; c < 65536; c++) {
-			//565
-			decoded_colors[0][c] = 0xFF000000 | (REP_32((c >> 11) % 32) << 16) | (REP_64((c >> 5) % 64) << 8) | (REP_32((c >> 0) % 32) << 0);
-			//1555
-			decoded_colors[1][c] = ((c >> 0) % 2 * 255 << 24) | (REP_32((c >> 11) % 32) << 16) | (REP_32((c >> 6) % 32) << 8) | (REP_32((c >> 1) % 32) << 0);
-			//4444
-			decoded_colors[2][c] = (REP_16((c >> 0) % 16) << 24) | (REP_16((c >> 12) % 16) << 16) | (REP_16((c >> 8) % 16) << 8) | (REP_16((c >> 4) % 16) << 0);
+	void Rendtriangle(const Triangle& t, int tile_x, int tile_y, u32 *colorBuffer, float *depthBuffer) const
+	{
+		const PolyState& state = states[t.state];
+		int left = std::max(t.left, tile_x);
+		int right = std::min(t.right, tile_x + TILE_SIZE);
+		int top = std::max(t.top, tile_y);
+		int bottom = std::min(t.bottom, tile_y + TILE_SIZE);
+		if (state.clip_mode == TileClipping::Outside)
+		{
+			left = std::max(left, state.clip[0]);
+			top = std::max(top, state.clip[1]);
+			right = std::min(right, state.clip[2]);
+			bottom = std::min(bottom, state.clip[3]);
 		}
+		if (left >= right || top >= bottom)
+			return;
 
+		const __m128 pixel_centers = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+		for (int y = top; y < bottom; y++)
 		{
-			RendtriangleFns[0][0][1][0][0][0] = &Rendtriangle<0, 0, 1, 0, 0, 0>;
-			RendtriangleFns[0][0][1][0][0][1] = &Rendtriangle<0, 0, 1, 0, 0, 1>;
-			RendtriangleFns[0][0][1][0][1][0] = &Rendtriangle<0, 0, 1, 0, 1, 0>;
-			RendtriangleFns[0][0][1][0][1][1] = &Rendtriangle<0, 0, 1, 0, 1, 1>;
-			RendtriangleFns[0][0][1][0][2][0] = &Rendtriangle<0, 0, 1, 0, 2, 0>;
-			RendtriangleFns[0][0][1][0][2][1] = &Rendtriangle<0, 0, 1, 0, 2, 1>;
-			RendtriangleFns[0][0][1][0][3][0] = &Rendtriangle<0, 0, 1, 0, 3, 0>;
-			RendtriangleFns[0][0][1][0][3][1] = &Rendtriangle<0, 0, 1, 0, 3, 1>;
-			RendtriangleFns[0][0][1][1][0][0] = &Rendtriangle<0, 0, 1, 1, 0, 0>;
-			RendtriangleFns[0][0][1][1][0][1] = &Rendtriangle<0, 0, 1, 1, 0, 1>;
-			RendtriangleFns[0][0][1][1][1][0] = &Rendtriangle<0, 0, 1, 1, 1, 0>;
-			RendtriangleFns[0][0][1][1][1][1] = &Rendtriangle<0, 0, 1, 1, 1, 1>;
-			RendtriangleFns[0][0][1][1][2][0] = &Rendtriangle<0, 0, 1, 1, 2, 0>;
-			RendtriangleFns[0][0][1][1][2][1] = &Rendtriangle<0, 0, 1, 1, 2, 1>;
-			RendtriangleFns[0][0][1][1][3][0] = &Rendtriangle<0, 0, 1, 1, 3, 0>;
-			RendtriangleFns[0][0][1][1][3][1] = &Rendtriangle<0, 0, 1, 1, 3, 1>;
-			RendtriangleFns[0][0][0][0][0][0] = &Rendtriangle<0, 0, 0, 0, 0, 0>;
-			RendtriangleFns[0][0][0][0][0][1] = &Rendtriangle<0, 0, 0, 0, 0, 1>;
-			RendtriangleFns[0][0][0][0][1][0] = &Rendtriangle<0, 0, 0, 0, 1, 0>;
-			RendtriangleFns[0][0][0][0][1][1] = &Rendtriangle<0, 0, 0, 0, 1, 1>;
-			RendtriangleFns[0][0][0][0][2][0] = &Rendtriangle<0, 0, 0, 0, 2, 0>;
-			RendtriangleFns[0][0][0][0][2][1] = &Rendtriangle<0, 0, 0, 0, 2, 1>;
-			RendtriangleFns[0][0][0][0][3][0] = &Rendtriangle<0, 0, 0, 0, 3, 0>;
-			RendtriangleFns[0][0][0][0][3][1] = &Rendtriangle<0, 0, 0, 0, 3, 1>;
-			RendtriangleFns[0][0][0][1][0][0] = &Rendtriangle<0, 0, 0, 1, 0, 0>;
-			RendtriangleFns[0][0][0][1][0][1] = &Rendtriangle<0, 0, 0, 1, 0, 1>;
-			RendtriangleFns[0][0][0][1][1][0] = &Rendtriangle<0, 0, 0, 1, 1, 0>;
-			RendtriangleFns[0][0][0][1][1][1] = &Rendtriangle<0, 0, 0, 1, 1, 1>;
-			RendtriangleFns[0][0][0][1][2][0] = &Rendtriangle<0, 0, 0, 1, 2, 0>;
-			RendtriangleFns[0][0][0][1][2][1] = &Rendtriangle<0, 0, 0, 1, 2, 1>;
-			RendtriangleFns[0][0][0][1][3][0] = &Rendtriangle<0, 0, 0, 1, 3, 0>;
-			RendtriangleFns[0][0][0][1][3][1] = &Rendtriangle<0, 0, 0, 1, 3, 1>;
-			RendtriangleFns[0][1][1][0][0][0] = &Rendtriangle<0, 1, 1, 0, 0, 0>;
-			RendtriangleFns[0][1][1][0][0][1] = &Rendtriangle<0, 1, 1, 0, 0, 1>;
-			RendtriangleFns[0][1][1][0][1][0] = &Rendtriangle<0, 1, 1, 0, 1, 0>;
-			RendtriangleFns[0][1][1][0][1][1] = &Rendtriangle<0, 1, 1, 0, 1, 1>;
-			RendtriangleFns[0][1][1][0][2][0] = &Rendtriangle<0, 1, 1, 0, 2, 0>;
-			RendtriangleFns[0][1][1][0][2][1] = &Rendtriangle<0, 1, 1, 0, 2, 1>;
-			RendtriangleFns[0][1][1][0][3][0] = &Rendtriangle<0, 1, 1, 0, 3, 0>;
-			RendtriangleFns[0][1][1][0][3][1] = &Rendtriangle<0, 1, 1, 0, 3, 1>;
-			RendtriangleFns[0][1][1][1][0][0] = &Rendtriangle<0, 1, 1, 1, 0, 0>;
-			RendtriangleFns[0][1][1][1][0][1] = &Rendtriangle<0, 1, 1, 1, 0, 1>;
-			RendtriangleFns[0][1][1][1][1][0] = &Rendtriangle<0, 1, 1, 1, 1, 0>;
-			RendtriangleFns[0][1][1][1][1][1] = &Rendtriangle<0, 1, 1, 1, 1, 1>;
-			RendtriangleFns[0][1][1][1][2][0] = &Rendtriangle<0, 1, 1, 1, 2, 0>;
-			RendtriangleFns[0][1][1][1][2][1] = &Rendtriangle<0, 1, 1, 1, 2, 1>;
-			RendtriangleFns[0][1][1][1][3][0] = &Rendtriangle<0, 1, 1, 1, 3, 0>;
-			RendtriangleFns[0][1][1][1][3][1] = &Rendtriangle<0, 1, 1, 1, 3, 1>;
-			RendtriangleFns[0][1][0][0][0][0] = &Rendtriangle<0, 1, 0, 0, 0, 0>;
-			RendtriangleFns[0][1][0][0][0][1] = &Rendtriangle<0, 1, 0, 0, 0, 1>;
-			RendtriangleFns[0][1][0][0][1][0] = &Rendtriangle<0, 1, 0, 0, 1, 0>;
-			RendtriangleFns[0][1][0][0][1][1] = &Rendtriangle<0, 1, 0, 0, 1, 1>;
-			RendtriangleFns[0][1][0][0][2][0] = &Rendtriangle<0, 1, 0, 0, 2, 0>;
-			RendtriangleFns[0][1][0][0][2][1] = &Rendtriangle<0, 1, 0, 0, 2, 1>;
-			RendtriangleFns[0][1][0][0][3][0] = &Rendtriangle<0, 1, 0, 0, 3, 0>;
-			RendtriangleFns[0][1][0][0][3][1] = &Rendtriangle<0, 1, 0, 0, 3, 1>;
-			RendtriangleFns[0][1][0][1][0][0] = &Rendtriangle<0, 1, 0, 1, 0, 0>;
-			RendtriangleFns[0][1][0][1][0][1] = &Rendtriangle<0, 1, 0, 1, 0, 1>;
-			RendtriangleFns[0][1][0][1][1][0] = &Rendtriangle<0, 1, 0, 1, 1, 0>;
-			RendtriangleFns[0][1][0][1][1][1] = &Rendtriangle<0, 1, 0, 1, 1, 1>;
-			RendtriangleFns[0][1][0][1][2][0] = &Rendtriangle<0, 1, 0, 1, 2, 0>;
-			RendtriangleFns[0][1][0][1][2][1] = &Rendtriangle<0, 1, 0, 1, 2, 1>;
-			RendtriangleFns[0][1][0][1][3][0] = &Rendtriangle<0, 1, 0, 1, 3, 0>;
-			RendtriangleFns[0][1][0][1][3][1] = &Rendtriangle<0, 1, 0, 1, 3, 1>;
-			RendtriangleFns[1][0][1][0][0][0] = &Rendtriangle<1, 0, 1, 0, 0, 0>;
-			RendtriangleFns[1][0][1][0][0][1] = &Rendtriangle<1, 0, 1, 0, 0, 1>;
-			RendtriangleFns[1][0][1][0][1][0] = &Rendtriangle<1, 0, 1, 0, 1, 0>;
-			RendtriangleFns[1][0][1][0][1][1] = &Rendtriangle<1, 0, 1, 0, 1, 1>;
-			RendtriangleFns[1][0][1][0][2][0] = &Rendtriangle<1, 0, 1, 0, 2, 0>;
-			RendtriangleFns[1][0][1][0][2][1] = &Rendtriangle<1, 0, 1, 0, 2, 1>;
-			RendtriangleFns[1][0][1][0][3][0] = &Rendtriangle<1, 0, 1, 0, 3, 0>;
-			RendtriangleFns[1][0][1][0][3][1] = &Rendtriangle<1, 0, 1, 0, 3, 1>;
-			RendtriangleFns[1][0][1][1][0][0] = &Rendtriangle<1, 0, 1, 1, 0, 0>;
-			RendtriangleFns[1][0][1][1][0][1] = &Rendtriangle<1, 0, 1, 1, 0, 1>;
-			RendtriangleFns[1][0][1][1][1][0] = &Rendtriangle<1, 0, 1, 1, 1, 0>;
-			RendtriangleFns[1][0][1][1][1][1] = &Rendtriangle<1, 0, 1, 1, 1, 1>;
-			RendtriangleFns[1][0][1][1][2][0] = &Rendtriangle<1, 0, 1, 1, 2, 0>;
-			RendtriangleFns[1][0][1][1][2][1] = &Rendtriangle<1, 0, 1, 1, 2, 1>;
-			RendtriangleFns[1][0][1][1][3][0] = &Rendtriangle<1, 0, 1, 1, 3, 0>;
-			RendtriangleFns[1][0][1][1][3][1] = &Rendtriangle<1, 0, 1, 1, 3, 1>;
-			RendtriangleFns[1][0][0][0][0][0] = &Rendtriangle<1, 0, 0, 0, 0, 0>;
-			RendtriangleFns[1][0][0][0][0][1] = &Rendtriangle<1, 0, 0, 0, 0, 1>;
-			RendtriangleFns[1][0][0][0][1][0] = &Rendtriangle<1, 0, 0, 0, 1, 0>;
-			RendtriangleFns[1][0][0][0][1][1] = &Rendtriangle<1, 0, 0, 0, 1, 1>;
-			RendtriangleFns[1][0][0][0][2][0] = &Rendtriangle<1, 0, 0, 0, 2, 0>;
-			RendtriangleFns[1][0][0][0][2][1] = &Rendtriangle<1, 0, 0, 0, 2, 1>;
-			RendtriangleFns[1][0][0][0][3][0] = &Rendtriangle<1, 0, 0, 0, 3, 0>;
-			RendtriangleFns[1][0][0][0][3][1] = &Rendtriangle<1, 0, 0, 0, 3, 1>;
-			RendtriangleFns[1][0][0][1][0][0] = &Rendtriangle<1, 0, 0, 1, 0, 0>;
-			RendtriangleFns[1][0][0][1][0][1] = &Rendtriangle<1, 0, 0, 1, 0, 1>;
-			RendtriangleFns[1][0][0][1][1][0] = &Rendtriangle<1, 0, 0, 1, 1, 0>;
-			RendtriangleFns[1][0][0][1][1][1] = &Rendtriangle<1, 0, 0, 1, 1, 1>;
-			RendtriangleFns[1][0][0][1][2][0] = &Rendtriangle<1, 0, 0, 1, 2, 0>;
-			RendtriangleFns[1][0][0][1][2][1] = &Rendtriangle<1, 0, 0, 1, 2, 1>;
-			RendtriangleFns[1][0][0][1][3][0] = &Rendtriangle<1, 0, 0, 1, 3, 0>;
-			RendtriangleFns[1][0][0][1][3][1] = &Rendtriangle<1, 0, 0, 1, 3, 1>;
-			RendtriangleFns[1][1][1][0][0][0] = &Rendtriangle<1, 1, 1, 0, 0, 0>;
-			RendtriangleFns[1][1][1][0][0][1] = &Rendtriangle<1, 1, 1, 0, 0, 1>;
-			RendtriangleFns[1][1][1][0][1][0] = &Rendtriangle<1, 1, 1, 0, 1, 0>;
-			RendtriangleFns[1][1][1][0][1][1] = &Rendtriangle<1, 1, 1, 0, 1, 1>;
-			RendtriangleFns[1][1][1][0][2][0] = &Rendtriangle<1, 1, 1, 0, 2, 0>;
-			RendtriangleFns[1][1][1][0][2][1] = &Rendtriangle<1, 1, 1, 0, 2, 1>;
-			RendtriangleFns[1][1][1][0][3][0] = &Rendtriangle<1, 1, 1, 0, 3, 0>;
-			RendtriangleFns[1][1][1][0][3][1] = &Rendtriangle<1, 1, 1, 0, 3, 1>;
-			RendtriangleFns[1][1][1][1][0][0] = &Rendtriangle<1, 1, 1, 1, 0, 0>;
-			RendtriangleFns[1][1][1][1][0][1] = &Rendtriangle<1, 1, 1, 1, 0, 1>;
-			RendtriangleFns[1][1][1][1][1][0] = &Rendtriangle<1, 1, 1, 1, 1, 0>;
-			RendtriangleFns[1][1][1][1][1][1] = &Rendtriangle<1, 1, 1, 1, 1, 1>;
-			RendtriangleFns[1][1][1][1][2][0] = &Rendtriangle<1, 1, 1, 1, 2, 0>;
-			RendtriangleFns[1][1][1][1][2][1] = &Rendtriangle<1, 1, 1, 1, 2, 1>;
-			RendtriangleFns[1][1][1][1][3][0] = &Rendtriangle<1, 1, 1, 1, 3, 0>;
-			RendtriangleFns[1][1][1][1][3][1] = &Rendtriangle<1, 1, 1, 1, 3, 1>;
-			RendtriangleFns[1][1][0][0][0][0] = &Rendtriangle<1, 1, 0, 0, 0, 0>;
-			RendtriangleFns[1][1][0][0][0][1] = &Rendtriangle<1, 1, 0, 0, 0, 1>;
-			RendtriangleFns[1][1][0][0][1][0] = &Rendtriangle<1, 1, 0, 0, 1, 0>;
-			RendtriangleFns[1][1][0][0][1][1] = &Rendtriangle<1, 1, 0, 0, 1, 1>;
-			RendtriangleFns[1][1][0][0][2][0] = &Rendtriangle<1, 1, 0, 0, 2, 0>;
-			RendtriangleFns[1][1][0][0][2][1] = &Rendtriangle<1, 1, 0, 0, 2, 1>;
-			RendtriangleFns[1][1][0][0][3][0] = &Rendtriangle<1, 1, 0, 0, 3, 0>;
-			RendtriangleFns[1][1][0][0][3][1] = &Rendtriangle<1, 1, 0, 0, 3, 1>;
-			RendtriangleFns[1][1][0][1][0][0] = &Rendtriangle<1, 1, 0, 1, 0, 0>;
-			RendtriangleFns[1][1][0][1][0][1] = &Rendtriangle<1, 1, 0, 1, 0, 1>;
-			RendtriangleFns[1][1][0][1][1][0] = &Rendtriangle<1, 1, 0, 1, 1, 0>;
-			RendtriangleFns[1][1][0][1][1][1] = &Rendtriangle<1, 1, 0, 1, 1, 1>;
-			RendtriangleFns[1][1][0][1][2][0] = &Rendtriangle<1, 1, 0, 1, 2, 0>;
-			RendtriangleFns[1][1][0][1][2][1] = &Rendtriangle<1, 1, 0, 1, 2, 1>;
-			RendtriangleFns[1][1][0][1][3][0] = &Rendtriangle<1, 1, 0, 1, 3, 0>;
-			RendtriangleFns[1][1][0][1][3][1] = &Rendtriangle<1, 1, 0, 1, 3, 1>;
-
-
-			RendtriangleFns[2][0][1][0][0][0] = &Rendtriangle<2, 0, 1, 0, 0, 0>;
-			RendtriangleFns[2][0][1][0][0][1] = &Rendtriangle<2, 0, 1, 0, 0, 1>;
-			RendtriangleFns[2][0][1][0][1][0] = &Rendtriangle<2, 0, 1, 0, 1, 0>;
-			RendtriangleFns[2][0][1][0][1][1] = &Rendtriangle<2, 0, 1, 0, 1, 1>;
-			RendtriangleFns[2][0][1][0][2][0] = &Rendtriangle<2, 0, 1, 0, 2, 0>;
-			RendtriangleFns[2][0][1][0][2][1] = &Rendtriangle<2, 0, 1, 0, 2, 1>;
-			RendtriangleFns[2][0][1][0][3][0] = &Rendtriangle<2, 0, 1, 0, 3, 0>;
-			RendtriangleFns[2][0][1][0][3][1] = &Rendtriangle<2, 0, 1, 0, 3, 1>;
-			RendtriangleFns[2][0][1][1][0][0] = &Rendtriangle<2, 0, 1, 1, 0, 0>;
-			RendtriangleFns[2][0][1][1][0][1] = &Rendtriangle<2, 0, 1, 1, 0, 1>;
-			RendtriangleFns[2][0][1][1][1][0] = &Rendtriangle<2, 0, 1, 1, 1, 0>;
-			RendtriangleFns[2][0][1][1][1][1] = &Rendtriangle<2, 0, 1, 1, 1, 1>;
-			RendtriangleFns[2][0][1][1][2][0] = &Rendtriangle<2, 0, 1, 1, 2, 0>;
-			RendtriangleFns[2][0][1][1][2][1] = &Rendtriangle<2, 0, 1, 1, 2, 1>;
-			RendtriangleFns[2][0][1][1][3][0] = &Rendtriangle<2, 0, 1, 1, 3, 0>;
-			RendtriangleFns[2][0][1][1][3][1] = &Rendtriangle<2, 0, 1, 1, 3, 1>;
-			RendtriangleFns[2][0][0][0][0][0] = &Rendtriangle<2, 0, 0, 0, 0, 0>;
-			RendtriangleFns[2][0][0][0][0][1] = &Rendtriangle<2, 0, 0, 0, 0, 1>;
-			RendtriangleFns[2][0][0][0][1][0] = &Rendtriangle<2, 0, 0, 0, 1, 0>;
-			RendtriangleFns[2][0][0][0][1][1] = &Rendtriangle<2, 0, 0, 0, 1, 1>;
-			RendtriangleFns[2][0][0][0][2][0] = &Rendtriangle<2, 0, 0, 0, 2, 0>;
-			RendtriangleFns[2][0][0][0][2][1] = &Rendtriangle<2, 0, 0, 0, 2, 1>;
-			RendtriangleFns[2][0][0][0][3][0] = &Rendtriangle<2, 0, 0, 0, 3, 0>;
-			RendtriangleFns[2][0][0][0][3][1] = &Rendtriangle<2, 0, 0, 0, 3, 1>;
-			RendtriangleFns[2][0][0][1][0][0] = &Rendtriangle<2, 0, 0, 1, 0, 0>;
-			RendtriangleFns[2][0][0][1][0][1] = &Rendtriangle<2, 0, 0, 1, 0, 1>;
-			RendtriangleFns[2][0][0][1][1][0] = &Rendtriangle<2, 0, 0, 1, 1, 0>;
-			RendtriangleFns[2][0][0][1][1][1] = &Rendtriangle<2, 0, 0, 1, 1, 1>;
-			RendtriangleFns[2][0][0][1][2][0] = &Rendtriangle<2, 0, 0, 1, 2, 0>;
-			RendtriangleFns[2][0][0][1][2][1] = &Rendtriangle<2, 0, 0, 1, 2, 1>;
-			RendtriangleFns[2][0][0][1][3][0] = &Rendtriangle<2, 0, 0, 1, 3, 0>;
-			RendtriangleFns[2][0][0][1][3][1] = &Rendtriangle<2, 0, 0, 1, 3, 1>;
-			RendtriangleFns[2][1][1][0][0][0] = &Rendtriangle<2, 1, 1, 0, 0, 0>;
-			RendtriangleFns[2][1][1][0][0][1] = &Rendtriangle<2, 1, 1, 0, 0, 1>;
-			RendtriangleFns[2][1][1][0][1][0] = &Rendtriangle<2, 1, 1, 0, 1, 0>;
-			RendtriangleFns[2][1][1][0][1][1] = &Rendtriangle<2, 1, 1, 0, 1, 1>;
-			RendtriangleFns[2][1][1][0][2][0] = &Rendtriangle<2, 1, 1, 0, 2, 0>;
-			RendtriangleFns[2][1][1][0][2][1] = &Rendtriangle<2, 1, 1, 0, 2, 1>;
-			RendtriangleFns[2][1][1][0][3][0] = &Rendtriangle<2, 1, 1, 0, 3, 0>;
-			RendtriangleFns[2][1][1][0][3][1] = &Rendtriangle<2, 1, 1, 0, 3, 1>;
-			RendtriangleFns[2][1][1][1][0][0] = &Rendtriangle<2, 1, 1, 1, 0, 0>;
-			RendtriangleFns[2][1][1][1][0][1] = &Rendtriangle<2, 1, 1, 1, 0, 1>;
-			RendtriangleFns[2][1][1][1][1][0] = &Rendtriangle<2, 1, 1, 1, 1, 0>;
-			RendtriangleFns[2][1][1][1][1][1] = &Rendtriangle<2, 1, 1, 1, 1, 1>;
-			RendtriangleFns[2][1][1][1][2][0] = &Rendtriangle<2, 1, 1, 1, 2, 0>;
-			RendtriangleFns[2][1][1][1][2][1] = &Rendtriangle<2, 1, 1, 1, 2, 1>;
-			RendtriangleFns[2][1][1][1][3][0] = &Rendtriangle<2, 1, 1, 1, 3, 0>;
-			RendtriangleFns[2][1][1][1][3][1] = &Rendtriangle<2, 1, 1, 1, 3, 1>;
-			RendtriangleFns[2][1][0][0][0][0] = &Rendtriangle<2, 1, 0, 0, 0, 0>;
-			RendtriangleFns[2][1][0][0][0][1] = &Rendtriangle<2, 1, 0, 0, 0, 1>;
-			RendtriangleFns[2][1][0][0][1][0] = &Rendtriangle<2, 1, 0, 0, 1, 0>;
-			RendtriangleFns[2][1][0][0][1][1] = &Rendtriangle<2, 1, 0, 0, 1, 1>;
-			RendtriangleFns[2][1][0][0][2][0] = &Rendtriangle<2, 1, 0, 0, 2, 0>;
-			RendtriangleFns[2][1][0][0][2][1] = &Rendtriangle<2, 1, 0, 0, 2, 1>;
-			RendtriangleFns[2][1][0][0][3][0] = &Rendtriangle<2, 1, 0, 0, 3, 0>;
-			RendtriangleFns[2][1][0][0][3][1] = &Rendtriangle<2, 1, 0, 0, 3, 1>;
-			RendtriangleFns[2][1][0][1][0][0] = &Rendtriangle<2, 1, 0, 1, 0, 0>;
-			RendtriangleFns[2][1][0][1][0][1] = &Rendtriangle<2, 1, 0, 1, 0, 1>;
-			RendtriangleFns[2][1][0][1][1][0] = &Rendtriangle<2, 1, 0, 1, 1, 0>;
-			RendtriangleFns[2][1][0][1][1][1] = &Rendtriangle<2, 1, 0, 1, 1, 1>;
-			RendtriangleFns[2][1][0][1][2][0] = &Rendtriangle<2, 1, 0, 1, 2, 0>;
-			RendtriangleFns[2][1][0][1][2][1] = &Rendtriangle<2, 1, 0, 1, 2, 1>;
-			RendtriangleFns[2][1][0][1][3][0] = &Rendtriangle<2, 1, 0, 1, 3, 0>;
-			RendtriangleFns[2][1][0][1][3][1] = &Rendtriangle<2, 1, 0, 1, 3, 1>;
+			const __m128 py = _mm_set1_ps(y + 0.5f);
+			const bool clip_row = state.clip_mode == TileClipping::Inside && y >= state.clip[1] && y < state.clip[3];
+			for (int x = left & ~3; x < right; x += 4)
+			{
+				u32 lanes = 0xF;
+				if (x < left)
+					lanes &= 0xF << (left - x);
+				if (x + 4 > right)
+					lanes &= 0xF >> (x + 4 - right);
+				if (clip_row)
+					lanes &= ~RangeLanes(x, state.clip[0], state.clip[2]);
+				if (lanes == 0)
+					continue;
+				const __m128 px = _mm_add_ps(_mm_set1_ps((float)x), pixel_centers);
+				lanes &= EdgeLanes(t, px, py);
+				if (lanes == 0)
+					continue;
+				int offset = (y - tile_y) * TILE_SIZE + x - tile_x;
+				PixelFlush(t, state, px, py, lanes, &colorBuffer[offset], &depthBuffer[offset]);
+			}
 		}
-
-		return true;
 	}
 
-	virtual void Resize(int w, int h) {
-
-	}
-
-	virtual void Term() {
-	}
-
-	#define RR(x, a, b, c, d) (x + a), (x + b), (x + c), (x + d)
-	#define R(a, b, c, d) RR(12, a, b, c, d), RR(8, a, b, c, d), RR(4, a, b, c, d),  RR(0, a, b, c, d)
-
-	//R coefs should be adjusted to match pixel format
-	INLINE __m128 shuffle_pixel(__m128 v)
-   {
-		return (__m128)_mm_shuffle_epi8((__m128i)v, _mm_set_epi8(R(0x80,2,1, 0)));
- 	}
-
-	virtual void Present() {
-
-		__m128* psrc = (__m128*)render_buffer;
-		__m128* pdst = (__m128*)pixels;
-
-		#define SHUFFL(v) v
-
-      #if defined(_WIN32)
-			#define FLIP_Y 479 - 
-		#else
-			#define FLIP_Y
-		#endif
-
-		const int stride = STRIDE_PIXEL_OFFSET / 4;
-		for (int y = 0; y<MAX_RENDER_HEIGHT; y += 4)
+	void RenderTile(int tile)
+	{
+		DECL_ALIGN(16) u32 colorBuffer[TILE_SIZE * TILE_SIZE];
+		DECL_ALIGN(16) float depthBuffer[TILE_SIZE * TILE_SIZE];
+		memset(colorBuffer, 0, sizeof(colorBuffer));
+		memset(depthBuffer, 0, sizeof(depthBuffer));
+
+		const int tile_x = (tile % tiles_x) * TILE_SIZE;
+		const int tile_y = (tile / tiles_x) * TILE_SIZE;
+		const std::vector<u32>& bin = bins[tile];
+		static thread_local std::vector<TileTrig> tile_trigs;
+		u32 pass = 0;
+		for (u32 i = 0; i < bin.size(); )
 		{
-			for (int x = 0; x<MAX_RENDER_WIDTH; x += 4)
+			const Triangle& t = triangles[bin[i]];
+			for (; pass < t.pass; pass++)
+				if (pass_z_clear[pass + 1])
+					memset(depthBuffer, 0, sizeof(depthBuffer));
+			if (!t.tile_sort)
 			{
-				pdst[(FLIP_Y - (y + 0))*stride + x / 4] = SHUFFL(*psrc++);
-				pdst[(FLIP_Y - (y + 1))*stride + x / 4] = SHUFFL(*psrc++);
-				pdst[(FLIP_Y - (y + 2))*stride + x / 4] = SHUFFL(*psrc++);
-				pdst[(FLIP_Y - (y + 3))*stride + x / 4] = SHUFFL(*psrc++);
+				Rendtriangle(t, tile_x, tile_y, colorBuffer, depthBuffer);
+				i++;
+				continue;
 			}
+			// Sort the autosorted triangles of this pass that touch the tile
+			tile_trigs.clear();
+			for (; i < bin.size() && triangles[bin[i]].tile_sort && triangles[bin[i]].pass == t.pass; i++)
+				tile_trigs.push_back({ bin[i], TileMinZ(triangles[bin[i]], tile_x, tile_y), 0 });
+			SortTileTrigs(tile_trigs.data(), tile_trigs.size());
+			for (const TileTrig& trig : tile_trigs)
+				Rendtriangle(triangles[trig.id], tile_x, tile_y, colorBuffer, depthBuffer);
 		}
 
-      /* should do a video_cb call here */
+		const int width = std::min(TILE_SIZE, (int)target_width - tile_x);
+		const int height = std::min(TILE_SIZE, (int)target_height - tile_y);
+		for (int y = 0; y < height; y++)
+		{
+			const u32 *src = &colorBuffer[y * TILE_SIZE];
+			u32 *dst = &target[(tile_y + y) * target_width + tile_x];
+			if (swap_rb)
+				// RGBA to XRGB
+				for (int x = 0; x < width; x++)
+					dst[x] = (src[x] & 0xFF00) | ((src[x] & 0xFF) << 16) | ((src[x] >> 16) & 0xFF);
+			else
+				memcpy(dst, src, width * sizeof(u32));
+		}
 	}
+
+	SoftTextureCache textureCache;
+
+	std::vector<Triangle> triangles;
+	std::vector<PolyState> states;
+	std::vector<bool> pass_z_clear;
+	std::vector<std::vector<u32>> bins;
+	std::vector<u32> rtt_buffer;
+
+	u32 *target = nullptr;
+	u32 target_width = 0;
+	u32 target_height = 0;
+	bool swap_rb = false;
+	u32 tiles_x = 0;
+	u32 tiles_y = 0;
+	float scale_x = 1.f;
+	float scale_y = 1.f;
+
+	float fog_col_ram[3];
+	float fog_col_vert[3];
+	float fog_density = 0.f;
+	u8 fog_table[256];
+	float fog_clamp_min[4];
+	float fog_clamp_max[4];
+	float pt_alpha_ref = 0.f;
 };
 
 Renderer* rend_softrend() {
-	return new(_mm_malloc(sizeof(softrend), 32)) softrend();
+	return new softrend();
 }
+#endif
@@ -0,0 +1,6 @@
+#pragma once
+#include "types.h"
+
+// Last frame rendered by the software renderer, as XRGB8888 pixels.
+// Returns nullptr if no frame has been rendered yet.
+const u32 *rend_soft_framebuffer(u32& width, u32& height);
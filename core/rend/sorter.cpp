@@ -15,7 +15,9 @@
 	 along with reicast.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include <algorithm>
+#include <cstring>
 #include "sorter.h"
+#include "oslib/oslib.h"
 
 struct IndexTrig
 {
@@ -41,11 +43,6 @@ static float minZ(const Vertex *v, const u32 *mod)
 	return std::min(std::min(v[mod[0]].z, v[mod[1]].z), v[mod[2]].z);
 }
 
-static bool operator<(const IndexTrig& left, const IndexTrig& right)
-{
-	return left.z<right.z;
-}
-
 static bool operator<(const PolyParam& left, const PolyParam& right)
 {
 /* put any condition you want to sort on here */
@@ -202,7 +199,152 @@ static void fill_id(u32 *d, const Vertex *v0, const Vertex *v1, const Vertex *v2
 	d[2] = (u32)(v2 - vb);
 }
 
-void GenSorted(int first, int count, std::vector<SortTrigDrawParam>& pidx_sort, std::vector<u32>& vidx_sort)
+// LSD radix sort of the triangles by min z, 8 bits per pass
+#define RADIX_BITS 8
+#define RADIX_SIZE (1 << RADIX_BITS)
+#define RADIX_PASSES (32 / RADIX_BITS)
+#define RADIX_MAX_CHUNKS 16
+// Smaller lists are sorted by the calling thread only
+#define RADIX_PARALLEL_MIN 16384
+
+// Buffers kept across frames
+static std::vector<IndexTrig> lst;
+static std::vector<IndexTrig> sorted_lst;
+static std::vector<u32> sort_keys[2];
+static std::vector<u32> sort_order[2];
+static u32 sort_histogram[RADIX_MAX_CHUNKS][RADIX_SIZE];
+
+// Unsigned key with the same order as the float z
+static u32 SortKey(f32 z)
+{
+	if (z == 0.f)
+		z = 0.f;	// -0 and +0 are equal
+	u32 bits;
+	memcpy(&bits, &z, sizeof(bits));
+	// Flip all the bits of negative numbers and the sign bit of positive ones
+	return bits ^ ((u32)((s32)bits >> 31) | 0x80000000);
+}
+
+static void RunSortChunks(int chunks, const std::function<void(int)>& task)
+{
+	if (chunks == 1)
+		task(0);
+	else
+		worker_pool.Run(chunks, task);
+}
+
+// Stable sort of lst[0, count) by increasing z. The result is left in sorted_lst.
+static void RadixSortTrigs(u32 count)
+{
+	int chunks = 1;
+	if (count >= RADIX_PARALLEL_MIN)
+	{
+		StartWorkerPool();
+		chunks = std::min(worker_pool.ThreadCount(), RADIX_MAX_CHUNKS);
+	}
+	const u32 chunk_size = (count + chunks - 1) / chunks;
+	for (int i = 0; i < 2; i++)
+	{
+		if (sort_keys[i].size() < count)
+		{
+			render_stage_stats.storage_growths++;
+			sort_keys[i].resize(count);
+			sort_order[i].resize(count);
+		}
+	}
+	u32 *keys = sort_keys[0].data();
+	u32 *order = sort_order[0].data();
+	u32 *keys_out = sort_keys[1].data();
+	u32 *order_out = sort_order[1].data();
+
+	RunSortChunks(chunks, [=](int chunk) {
+		const u32 end = std::min(count, (chunk + 1) * chunk_size);
+		for (u32 i = chunk * chunk_size; i < end; i++)
+		{
+			keys[i] = SortKey(lst[i].z);
+			order[i] = i;
+		}
+	});
+
+	for (int pass = 0; pass < RADIX_PASSES; pass++)
+	{
+		const u32 shift = pass * RADIX_BITS;
+		RunSortChunks(chunks, [=](int chunk) {
+			u32 *histogram = sort_histogram[chunk];
+			memset(histogram, 0, sizeof(sort_histogram[0]));
+			const u32 end = std::min(count, (chunk + 1) * chunk_size);
+			for (u32 i = chunk * chunk_size; i < end; i++)
+				histogram[(keys[i] >> shift) & (RADIX_SIZE - 1)]++;
+		});
+		// Skip the pass if all keys have the same digit
+		bool skip = false;
+		for (u32 digit = 0; digit < RADIX_SIZE; digit++)
+		{
+			u32 total = 0;
+			for (int chunk = 0; chunk < chunks; chunk++)
+				total += sort_histogram[chunk][digit];
+			if (total != 0)
+			{
+				skip = total == count;
+				break;
+			}
+		}
+		if (skip)
+			continue;
+		// Turn the histograms into output offsets. Lower chunks go first to keep the sort stable.
+		u32 offset = 0;
+		for (u32 digit = 0; digit < RADIX_SIZE; digit++)
+			for (int chunk = 0; chunk < chunks; chunk++)
+			{
+				u32 n = sort_histogram[chunk][digit];
+				sort_histogram[chunk][digit] = offset;
+				offset += n;
+			}
+		RunSortChunks(chunks, [=](int chunk) {
+			u32 *offsets = sort_histogram[chunk];
+			const u32 end = std::min(count, (chunk + 1) * chunk_size);
+			for (u32 i = chunk * chunk_size; i < end; i++)
+			{
+				u32 dst = offsets[(keys[i] >> shift) & (RADIX_SIZE - 1)]++;
+				keys_out[dst] = keys[i];
+				order_out[dst] = order[i];
+			}
+		});
+		std::swap(keys, keys_out);
+		std::swap(order, order_out);
+	}
+
+	if (sorted_lst.size() < count)
+	{
+		render_stage_stats.storage_growths++;
+		sorted_lst.resize(count);
+	}
+	RunSortChunks(chunks, [=](int chunk) {
+		const u32 end = std::min(count, (chunk + 1) * chunk_size);
+		for (u32 i = chunk * chunk_size; i < end; i++)
+			sorted_lst[i] = lst[order[i]];
+	});
+}
+
+#ifdef NO_REND
+bool stable_sort_trigs;
+
+static bool operator<(const IndexTrig& left, const IndexTrig& right)
+{
+	return left.z < right.z;
+}
+
+// The comparison sort used before RadixSortTrigs, for ta_replay
+static void StableSortTrigs(u32 count)
+{
+	if (sorted_lst.size() < count)
+		sorted_lst.resize(count);
+	std::copy(lst.begin(), lst.begin() + count, sorted_lst.begin());
+	std::stable_sort(sorted_lst.begin(), sorted_lst.begin() + count);
+}
+#endif
+
+static void GenSortedTrigs(int first, int count, std::vector<SortTrigDrawParam>& pidx_sort, std::vector<u32>& vidx_sort)
 {
 	u32 tess_gen=0;
 
@@ -238,9 +380,11 @@ void GenSorted(int first, int count, std::vector<SortTrigDrawParam>& pidx_sort,
 		return;
 
 	//make lists of all triangles, with their pid and vid
-	static std::vector<IndexTrig> lst;
-
-	lst.resize(vtx_count*4);
+	if (lst.size() < (size_t)vtx_count * 4)
+	{
+		render_stage_stats.storage_growths++;
+		lst.resize(vtx_count * 4);
+	}
 
 
 	int pfsti=0;
@@ -359,11 +503,15 @@ void GenSorted(int first, int count, std::vector<SortTrigDrawParam>& pidx_sort,
 
 	u32 aused=pfsti;
 
-	lst.resize(aused);
-
 	//sort them
 #if 1
-	std::stable_sort(lst.begin(),lst.end());
+#ifdef NO_REND
+	if (stable_sort_trigs)
+		StableSortTrigs(aused);
+	else
+#endif
+	RadixSortTrigs(aused);
+	std::vector<IndexTrig>& lst = sorted_lst;
 
 	//Merge pids/draw cmds if two different pids are actually equal
 	if (true)
@@ -456,3 +604,43 @@ void GenSorted(int first, int count, std::vector<SortTrigDrawParam>& pidx_sort,
 
 	if (tess_gen) DEBUG_LOG(RENDERER, "Generated %.2fK Triangles !", tess_gen / 1000.0);
 }
+
+void GenSorted(int first, int count, std::vector<SortTrigDrawParam>& pidx_sort, std::vector<u32>& vidx_sort)
+{
+	double start_time = render_stage_timing ? os_GetSeconds() : 0;
+	GenSortedTrigs(first, count, pidx_sort, vidx_sort);
+	render_stage_stats.sorts++;
+	if (!pidx_sort.empty())
+		render_stage_stats.sorted_triangles += vidx_sort.size() / 3;
+	if (render_stage_timing)
+		render_stage_stats.sort_time += os_GetSeconds() - start_time;
+}
+
+// Tiles rarely hold more triangles than this
+#define TILE_INSERTION_SORT_MAX 32
+
+void SortTileTrigs(TileTrig *trigs, u32 count)
+{
+	// Same order as GenSorted, NaNs included
+	for (u32 i = 0; i < count; i++)
+		trigs[i].key = SortKey(trigs[i].z);
+
+	if (count <= TILE_INSERTION_SORT_MAX)
+	{
+		for (u32 i = 1; i < count; i++)
+		{
+			TileTrig trig = trigs[i];
+			u32 j = i;
+			for (; j > 0 && trigs[j - 1].key > trig.key; j--)
+				trigs[j] = trigs[j - 1];
+			trigs[j] = trig;
+		}
+	}
+	else
+	{
+		// ids are increasing so ordering equal keys by id keeps the sort stable without a temporary buffer
+		std::sort(trigs, trigs + count, [](const TileTrig& left, const TileTrig& right) {
+			return left.key < right.key || (left.key == right.key && left.id < right.id);
+		});
+	}
+}
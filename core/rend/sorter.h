@@ -30,3 +30,18 @@ struct SortTrigDrawParam
 
 // Sort based on min-z of each triangle
 void GenSorted(int first, int count, std::vector<SortTrigDrawParam>& pidx_sort, std::vector<u32>& vidx_sort);
+#ifdef NO_REND
+// Makes GenSorted use std::stable_sort instead of the radix sort, to compare them
+extern bool stable_sort_trigs;
+#endif
+
+struct TileTrig
+{
+	u32 id;
+	f32 z;
+	u32 key;	// set by SortTileTrigs
+};
+
+// Sort the triangles of a 32x32 tile based on their min-z in the tile.
+// trigs must be in drawing order, which is kept for equal z.
+void SortTileTrigs(TileTrig *trigs, u32 count);
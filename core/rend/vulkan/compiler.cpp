@@ -22,6 +22,12 @@
 #include "compiler.h"
 #include "SPIRV/GlslangToSpv.h"
 #include "vulkan_context.h"
+#include "deps/xxhash/xxhash.h"
+
+static const char *ShaderCacheFileName = "vulkan_shader.cache";
+static const u32 ShaderCacheMagic = 0x43565053;	// "SPVC"
+// Bump when the shader compiler or its options change
+static const u32 ShaderCacheVersion = 1;
 
 static const TBuiltInResource DefaultTBuiltInResource = {
     /* .MaxLights = */ 32,
@@ -130,19 +136,90 @@ static const TBuiltInResource DefaultTBuiltInResource = {
 }};
 
 int ShaderCompiler::initCount;
+bool ShaderCompiler::glslangInitialized;
+std::map<u64, std::vector<u32>> ShaderCompiler::spirvCache;
+bool ShaderCompiler::cacheDirty;
 
+// glslang is only initialized when a shader isn't in the cache
 void ShaderCompiler::Init()
 {
 	if (initCount++ == 0)
-		verify(glslang::InitializeProcess());
+		LoadCache();
 }
 void ShaderCompiler::Term()
 {
 	if (--initCount == 0)
-		glslang::FinalizeProcess();
+	{
+		SaveCache();
+		spirvCache.clear();
+		if (glslangInitialized)
+			glslang::FinalizeProcess();
+		glslangInitialized = false;
+	}
 	initCount = std::max(initCount, 0);
 }
 
+// Format: magic, version, entry count, then for each entry its key, word count and SPIR-V words
+void ShaderCompiler::LoadCache()
+{
+	spirvCache.clear();
+	cacheDirty = false;
+	std::string cachePath = get_writable_data_path(ShaderCacheFileName);
+	FILE *f = fopen(cachePath.c_str(), "rb");
+	if (f == nullptr)
+		return;
+	u32 header[3];
+	bool valid = fread(header, sizeof(header), 1, f) == 1 && header[0] == ShaderCacheMagic && header[1] == ShaderCacheVersion;
+	for (u32 i = 0; valid && i < header[2]; i++)
+	{
+		u64 key;
+		u32 size;
+		valid = fread(&key, sizeof(key), 1, f) == 1 && fread(&size, sizeof(size), 1, f) == 1 && size > 0 && size < 0x100000;
+		if (valid)
+		{
+			std::vector<u32>& spirv = spirvCache[key];
+			spirv.resize(size);
+			valid = fread(spirv.data(), sizeof(u32), size, f) == size;
+		}
+	}
+	fclose(f);
+	if (!valid)
+	{
+		WARN_LOG(RENDERER, "Ignoring invalid or outdated shader cache %s", cachePath.c_str());
+		spirvCache.clear();
+		cacheDirty = true;
+	}
+	else
+		INFO_LOG(RENDERER, "Vulkan shader cache loaded from %s: %zd shaders", cachePath.c_str(), spirvCache.size());
+}
+
+void ShaderCompiler::SaveCache()
+{
+	if (!cacheDirty)
+		return;
+	std::string cachePath = get_writable_data_path(ShaderCacheFileName);
+	FILE *f = fopen(cachePath.c_str(), "wb");
+	if (f == nullptr)
+	{
+		WARN_LOG(RENDERER, "Cannot write shader cache %s", cachePath.c_str());
+		return;
+	}
+	const u32 header[3] = { ShaderCacheMagic, ShaderCacheVersion, (u32)spirvCache.size() };
+	bool written = fwrite(header, sizeof(header), 1, f) == 1;
+	for (const auto& entry : spirvCache)
+	{
+		u32 size = (u32)entry.second.size();
+		written = written && fwrite(&entry.first, sizeof(entry.first), 1, f) == 1
+				&& fwrite(&size, sizeof(size), 1, f) == 1
+				&& fwrite(entry.second.data(), sizeof(u32), size, f) == size;
+	}
+	fclose(f);
+	if (written)
+		cacheDirty = false;
+	else
+		WARN_LOG(RENDERER, "Error writing shader cache %s", cachePath.c_str());
+}
+
 static EShLanguage translateShaderStage(vk::ShaderStageFlagBits stage)
 {
 	switch (stage)
@@ -208,9 +285,21 @@ static bool GLSLtoSPV(const vk::ShaderStageFlagBits shaderType, std::string cons
 
 vk::UniqueShaderModule ShaderCompiler::Compile(vk::ShaderStageFlagBits shaderStage, std::string const& shaderText)
 {
-	std::vector<unsigned int> shaderSPV;
-	bool ok = GLSLtoSPV(shaderStage, shaderText, shaderSPV);
-	verify(ok);
+	const u64 key = XXH64(shaderText.data(), shaderText.size(), (u32)shaderStage);
+	std::vector<u32>& shaderSPV = spirvCache[key];
+	if (shaderSPV.empty())
+	{
+		if (!glslangInitialized)
+		{
+			verify(glslang::InitializeProcess());
+			glslangInitialized = true;
+		}
+		std::vector<unsigned int> spirv;
+		bool ok = GLSLtoSPV(shaderStage, shaderText, spirv);
+		verify(ok);
+		shaderSPV.assign(spirv.begin(), spirv.end());
+		cacheDirty = true;
+	}
 
 	return VulkanContext::Instance()->GetDevice().createShaderModuleUnique
 			(vk::ShaderModuleCreateInfo(vk::ShaderModuleCreateFlags(), shaderSPV.size() * sizeof(unsigned int), shaderSPV.data()));
@@ -20,6 +20,9 @@
 */
 #include "vulkan.h"
 
+#include <map>
+#include <vector>
+
 class ShaderCompiler
 {
 public:
@@ -27,5 +30,12 @@ public:
 	static void Term();
 	static vk::UniqueShaderModule Compile(vk::ShaderStageFlagBits shaderStage, std::string const& shaderText);
 private:
+	static void LoadCache();
+	static void SaveCache();
+
 	static int initCount;
+	static bool glslangInitialized;
+	// SPIR-V of the shaders compiled so far, keyed by stage and source hash. Persisted across runs.
+	static std::map<u64, std::vector<u32>> spirvCache;
+	static bool cacheDirty;
 };
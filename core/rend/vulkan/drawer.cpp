@@ -664,6 +664,9 @@ void ScreenDrawer::Init(SamplerManager *samplerManager, ShaderManager *shaderMan
 		screenPipelineManager = std::unique_ptr<PipelineManager>(new PipelineManager());
 	screenPipelineManager->Init(shaderManager, *renderPass);
 	Drawer::Init(samplerManager, screenPipelineManager.get());
+	// Avoid a reset of the precompiled pipelines on the first frame
+	CheckAlphaSortMode();
+	screenPipelineManager->Precompile();
 }
 
 vk::CommandBuffer ScreenDrawer::BeginRenderPass()
@@ -109,6 +109,11 @@ protected:
 	void NewImage()
 	{
 		imageIndex = (imageIndex + 1) % GetContext()->GetSwapChainSize();
+		CheckAlphaSortMode();
+	}
+
+	void CheckAlphaSortMode()
+	{
 		if (alphaSortMode != settings.pvr.Emulation.AlphaSortMode)
 		{
 			alphaSortMode = settings.pvr.Emulation.AlphaSortMode;
@@ -187,6 +192,11 @@ class ScreenDrawer : public Drawer
 {
 public:
 	void Init(SamplerManager *samplerManager, ShaderManager *shaderManager);
+	void Term()
+	{
+		if (screenPipelineManager)
+			screenPipelineManager->Term();
+	}
 	vk::RenderPass GetRenderPass() const { return *renderPass; }
 	virtual void EndRenderPass() override;
 	vk::CommandBuffer GetCurrentCommandBuffer() const { return currentCommandBuffer; }
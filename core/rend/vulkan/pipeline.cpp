@@ -22,6 +22,8 @@
 #include "hw/pvr/Renderer_if.h"
 #include "quad.h"
 
+#include <thread>
+
 void PipelineManager::CreateModVolPipeline(ModVolMode mode, int cullMode)
 {
 	// Vertex input state
@@ -168,6 +170,42 @@ void PipelineManager::CreateModVolPipeline(ModVolMode mode, int cullMode)
 }
 
 void PipelineManager::CreatePipeline(u32 listType, bool sortTriangles, const PolyParam& pp)
+{
+	vk::ShaderModule vertexModule;
+	vk::ShaderModule fragmentModule;
+	// Not part of the hash: the pipeline keeps the clamping of the frame that created it
+	bool clamping = pp.tsp.ColorClamp && (pvrrc.fog_clamp_min != 0 || pvrrc.fog_clamp_max != 0xffffffff);
+	GetShaderModules(listType, pp, clamping, vertexModule, fragmentModule);
+
+	u32 pipehash = hash(listType, sortTriangles, &pp);
+	pipelines[pipehash] = CompilePipeline(listType, sortTriangles, pp, vertexModule, fragmentModule);
+	if (!manifestPath.empty() && manifest.emplace(pipehash, clamping).second)
+		manifestDirty = true;
+}
+
+void PipelineManager::GetShaderModules(u32 listType, const PolyParam& pp, bool clamping, vk::ShaderModule& vertexModule, vk::ShaderModule& fragmentModule)
+{
+	vertexModule = shaderManager->GetVertexShader(VertexShaderParams{ pp.pcw.Gouraud == 1 });
+	FragmentShaderParams params = {};
+	params.alphaTest = listType == ListType_Punch_Through;
+	params.bumpmap = pp.tcw.PixelFmt == PixelBumpMap;
+	params.clamping = clamping;
+	params.insideClipTest = (pp.tileclip >> 28) == 3;
+	params.fog = settings.rend.Fog ? pp.tsp.FogCtrl : 2;
+	params.gouraud = pp.pcw.Gouraud;
+   params.ignoreTexAlpha = pp.tsp.IgnoreTexA || pp.tcw.PixelFmt == Pixel565;
+	params.offset = pp.pcw.Offset;
+	params.shaderInstr = pp.tsp.ShadInstr;
+	params.texture = pp.pcw.Texture;
+	params.trilinear = pp.pcw.Texture && pp.tsp.FilterMode > 1 && listType != ListType_Punch_Through && pp.tcw.MipMapped == 1;
+	params.useAlpha = pp.tsp.UseAlpha;
+	params.palette = BaseTextureCacheData::IsGpuHandledPaletted(pp.tsp, pp.tcw);
+	fragmentModule = shaderManager->GetFragmentShader(params);
+}
+
+// Only uses its arguments, the settings and the device so that it can run on a worker thread
+vk::UniquePipeline PipelineManager::CompilePipeline(u32 listType, bool sortTriangles, const PolyParam& pp,
+		vk::ShaderModule vertexModule, vk::ShaderModule fragmentModule) const
 {
 	vk::PipelineVertexInputStateCreateInfo pipelineVertexInputStateCreateInfo = GetMainVertexInputStateCreateInfo();
 
@@ -288,26 +326,9 @@ void PipelineManager::CreatePipeline(u32 listType, bool sortTriangles, const Pol
 	vk::DynamicState dynamicStates[2] = { vk::DynamicState::eViewport, vk::DynamicState::eScissor };
 	vk::PipelineDynamicStateCreateInfo pipelineDynamicStateCreateInfo(vk::PipelineDynamicStateCreateFlags(), 2, dynamicStates);
 
-	vk::ShaderModule vertex_module = shaderManager->GetVertexShader(VertexShaderParams{ pp.pcw.Gouraud == 1 });
-	FragmentShaderParams params = {};
-	params.alphaTest = listType == ListType_Punch_Through;
-	params.bumpmap = pp.tcw.PixelFmt == PixelBumpMap;
-	params.clamping = pp.tsp.ColorClamp && (pvrrc.fog_clamp_min != 0 || pvrrc.fog_clamp_max != 0xffffffff);
-	params.insideClipTest = (pp.tileclip >> 28) == 3;
-	params.fog = settings.rend.Fog ? pp.tsp.FogCtrl : 2;
-	params.gouraud = pp.pcw.Gouraud;
-   params.ignoreTexAlpha = pp.tsp.IgnoreTexA || pp.tcw.PixelFmt == Pixel565;
-	params.offset = pp.pcw.Offset;
-	params.shaderInstr = pp.tsp.ShadInstr;
-	params.texture = pp.pcw.Texture;
-	params.trilinear = pp.pcw.Texture && pp.tsp.FilterMode > 1 && listType != ListType_Punch_Through && pp.tcw.MipMapped == 1;
-	params.useAlpha = pp.tsp.UseAlpha;
-	params.palette = BaseTextureCacheData::IsGpuHandledPaletted(pp.tsp, pp.tcw);
-	vk::ShaderModule fragment_module = shaderManager->GetFragmentShader(params);
-
 	vk::PipelineShaderStageCreateInfo stages[] = {
-			{ vk::PipelineShaderStageCreateFlags(), vk::ShaderStageFlagBits::eVertex, vertex_module, "main" },
-			{ vk::PipelineShaderStageCreateFlags(), vk::ShaderStageFlagBits::eFragment, fragment_module, "main" },
+			{ vk::PipelineShaderStageCreateFlags(), vk::ShaderStageFlagBits::eVertex, vertexModule, "main" },
+			{ vk::PipelineShaderStageCreateFlags(), vk::ShaderStageFlagBits::eFragment, fragmentModule, "main" },
 	};
 	vk::GraphicsPipelineCreateInfo graphicsPipelineCreateInfo
 	(
@@ -327,6 +348,208 @@ void PipelineManager::CreatePipeline(u32 listType, bool sortTriangles, const Pol
 	  renderPass                                  // renderPass
 	);
 
-	pipelines[hash(listType, sortTriangles, &pp)] = GetContext()->GetDevice().createGraphicsPipelineUnique(GetContext()->GetPipelineCache(),
-			graphicsPipelineCreateInfo);
+	return GetContext()->GetDevice().createGraphicsPipelineUnique(GetContext()->GetPipelineCache(), graphicsPipelineCreateInfo);
+}
+
+// Generic vertex color pipeline used while the right one is being compiled in the background
+vk::Pipeline PipelineManager::GetFallbackPipeline(u32 listType, bool sortTriangles)
+{
+	u32 key = (listType << 1) | (u32)sortTriangles;
+	const auto& it = fallbackPipelines.find(key);
+	if (it != fallbackPipelines.end())
+		return *it->second;
+
+	PolyParam pp = {};
+	pp.pcw.Gouraud = 1;
+	pp.tsp.FogCtrl = 2;
+	pp.isp.DepthMode = 6;	// greater or equal
+	if (listType == ListType_Translucent)
+	{
+		pp.tsp.UseAlpha = 1;
+		pp.tsp.SrcInstr = 4;	// src alpha
+		pp.tsp.DstInstr = 5;	// 1 - src alpha
+		pp.isp.ZWriteDis = 1;
+	}
+	else
+	{
+		pp.tsp.SrcInstr = 1;	// one
+		pp.tsp.DstInstr = 0;	// zero
+	}
+	vk::ShaderModule vertexModule;
+	vk::ShaderModule fragmentModule;
+	GetShaderModules(listType, pp, false, vertexModule, fragmentModule);
+	fallbackPipelines[key] = CompilePipeline(listType, sortTriangles, pp, vertexModule, fragmentModule);
+
+	return *fallbackPipelines[key];
+}
+
+static const u32 MANIFEST_MAGIC = 0x504c5056;	// "VPLP"
+static const u32 MANIFEST_VERSION = 2;
+static const u32 MANIFEST_MAX_ENTRIES = 16384;
+// Set in a manifest entry if the pipeline was created with color clamping. Pipeline hashes only use 28 bits.
+static const u32 MANIFEST_CLAMPING = 0x80000000;
+
+void PipelineManager::LoadManifest(const std::string& path)
+{
+	manifest.clear();
+	manifestDirty = false;
+	manifestPath = path;
+
+	FILE *f = fopen(path.c_str(), "rb");
+	if (f == NULL)
+		return;
+	u32 header[3];
+	if (fread(header, sizeof(header), 1, f) != 1
+			|| header[0] != MANIFEST_MAGIC || header[1] != MANIFEST_VERSION || header[2] > MANIFEST_MAX_ENTRIES)
+	{
+		WARN_LOG(RENDERER, "Ignoring invalid pipeline manifest %s", path.c_str());
+		fclose(f);
+		return;
+	}
+	std::vector<u32> entries(header[2]);
+	if (!entries.empty())
+		entries.resize(fread(&entries[0], sizeof(u32), entries.size(), f));
+	fclose(f);
+	for (u32 entry : entries)
+		manifest.emplace(entry & ~MANIFEST_CLAMPING, (entry & MANIFEST_CLAMPING) != 0);
+	INFO_LOG(RENDERER, "Pipeline manifest loaded from %s: %d pipelines", path.c_str(), (int)manifest.size());
+}
+
+void PipelineManager::SaveManifest()
+{
+	if (!manifestDirty || manifestPath.empty())
+		return;
+
+	FILE *f = fopen(manifestPath.c_str(), "wb");
+	if (f == NULL)
+	{
+		WARN_LOG(RENDERER, "Cannot save pipeline manifest to %s", manifestPath.c_str());
+		return;
+	}
+	u32 header[3] = { MANIFEST_MAGIC, MANIFEST_VERSION, (u32)manifest.size() };
+	fwrite(header, sizeof(header), 1, f);
+	for (const auto& it : manifest)
+	{
+		u32 entry = it.first | (it.second ? MANIFEST_CLAMPING : 0);
+		fwrite(&entry, sizeof(entry), 1, f);
+	}
+	fclose(f);
+	manifestDirty = false;
+	INFO_LOG(RENDERER, "Pipeline manifest saved to %s: %d pipelines", manifestPath.c_str(), (int)manifest.size());
+}
+
+void PipelineManager::Precompile()
+{
+	extern char content_name[PATH_MAX];
+	std::string path = get_writable_data_path("data/") + content_name + ".vkpipelines";
+	if (path != manifestPath)
+	{
+		SaveManifest();
+		LoadManifest(path);
+	}
+	if (manifest.empty() || !compileThreads.empty())
+		return;
+
+	// Shader modules are fetched here since the shader manager isn't thread safe
+	std::vector<CompileJob> jobs;
+	for (const auto& it : manifest)
+	{
+		CompileJob job;
+		job.hash = it.first;
+		if (pipelines.count(job.hash) != 0 || !unhash(job.hash, job.listType, job.sortTriangles, job.pp))
+			continue;
+		GetShaderModules(job.listType, job.pp, it.second, job.vertexModule, job.fragmentModule);
+		jobs.push_back(job);
+	}
+	if (jobs.empty())
+		return;
+
+	GetFallbackPipeline(ListType_Opaque, false);
+	GetFallbackPipeline(ListType_Punch_Through, false);
+	GetFallbackPipeline(ListType_Translucent, false);
+	GetFallbackPipeline(ListType_Translucent, true);
+
+	compileMutex.lock();
+	compileExit = false;
+	for (const CompileJob& job : jobs)
+		compiling.insert(job.hash);
+	compileQueue = std::move(jobs);
+	compileMutex.unlock();
+
+	u32 threadCount = std::max(1u, std::min(4u, std::thread::hardware_concurrency() / 2));
+	threadCount = std::min(threadCount, (u32)compileQueue.size());
+	INFO_LOG(RENDERER, "Compiling %d pipelines on %d threads", (int)compileQueue.size(), threadCount);
+	for (u32 i = 0; i < threadCount; i++)
+	{
+		compileThreads.push_back(std::unique_ptr<cThread>(new cThread(CompileThreadEntry, this)));
+		compileThreads.back()->Start();
+	}
+}
+
+void *PipelineManager::CompileThreadEntry(void *param)
+{
+	PipelineManager *manager = (PipelineManager *)param;
+	while (true)
+	{
+		manager->compileMutex.lock();
+		if (manager->compileExit || manager->compileQueue.empty())
+		{
+			manager->compileMutex.unlock();
+			break;
+		}
+		CompileJob job = manager->compileQueue.back();
+		manager->compileQueue.pop_back();
+		manager->compileMutex.unlock();
+
+		vk::UniquePipeline pipeline;
+		try {
+			pipeline = manager->CompilePipeline(job.listType, job.sortTriangles, job.pp, job.vertexModule, job.fragmentModule);
+		} catch (const vk::SystemError& e) {
+			WARN_LOG(RENDERER, "Background pipeline compilation failed: %s", e.what());
+		}
+
+		manager->compileMutex.lock();
+		manager->compiledPipelines.push_back(std::make_pair(job.hash, std::move(pipeline)));
+		manager->compileMutex.unlock();
+	}
+	return NULL;
+}
+
+void PipelineManager::CollectCompiledPipelines()
+{
+	compileMutex.lock();
+	for (auto& compiled : compiledPipelines)
+	{
+		compiling.erase(compiled.first);
+		// Failed compilations are retried synchronously when needed
+		if (compiled.second)
+			pipelines[compiled.first] = std::move(compiled.second);
+	}
+	compiledPipelines.clear();
+	bool done = compiling.empty();
+	compileMutex.unlock();
+
+	if (done && !compileThreads.empty())
+	{
+		compileThreads.clear();
+		DEBUG_LOG(RENDERER, "Background pipeline compilation done");
+	}
+}
+
+void PipelineManager::StopCompiling()
+{
+	compileMutex.lock();
+	compileExit = true;
+	compileQueue.clear();
+	compileMutex.unlock();
+	// cThread joins when destroyed
+	compileThreads.clear();
+	CollectCompiledPipelines();
+	compiling.clear();
+}
+
+void PipelineManager::Term()
+{
+	StopCompiling();
+	SaveManifest();
 }
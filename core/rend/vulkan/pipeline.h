@@ -25,6 +25,9 @@
 #include "utils.h"
 #include "hw/pvr/ta_ctx.h"
 #include "vulkan_context.h"
+#include "stdclass.h"
+
+#include <set>
 
 class DescriptorSets
 {
@@ -136,7 +139,7 @@ private:
 class PipelineManager
 {
 public:
-	virtual ~PipelineManager() = default;
+	virtual ~PipelineManager() { Term(); }
 
 	void Init(ShaderManager *shaderManager, vk::RenderPass renderPass)
 	{
@@ -177,12 +180,27 @@ public:
 		const auto &pipeline = pipelines.find(pipehash);
 		if (pipeline != pipelines.end())
 			return pipeline->second.get();
+		if (compiling.count(pipehash) != 0)
+		{
+			CollectCompiledPipelines();
+			const auto &pipeline = pipelines.find(pipehash);
+			if (pipeline != pipelines.end())
+				return pipeline->second.get();
+			// Don't wait for the background compilation
+			if (compiling.count(pipehash) != 0)
+				return GetFallbackPipeline(listType, sortTriangles);
+		}
 
 		CreatePipeline(listType, sortTriangles, pp);
 
 		return *pipelines[pipehash];
 	}
 
+	// Compiles the pipelines recorded for the current game in the background
+	void Precompile();
+	// Stops the background compilation and saves the pipeline manifest
+	void Term();
+
 	vk::Pipeline GetModifierVolumePipeline(ModVolMode mode, int cullMode)
 	{
 		u32 pipehash = hash(mode, cullMode);
@@ -196,8 +214,10 @@ public:
 
 	void Reset()
 	{
+		StopCompiling();
 		pipelines.clear();
 		modVolPipelines.clear();
+		fallbackPipelines.clear();
 	}
 
 	vk::PipelineLayout GetPipelineLayout() const { return *pipelineLayout; }
@@ -222,6 +242,32 @@ private:
 
 		return hash;
 	}
+	// Rebuilds the pipeline parameters from a hash. Returns false if they don't hash back to the same value.
+	bool unhash(u32 pipehash, u32& listType, bool& sortTriangles, PolyParam& pp) const
+	{
+		pp = {};
+		pp.pcw.Gouraud = pipehash & 1;
+		pp.pcw.Offset = (pipehash >> 1) & 1;
+		pp.pcw.Texture = (pipehash >> 2) & 1;
+		pp.pcw.Shadow = (pipehash >> 3) & 1;
+		pp.tileclip = ((pipehash >> 4) & 1) ? 3u << 28 : 0;
+		listType = ((pipehash >> 5) & 3) << 1;
+		pp.tsp.ShadInstr = (pipehash >> 7) & 3;
+		pp.tsp.IgnoreTexA = (pipehash >> 9) & 1;
+		pp.tsp.UseAlpha = (pipehash >> 10) & 1;
+		pp.tsp.ColorClamp = (pipehash >> 11) & 1;
+		pp.tsp.FogCtrl = (pipehash >> 12) & 3;
+		pp.tsp.SrcInstr = (pipehash >> 14) & 7;
+		pp.tsp.DstInstr = (pipehash >> 17) & 7;
+		pp.isp.ZWriteDis = (pipehash >> 20) & 1;
+		pp.isp.CullMode = (pipehash >> 21) & 3;
+		pp.isp.DepthMode = (pipehash >> 23) & 7;
+		sortTriangles = (pipehash >> 26) & 1;
+		if ((pipehash >> 27) & 1)
+			pp.tcw.PixelFmt = PixelPal4;
+
+		return listType <= ListType_Punch_Through && hash(listType, sortTriangles, &pp) == pipehash;
+	}
 	u32 hash(ModVolMode mode, int cullMode) const
 	{
 		return ((int)mode << 2) | cullMode;
@@ -254,9 +300,42 @@ private:
 	}
 
 	void CreatePipeline(u32 listType, bool sortTriangles, const PolyParam& pp);
+	void GetShaderModules(u32 listType, const PolyParam& pp, bool clamping, vk::ShaderModule& vertexModule, vk::ShaderModule& fragmentModule);
+	vk::UniquePipeline CompilePipeline(u32 listType, bool sortTriangles, const PolyParam& pp,
+			vk::ShaderModule vertexModule, vk::ShaderModule fragmentModule) const;
+	vk::Pipeline GetFallbackPipeline(u32 listType, bool sortTriangles);
+
+	void StopCompiling();
+	void CollectCompiledPipelines();
+	static void *CompileThreadEntry(void *param);
+	void LoadManifest(const std::string& path);
+	void SaveManifest();
 
 	std::map<u32, vk::UniquePipeline> pipelines;
 	std::map<u32, vk::UniquePipeline> modVolPipelines;
+	std::map<u32, vk::UniquePipeline> fallbackPipelines;
+
+	// Background compilation of the pipelines recorded in the manifest
+	struct CompileJob
+	{
+		u32 hash;
+		u32 listType;
+		bool sortTriangles;
+		PolyParam pp;
+		vk::ShaderModule vertexModule;
+		vk::ShaderModule fragmentModule;
+	};
+	std::vector<CompileJob> compileQueue;
+	std::vector<std::pair<u32, vk::UniquePipeline>> compiledPipelines;
+	std::set<u32> compiling;
+	std::vector<std::unique_ptr<cThread>> compileThreads;
+	cMutex compileMutex;
+	bool compileExit = false;
+
+	// Hashes of all the pipelines used by the current game, with their color clamping
+	std::map<u32, bool> manifest;
+	std::string manifestPath;
+	bool manifestDirty = false;
 
 	vk::UniquePipelineLayout pipelineLayout;
 	vk::UniqueDescriptorSetLayout perFrameLayout;
@@ -52,6 +52,7 @@ public:
 	{
 		DEBUG_LOG(RENDERER, "VulkanRenderer::Term");
 		GetContext()->WaitIdle();
+		screenDrawer.Term();
 		samplerManager.Term();
 		BaseVulkanRenderer::Term();
 	}
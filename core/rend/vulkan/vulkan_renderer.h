@@ -45,7 +45,7 @@ public:
 	{
 		Texture* tf = textureCache.getTextureCacheData(tsp, tcw);
 
-		if (tf->IsNew())
+		if (tf->IsNew() && !tf->update_pending)
 		{
 			tf->Create();
 			tf->SetPhysicalDevice(GetContext()->GetPhysicalDevice());
@@ -58,10 +58,10 @@ public:
 			// This kills performance when a frame is skipped and lots of texture updated each frame
 			//if (textureCache.IsInFlight(tf))
 			//	textureCache.DestroyLater(tf);
-			tf->SetCommandBuffer(texCommandPool.Allocate());
-			tf->Update();
+			// Decoded and uploaded once the frame is parsed
+			textureCache.QueueUpdate(tf);
 		}
-		else if (tf->IsCustomTextureAvailable())
+		else if (tf->IsCustomTextureAvailable() && !tf->update_pending)
 		{
 			textureCache.DestroyLater(tf);
 			tf->SetCommandBuffer(texCommandPool.Allocate());
@@ -91,6 +91,11 @@ public:
 
 		bool result = ta_parse_vdrc(ctx);
 
+		textureCache.UpdateTextures([this](Texture *texture) {
+			texture->SetCommandBuffer(texCommandPool.Allocate());
+			texture->Upload();
+			texture->SetCommandBuffer(nullptr);
+		});
 		textureCache.Cleanup();
 
 		if (result)
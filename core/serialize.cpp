@@ -23,6 +23,7 @@
 #include <map>
 #include <set>
 #include "rend/gles/gles.h"
+#include "rend/TexCache.h"
 #include "hw/sh4/dyna/blockmanager.h"
 #include "hw/sh4/dyna/ngen.h"
 #include "hw/naomi/naomi.h"
@@ -312,11 +313,115 @@ bool register_unserialize(Array<RegisterStruct>& regs,void **data, unsigned int
 	return true ;
 }
 
+// Delta savestates: RAM and VRAM writes are tracked by write-protecting their pages.
+// When a state is saved into or loaded from a buffer that still holds one of the
+// last snapshots, only the pages written since that snapshot are copied.
+struct snapshot_slot
+{
+	const void *buffer;
+	u64 id;
+	u32 session;
+	u32 ram_epoch;
+	u32 vram_epoch;
+	u32 ram_offset;
+	u32 vram_offset;
+};
+static snapshot_slot snapshot_slots[4];
+static u32 snapshot_next_slot;
+static u32 snapshot_session;
+static u64 snapshot_next_id;
+// Slot of the buffer being saved or loaded, if its content can be reused
+static const snapshot_slot *delta_slot;
+static const u8 *delta_base;
+
+static const snapshot_slot *find_snapshot_slot(const void *buffer)
+{
+	if (snapshot_session == 0 || !bm_DirtyTrackingActive())
+		return NULL;
+	serialize_version_enum version;
+	memcpy(&version, buffer, sizeof(version));
+	if (version != VCUR_LIBRETRO)
+		return NULL;
+	u64 id;
+	memcpy(&id, (const u8 *)buffer + sizeof(version), sizeof(id));
+	for (const auto& slot : snapshot_slots)
+		if (slot.buffer == buffer && slot.id == id && slot.session == snapshot_session)
+			return &slot;
+	return NULL;
+}
+
+bool dc_can_restore_delta(const void *data, size_t size)
+{
+	if (data == NULL || size < sizeof(serialize_version_enum) + sizeof(u64))
+		return false;
+	return find_snapshot_slot(data) != NULL;
+}
+
+static bool delta_region(void **data, u32 slot_offset)
+{
+	return delta_slot != NULL && (const u8 *)*data - delta_base == slot_offset;
+}
+
+static void region_serialize(void **data, unsigned int *total_size, const u8 *mem, u32 size,
+		u32 slot_offset, u32 epoch, bool (*page_dirty)(u32, u32))
+{
+	if (*data != NULL && delta_region(data, slot_offset))
+	{
+		u8 *dst = (u8 *)*data;
+		for (u32 offset = 0; offset < size; offset += PAGE_SIZE)
+			if (page_dirty(offset, epoch))
+				memcpy(dst + offset, mem + offset, PAGE_SIZE);
+		*data = dst + size;
+		*total_size += size;
+	}
+	else
+		LIBRETRO_SA(mem, size);
+}
+
+// Only copies and invalidates the RAM pages that differ from the current state
+static void ram_unserialize(void **data, unsigned int *total_size)
+{
+	if (*data != NULL)
+	{
+		const u8 *src = (const u8 *)*data;
+		bool delta = delta_region(data, delta_slot != NULL ? delta_slot->ram_offset : 0);
+		for (u32 offset = 0; offset < mem_b.size; offset += PAGE_SIZE)
+		{
+			if (delta && !bm_RamPageDirty(offset, delta_slot->ram_epoch))
+				continue;
+			if (memcmp(&mem_b[offset], src + offset, PAGE_SIZE) != 0)
+			{
+				memcpy(&mem_b[offset], src + offset, PAGE_SIZE);
+				bm_RamPageChanged(offset);
+			}
+		}
+		*data = ((unsigned char*)*data) + mem_b.size;
+	}
+	*total_size += mem_b.size;
+}
+
+static void vram_unserialize(void **data, unsigned int *total_size)
+{
+	if (*data != NULL && delta_region(data, delta_slot != NULL ? delta_slot->vram_offset : 0))
+	{
+		const u8 *src = (const u8 *)*data;
+		for (u32 offset = 0; offset < vram.size; offset += PAGE_SIZE)
+			if (VramPageDirty(offset, delta_slot->vram_epoch))
+				memcpy(&vram[offset], src + offset, PAGE_SIZE);
+		*data = ((unsigned char*)*data) + vram.size;
+		*total_size += vram.size;
+	}
+	else
+		LIBRETRO_USA(vram.data, vram.size);
+}
+
 bool dc_serialize(void **data, unsigned int *total_size)
 {
 	int i = 0;
 	int j = 0;
 	serialize_version_enum version = VCUR_LIBRETRO;
+	u64 snapshot_id = 0;
+	u8 *buffer = (u8 *)*data;
 
 	*total_size = 0 ;
 
@@ -324,7 +429,26 @@ bool dc_serialize(void **data, unsigned int *total_size)
 	if ( p_sh4rcb == NULL )
 		return false ;
 
+	delta_slot = NULL;
+	if (buffer != NULL)
+	{
+		if (!bm_DirtyTrackingActive() && bm_DirtyTrackingStart())
+		{
+			// New tracking session: the previous snapshots can't be reused
+			VramDirtyTrackingStart();
+			snapshot_session++;
+		}
+		delta_slot = find_snapshot_slot(buffer);
+		delta_base = buffer;
+		if (snapshot_next_id == 0)
+			snapshot_next_id = (u64)time(NULL) << 32;
+		snapshot_id = ++snapshot_next_id;
+	}
+	u32 ram_epoch = delta_slot != NULL ? delta_slot->ram_epoch : 0;
+	u32 vram_epoch = delta_slot != NULL ? delta_slot->vram_epoch : 0;
+
 	LIBRETRO_S(version) ;
+	LIBRETRO_S(snapshot_id);
 	LIBRETRO_S(aica_interr) ;
 	LIBRETRO_S(aica_reg_L) ;
 	LIBRETRO_S(e68k_out) ;
@@ -426,9 +550,9 @@ bool dc_serialize(void **data, unsigned int *total_size)
 	LIBRETRO_S(ta_fsm[2048]);
 	LIBRETRO_S(ta_fsm_cl);
 
-	SerializeTAContext(data, total_size);
-
-	LIBRETRO_SA(vram.data, vram.size);
+	u32 vram_offset = (u32)((u8 *)*data - buffer);
+	region_serialize(data, total_size, vram.data, vram.size, delta_slot != NULL ? delta_slot->vram_offset : 0,
+			vram_epoch, VramPageDirty);
 
 	LIBRETRO_SA(OnChipRAM.data,OnChipRAM_SIZE);
 
@@ -445,7 +569,9 @@ bool dc_serialize(void **data, unsigned int *total_size)
 	icache.Serialize(data, total_size);
 	ocache.Serialize(data, total_size);
 
-	LIBRETRO_SA(mem_b.data, mem_b.size);
+	u32 ram_offset = (u32)((u8 *)*data - buffer);
+	region_serialize(data, total_size, mem_b.data, mem_b.size, delta_slot != NULL ? delta_slot->ram_offset : 0,
+			ram_epoch, bm_RamPageDirty);
 
 	LIBRETRO_SA(InterruptEnvId,32);
 	LIBRETRO_SA(InterruptBit,32);
@@ -595,8 +721,35 @@ bool dc_serialize(void **data, unsigned int *total_size)
 	if (CurrentCartridge != NULL)
 	   CurrentCartridge->Serialize(data, total_size);
 	gd_hle_state.Serialize(data, total_size);
+	// Variable size, kept at the end so that the RAM and VRAM offsets don't move
+	SerializeTAContext(data, total_size);
    settings.network.EmulateBBA = false;
 
+	if (buffer != NULL)
+	{
+		delta_slot = NULL;
+		if (bm_DirtyTrackingActive())
+		{
+			snapshot_slot *slot = NULL;
+			for (auto& it : snapshot_slots)
+				if (it.buffer == buffer)
+					slot = &it;
+			if (slot == NULL)
+			{
+				slot = &snapshot_slots[snapshot_next_slot];
+				snapshot_next_slot = (snapshot_next_slot + 1) % (sizeof(snapshot_slots) / sizeof(snapshot_slots[0]));
+			}
+			slot->buffer = buffer;
+			slot->id = snapshot_id;
+			slot->session = snapshot_session;
+			slot->ram_offset = ram_offset;
+			slot->vram_offset = vram_offset;
+			// Writes from now on belong to the new epochs
+			slot->ram_epoch = bm_DirtyTrackingRearm();
+			slot->vram_epoch = VramDirtyTrackingRearm();
+		}
+	}
+
 	return true ;
 }
 
@@ -612,6 +765,15 @@ bool dc_unserialize(void **data, unsigned int *total_size, size_t actual_data_si
 
 	LIBRETRO_US(version) ;
 
+	delta_slot = NULL;
+	if (version >= V14)
+	{
+		u64 snapshot_id;
+		delta_slot = find_snapshot_slot((u8 *)*data - sizeof(version));
+		delta_base = (const u8 *)*data - sizeof(version);
+		LIBRETRO_US(snapshot_id);
+	}
+
 	//This normally isn't necessary - but we need some way to differentiate between save states
 	//that were created after the format change and before the new format had a new version saved in it
 	if (version == V1 && actual_data_size != 48324799 && actual_data_size != 48855967)
@@ -830,10 +992,10 @@ bool dc_unserialize(void **data, unsigned int *total_size, size_t actual_data_si
 	}
 	KillTex = true;
 	pal_needs_update = true;
-	if (version >= V10)
+	if (version >= V10 && version < V14)
 		UnserializeTAContext(data, total_size, VCUR_LIBRETRO);
 
-	LIBRETRO_USA(vram.data, vram.size);
+	vram_unserialize(data, total_size);
 
 	LIBRETRO_USA(OnChipRAM.data,OnChipRAM_SIZE);
 
@@ -856,7 +1018,7 @@ bool dc_unserialize(void **data, unsigned int *total_size, size_t actual_data_si
 	else
 		ocache.Reset(true);
 
-	LIBRETRO_USA(mem_b.data, mem_b.size);
+	ram_unserialize(data, total_size);
 
 	if (version < V9)
 	{
@@ -1134,6 +1296,9 @@ bool dc_unserialize(void **data, unsigned int *total_size, size_t actual_data_si
 	}
 	if (version >= V7)
 		gd_hle_state.Unserialize(data, total_size);
+	if (version >= V14)
+		UnserializeTAContext(data, total_size, VCUR_LIBRETRO);
+	delta_slot = NULL;
 
 	return true ;
 }
@@ -3,6 +3,8 @@
 #include <stdlib.h>
 #include <vector>
 #include <string.h>
+#include <atomic>
+#include <functional>
 
 #include <rthreads/rthreads.h>
 
@@ -236,6 +238,50 @@ public :
 	}
 };
 
+// Pool of worker threads running batches of independent tasks.
+// Idle threads pick the next unclaimed task so that uneven tasks are balanced.
+class WorkerPool
+{
+public:
+	~WorkerPool() { Term(); }
+	// Starts the worker threads. The thread calling Run() also takes part.
+	void Init(int threads);
+	void Term();
+	// True between Init() and Term(), even if Init() started no thread
+	bool IsRunning() { return started; }
+	int ThreadCount() { return (int)threads.size() + 1; }
+	// Calls task(i) for each i in [0, count) and returns when they are all done.
+	// Nested or concurrent batches are run serially by the calling thread.
+	void Run(int count, const std::function<void(int)>& task);
+
+private:
+	static void WorkerEntry(void *param);
+	void Work();
+	void RunTasks();
+
+#ifndef TARGET_NO_THREADS
+	std::vector<sthread_t *> threads;
+	slock_t *mutx = nullptr;
+	scond_t *start_cond = nullptr;
+	scond_t *done_cond = nullptr;
+#else
+	std::vector<void *> threads;
+#endif
+	const std::function<void(int)> *task = nullptr;
+	int task_count = 0;
+	std::atomic<int> next_task;
+	std::atomic<bool> busy;
+	u32 batch = 0;
+	bool batch_open = false;
+	int active_workers = 0;
+	bool stopping = false;
+	bool started = false;
+};
+extern WorkerPool worker_pool;
+// Starts the worker pool used for texture decoding, sorting and software rendering,
+// if needed. Must be called from the render thread.
+void StartWorkerPool();
+
 //Set the path !
 void set_user_config_dir(const std::string& dir);
 void set_user_data_dir(const std::string& dir);
@@ -595,6 +595,7 @@ struct settings_t
 		bool PatchRegion;
 		bool LoadDefaultImage;
 		char DefaultImage[512];
+		u32 ChdCacheSize;	// CHD hunk cache size in MB
 	} imgread;
 
 	struct
@@ -634,6 +635,8 @@ struct settings_t
 		
 		u32 MaxThreads;
 		u32 SynchronousRendering;
+		u32 RenderQueueSize;	// max number of frames queued for the render thread
+		u32 TACaptureFrames;	// number of TA contexts to capture, see ta_capture.h
 	} pvr;
 
 	unsigned UpdateMode;
@@ -708,6 +711,11 @@ void libCore_gdrom_disc_change(void);
 
 //IO
 void libGDR_ReadSector(u8 * buff,u32 StartSector,u32 SectorCount,u32 secsz);
+void libGDR_ReadAhead(u32 StartSector,u32 SectorCount);
+// Starts reading sectors in the background. Only one read can be pending.
+void libGDR_ReadSectorAsync(u8 * buff,u32 StartSector,u32 SectorCount,u32 secsz);
+// Waits for the pending background read, if any
+void libGDR_WaitRead(void);
 void libGDR_ReadSubChannel(u8 * buff, u32 format, u32 len);
 void libGDR_GetToc(u32* toc,u32 area);
 u32 libGDR_GetDiscType(void);
@@ -783,6 +791,7 @@ bool ra_serialize(const void *src, unsigned int src_size, void **dest, unsigned
 bool ra_unserialize(void *src, unsigned int src_size, void **dest, unsigned int *total_size);
 bool dc_serialize(void **data, unsigned int *total_size);
 bool dc_unserialize(void **data, unsigned int *total_size, size_t actual_data_size);
+bool dc_can_restore_delta(const void *data, size_t size);
 
 #define LIBRETRO_S(v) ra_serialize(&(v), sizeof(v), data, total_size)
 #define LIBRETRO_US(v) ra_unserialize(&(v), sizeof(v), data, total_size)
@@ -911,5 +920,6 @@ enum serialize_version_enum {
 	V11,
    V12,
    V13,
-   VCUR_LIBRETRO = V13,
+   V14,
+   VCUR_LIBRETRO = V14,
 };